@@ -1,32 +1,106 @@
 # Used for visualizing charge and radius changes in VMD trajectories.
-# Loads a charge-radius text files where each line corresponds
-# to one frame with alternating charge - white space - radius values for each
-# atom.
+# Loads charge-radius information written by the `qrfile` analysis, either
 #
-# Inspired by http://klein-group.icms.temple.edu/cpmd-vmd/files/ar3plus-charge.vmd 
+# - a text file where each line corresponds to one frame with alternating
+#   charge - white space - radius values for each atom (e.g. `qrtraj.dat`), or
+# - a binary file with suffix `.qrtraj` where each frame stores only the
+#   atoms that changed since the previous frame.
+#
+# Inspired by http://klein-group.icms.temple.edu/cpmd-vmd/files/ar3plus-charge.vmd
 #
 # Usage:
 #
-# (1) Load trajectory into VMD - number of frames must match 'qrtraj.dat' file
-# (2) in the VMD console, `source vmd-qrtraj.tcl`
+# (1) Load trajectory into VMD - number of frames must match the charge-radius file
+# (2) in the VMD console, `source vmd-qrtraj.tcl`; `qrtraj.dat` is loaded unless
+#     the variable `qrfile` is set
+#
+# Examples:
+#
+#     vmd confout.pqr traj.xtc -e scripts/vmd-qrtraj.tcl
+#     vmd confout.pqr traj.xtc -e scripts/vmd-qrtraj.tcl -args qrtraj.qrtraj
+#
+# or from the VMD console:
+#
+#     set qrfile qrtraj.qrtraj
+#     source scripts/vmd-qrtraj.tcl
+
+# Read `n` frames from text file into arrays of charge and radius lists
+proc qr_read_text {filename n} {
+    global qrcharge qrradius
+    set fp [open $filename r]
+    for {set i 0} {$i < $n} {incr i} {
+        set charges {}
+        set radii {}
+        foreach {q r} [gets $fp] {
+            lappend charges $q
+            lappend radii $r
+        }
+        set qrcharge($i) $charges
+        set qrradius($i) $radii
+    }
+    close $fp
+}
+
+# Read `n` frames from binary `.qrtraj` file into arrays of charge and radius lists
+proc qr_read_binary {filename n} {
+    global qrcharge qrradius
+    set fp [open $filename r]
+    fconfigure $fp -translation binary
+    if {[read $fp 8] ne "FAUNQRTJ"} {
+        error "$filename is not a qr trajectory"
+    }
+    binary scan [read $fp 24] nunudnunu version flags precision natoms ntypes
+    # atom types: null terminated name, radius (float), charge (double)
+    for {set t 0} {$t < $ntypes} {incr t} {
+        while {[set c [read $fp 1]] ne "\0" && $c ne ""} {}
+        binary scan [read $fp 12] fd radius($t) charge($t)
+    }
+    set charges [lrepeat $natoms 0]
+    set radii [lrepeat $natoms 0]
+    for {set i 0} {$i < $n} {incr i} {
+        if {[binary scan [read $fp 4] nu nrecords] != 1} {
+            error "$filename has fewer frames than the loaded trajectory"
+        }
+        set data [read $fp [expr {10*$nrecords}]]
+        for {set k 0} {$k < $nrecords} {incr k} {
+            binary scan $data @[expr {10*$k}]nutun index id dq
+            if {$id == 65535} {
+                lset charges $index 0
+                lset radii $index 0
+            } else {
+                lset charges $index [expr {$charge($id) + $dq / $precision}]
+                lset radii $index $radius($id)
+            }
+        }
+        set qrcharge($i) $charges
+        set qrradius($i) $radii
+    }
+    close $fp
+}
+
+if {![info exists qrfile]} {
+    if {[info exists argv] && [llength $argv] > 0} {
+        set qrfile [lindex $argv 0]
+    } else {
+        set qrfile "qrtraj.dat"
+    }
+}
 
 set molid 0
 set n [molinfo $molid get numframes]
-set fp [open "qrtraj.dat" r]
-for {set i 0} {$i < $n} {incr i} {
-    set qrdata($i) [gets $fp]
+if {[file extension $qrfile] eq ".qrtraj"} {
+    qr_read_binary $qrfile $n
+} else {
+    qr_read_text $qrfile $n
 }
-close $fp
 
 proc do_update {args} {
-    global qrdata molid
-    set a [molinfo $molid get numatoms]
+    global qrcharge qrradius molid
     set f [molinfo $molid get frame]
-    for {set i 0} {$i < $a} {incr i 1} {
-        set s [atomselect $molid "index $i"]
-        $s set charge [lindex $qrdata($f) [expr 2*$i] ]
-        $s set radius [lindex $qrdata($f) [expr 2*$i+1 ] ]
-  }
+    set s [atomselect $molid all]
+    $s set charge $qrcharge($f)
+    $s set radius $qrradius($f)
+    $s delete
 }
 
 trace variable vmd_frame($molid) w do_update
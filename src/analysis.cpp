@@ -1,16 +1,25 @@
 #include "analysis.h"
 #include "move.h"
 #include "energy.h"
+#include "penalty.h"
 #include "reactioncoordinate.h"
 #include "multipole.h"
 #include "aux/iteratorsupport.h"
 #include "aux/eigensupport.h"
 #include <spdlog/spdlog.h>
-#include <zstr.hpp>
 #include <cereal/archives/binary.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/string.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <iomanip>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
 
 namespace Faunus {
 
@@ -26,18 +35,53 @@ void Analysisbase::_to_disk() {}
 
 void Analysisbase::to_disk() { _to_disk(); }
 
-void Analysisbase::sample() {
+void Analysisbase::_saveCheckpoint(cereal::BinaryOutputArchive &) const {}
+
+void Analysisbase::_loadCheckpoint(cereal::BinaryInputArchive &) {}
+
+/*
+ * Step counters are always restored so that sampling continues at the same
+ * interval. Accumulated data is restored only by analyses that implement
+ * `_loadCheckpoint()`.
+ */
+void Analysisbase::saveCheckpoint(cereal::BinaryOutputArchive &archive) const {
+    archive(name, stepcnt, totstepcnt, cnt);
+    _saveCheckpoint(archive);
+}
+
+void Analysisbase::loadCheckpoint(cereal::BinaryInputArchive &archive) {
+    std::string saved_name;
+    archive(saved_name, stepcnt, totstepcnt, cnt);
+    if (saved_name != name)
+        throw std::runtime_error("checkpoint mismatch: expected analysis " + name);
+    _loadCheckpoint(archive);
+}
+
+bool Analysisbase::countStep() {
     totstepcnt++;
     stepcnt++;
     if (stepcnt == steps) {
         stepcnt = 0;
-        if (totstepcnt > nskip) {
-            cnt++;
-            timer.start();
-            _sample();
-            timer.stop();
-        }
+        return totstepcnt > nskip;
     }
+    return false;
+}
+
+/*
+ * Step counters and the actual sampling are separated so that
+ * the former can be advanced on the simulation thread while the
+ * latter runs on an analysis thread; `cnt` is only touched here.
+ */
+void Analysisbase::sampleNow() {
+    cnt++;
+    timer.start();
+    _sample();
+    timer.stop();
+}
+
+void Analysisbase::sample() {
+    if (countStep())
+        sampleNow();
 }
 
 void Analysisbase::from_json(const json &j) {
@@ -74,26 +118,47 @@ void SystemEnergy::normalize() {
     }
 }
 
+/*
+ * Unless a full recalculation is due, the running energies maintained by the
+ * Hamiltonian from accepted moves are used. These are recalculated also if
+ * invalid (NaN), and the deviation from the running total is recorded.
+ */
 void SystemEnergy::_sample() {
-    auto ulist = energyFunc();
+    const auto &running = pot.runningEnergies();
+    double running_tot = std::accumulate(running.begin(), running.end(), 0.0);
+    bool use_running = recompute > 1 and running.size() == names.size() and (cnt - 1) % recompute != 0 and
+                       not std::isnan(running_tot);
+    auto ulist = use_running ? running : energyFunc();
     double tot = std::accumulate(ulist.begin(), ulist.end(), 0.0);
+    if (recompute > 1 and not use_running and std::isfinite(running_tot) and std::isfinite(tot)) {
+        running_error += std::fabs(tot) > 0 ? std::fabs((running_tot - tot) / tot) : std::fabs(running_tot);
+    }
     if (not std::isinf(tot)) {
         uavg += tot;
         u2avg += tot * tot;
     }
-    f << cnt * steps << sep << tot;
+    *output << cnt * steps << tot;
     for (auto u : ulist)
-        f << sep << u;
-    f << "\n";
+        *output << u;
     // ehist(tot)++;
 }
 
+void SystemEnergy::_saveCheckpoint(cereal::BinaryOutputArchive &archive) const {
+    archive(uinit, uavg, u2avg, running_error);
+}
+
+void SystemEnergy::_loadCheckpoint(cereal::BinaryInputArchive &archive) {
+    archive(uinit, uavg, u2avg, running_error);
+}
+
 void SystemEnergy::_to_json(json &j) const {
-    j = {{"file", file}, {"init", uinit}, {"final", energyFunc()}};
+    j = {{"file", file}, {"init", uinit}, {"final", energyFunc()}, {"recompute", recompute}};
     if (cnt > 0) {
         j["mean"] = uavg.avg();
         j["Cv/kB"] = u2avg.avg() - std::pow(uavg.avg(), 2);
     }
+    if (not running_error.empty())
+        j["running energy error"] = running_error.avg();
     _roundjson(j, 5);
     // normalize();
     // ehist.save( "distofstates.dat" );
@@ -101,47 +166,26 @@ void SystemEnergy::_to_json(json &j) const {
 
 void SystemEnergy::_from_json(const json &j) {
     file = MPI::prefix + j.at("file").get<std::string>();
-    if (f)
-        f.close();
-    f.open(file);
-    if (!f)
-        throw std::runtime_error(name + ": cannot open output file " + file);
+    recompute = j.value("recompute", 1);
+    if (recompute < 1)
+        throw std::runtime_error(name + ": `recompute` must be positive");
+    output = std::make_unique<TimeSeriesWriter>(file);
     assert(!names.empty());
-    std::string suffix = file.substr(file.find_last_of(".") + 1);
-    if (suffix == "csv")
-        sep = ",";
-    else {
-        sep = " ";
-        f << "#";
-    }
-    f << "total";
+    output->addColumn("step", TimeSeriesWriter::Type::INT64).addColumn("total");
     for (auto &n : names)
-        f << sep << n;
-    f << "\n";
-    f.precision(16);
+        output->addColumn(n);
 }
-SystemEnergy::SystemEnergy(const json &j, Energy::Hamiltonian &pot) {
+SystemEnergy::SystemEnergy(const json &j, Energy::Hamiltonian &pot) : pot(pot) {
     for (auto i : pot.vec)
         names.push_back(i->name);
     name = "systemenergy";
     from_json(j);
-    energyFunc = [&pot]() {
-        Change change;
-        change.all = true;
-        std::vector<double> u;
-        u.reserve(pot.vec.size());
-        for (auto i : pot.vec)
-            u.push_back(i->energy(change));
-        return u;
-    };
+    energyFunc = [&pot]() { return pot.recomputeRunningEnergies(); };
     ehist.setResolution(0.25);
     auto u = energyFunc();
     uinit = std::accumulate(u.begin(), u.end(), 0.0); // initial energy
 }
-void SystemEnergy::_to_disk() {
-    if (f)
-        f.flush(); // empty buffer
-}
+void SystemEnergy::_to_disk() { output->flush(); }
 
 void SaveState::_to_json(json &j) const { j["file"] = file; }
 
@@ -209,6 +253,108 @@ SaveState::SaveState(const json &j, Space &spc) {
         throw std::runtime_error("unknown file extension for '" + file + "'");
 }
 
+PairDistanceCounter::PairDistanceCounter(double dr, double rmax, int num_types)
+    : dr_inv(1.0 / dr), rmax(rmax), pair_index(num_types * num_types, -1), type_count(num_types),
+      num_types(num_types) {}
+
+void PairDistanceCounter::setSlice(const Point &dir, double thickness) {
+    slice = dir.sum() > 0;
+    slicedir = dir;
+    this->thickness = thickness;
+}
+
+int PairDistanceCounter::addPair(int type1, int type2) {
+    assert(type1 >= 0 and type1 < num_types and type2 >= 0 and type2 < num_types);
+    int &index = pair_index[type1 * num_types + type2];
+    if (index < 0) { // new pair
+        index = pair_index[type2 * num_types + type1] = pair_types.size();
+        pair_types.emplace_back(type1, type2);
+        pair_count.push_back(0);
+    }
+    return index;
+}
+
+/**
+ * Thread histograms are cleared, but not deallocated, before counting. With
+ * cell lists, each pair is visited once by the point with the lowest index.
+ * Cell lists are used only for orthogonal geometries; others loop over all pairs.
+ */
+void PairDistanceCounter::count(const Geometry::Chameleon &geo) {
+    const size_t n = positions.size();
+    int num_threads = 1;
+#ifdef _OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+    thread_counts.resize(num_threads);
+    for (auto &counts : thread_counts) {
+        counts.resize(pair_types.size());
+        for (auto &bins : counts)
+            std::fill(bins.begin(), bins.end(), 0.0);
+    }
+
+    std::fill(type_count.begin(), type_count.end(), 0);
+    for (auto type : types)
+        type_count[type]++;
+    for (size_t h = 0; h < pair_types.size(); h++) {
+        auto [a, b] = pair_types[h];
+        pair_count[h] = (a == b) ? 0.5 * type_count[a] * (type_count[a] - 1.0) : double(type_count[a]) * type_count[b];
+    }
+
+    const bool orthogonal = geo.type == Geometry::CUBOID or geo.type == Geometry::SLIT or
+                            geo.type == Geometry::SPHERE or geo.type == Geometry::CYLINDER;
+    const bool use_cells = std::isfinite(rmax) and orthogonal;
+    if (use_cells) {
+        cells.resize(geo.getLength(), rmax);
+        for (size_t i = 0; i < n; i++)
+            cells.insert(i, positions[i]);
+    }
+    const double rmax2 = rmax * rmax;
+
+#pragma omp parallel
+    {
+        int thread = 0;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+#endif
+        auto &counts = thread_counts[thread];
+        auto add = [&](size_t i, size_t j) {
+            int h = pair_index[types[i] * num_types + types[j]];
+            if (h >= 0) {
+                Point r = geo.vdist(positions[i], positions[j]);
+                if (slice and r.cwiseProduct(slicedir).norm() >= thickness)
+                    return;
+                double r2 = r.squaredNorm();
+                if (r2 < rmax2) {
+                    auto &bins = counts[h];
+                    size_t bin = std::sqrt(r2) * dr_inv;
+                    if (bin >= bins.size())
+                        bins.resize(bin + 1, 0.0);
+                    bins[bin] += 1;
+                }
+            }
+        };
+#pragma omp for schedule(dynamic, 64)
+        for (size_t i = 0; i < n; i++) {
+            if (use_cells)
+                cells.forEachNeighbor(cells.p2c(positions[i]), [&](size_t j) {
+                    if (j > i)
+                        add(i, j);
+                });
+            else
+                for (size_t j = i + 1; j < n; j++)
+                    add(i, j);
+        }
+    }
+}
+
+double PairDistanceCounter::addTo(int index, Equidistant2DTable<double, double> &hist) const {
+    for (auto &counts : thread_counts)
+        for (size_t bin = 0; bin < counts[index].size(); bin++)
+            if (counts[index][bin] > 0)
+                hist((bin + 0.5) / dr_inv) += counts[index][bin];
+    return pair_count[index];
+}
+
 PairFunctionBase::PairFunctionBase(const json &j) { from_json(j); }
 
 void PairFunctionBase::_to_json(json &j) const {
@@ -216,10 +362,15 @@ void PairFunctionBase::_to_json(json &j) const {
          {"slicedir", slicedir},    {"thickness", thickness}};
     if (Rhypersphere > 0)
         j["Rhyper"] = Rhypersphere;
+    if (std::isfinite(rmax))
+        j["rmax"] = rmax / 1.0_angstrom;
+    for (auto &pair : pairs)
+        j["pairs"].push_back({{"name1", pair.name1}, {"name2", pair.name2}, {"file", pair.file}});
 }
 
 void PairFunctionBase::_from_json(const json &j) {
-    assertKeys(j, {"file", "name1", "name2", "dim", "dr", "Rhyper", "nstep", "nskip", "slicedir", "thickness"});
+    assertKeys(j, {"file", "name1", "name2", "dim", "dr", "Rhyper", "nstep", "nskip", "slicedir", "thickness", "rmax",
+                   "pairs"});
     file = j.at("file");
     name1 = j.at("name1");
     name2 = j.at("name2");
@@ -229,12 +380,33 @@ void PairFunctionBase::_from_json(const json &j) {
     thickness = j.value("thickness", 0);
     hist.setResolution(dr, 0);
     Rhypersphere = j.value("Rhyper", -1.0);
+    rmax = j.value("rmax", pc::infty) * 1.0_angstrom;
+    if (rmax <= 0)
+        throw std::runtime_error("rmax must be positive");
+    if (std::isfinite(rmax) and slicedir.sum() > 0)
+        throw std::runtime_error("rmax cannot be combined with slicedir");
+    pairs.clear();
+    if (auto it = j.find("pairs"); it != j.end())
+        for (auto &i : *it) {
+            Pair pair;
+            pair.name1 = i.at("name1");
+            pair.name2 = i.at("name2");
+            pair.file = i.at("file");
+            pair.hist.setResolution(dr, 0);
+            pairs.push_back(pair);
+        }
 }
-void PairFunctionBase::_to_disk() {
-    std::ofstream f(MPI::prefix + file);
+
+/**
+ * Without `rmax`, all pairs are binned and the histogram sum equals the
+ * number of pairs. Otherwise the number of pairs counted while sampling is used.
+ */
+void PairFunctionBase::save(const std::string &filename, Equidistant2DTable<double, double> &table,
+                            double pair_count) const {
+    std::ofstream f(MPI::prefix + filename);
     if (f) {
-        double Vr = 1, sum = hist.sumy();
-        hist.stream_decorator = [&](std::ostream &o, double r, double N) {
+        double Vr = 1, sum = std::isfinite(rmax) ? pair_count : table.sumy();
+        table.stream_decorator = [&](std::ostream &o, double r, double N) {
             if (dim == 3)
                 Vr = 4 * pc::pi * std::pow(r, 2) * dr;
             else if (dim == 2) {
@@ -246,10 +418,16 @@ void PairFunctionBase::_to_disk() {
             if (Vr > 0)
                 o << r << " " << N * V / (Vr * sum) << "\n";
         };
-        f << hist;
+        f << table;
     }
 }
 
+void PairFunctionBase::_to_disk() {
+    save(file, hist, num_pairs);
+    for (auto &pair : pairs)
+        save(pair.file, pair.hist, pair.num_pairs);
+}
+
 PairAngleFunctionBase::PairAngleFunctionBase(const json &j) : PairFunctionBase(j) { from_json(j); }
 
 void PairAngleFunctionBase::_to_disk() {
@@ -264,29 +442,60 @@ void PairAngleFunctionBase::_to_disk() {
                               // base-destructor
 }
 
-void PairAngleFunctionBase::_from_json(const json &) { hist2.setResolution(dr, 0); }
+void PairAngleFunctionBase::_from_json(const json &j) {
+    for (auto key : {"rmax", "pairs"})
+        if (j.count(key))
+            throw std::runtime_error("'"s + key + "' is not supported by angular correlations");
+    hist2.setResolution(dr, 0);
+}
 
+/*
+ * Penalty functions count a visit whenever they are synced, which should
+ * happen only once per MC step, and are therefore left untouched. All other
+ * terms are synced as after a rejected move.
+ */
+void TrialState::restore(Change &change) {
+    spc.sync(accepted_spc, change);
+    if (pot.size() != accepted_pot.size())
+        throw std::runtime_error("hamiltonian mismatch");
+    for (size_t i = 0; i < pot.size(); i++)
+        if (not std::dynamic_pointer_cast<Energy::Penalty>(pot.vec[i]))
+            pot.vec[i]->sync(accepted_pot.vec[i].get(), change);
+}
+
+/*
+ * If a trial state is available, the volume is scaled in the trial state
+ * and the accepted state is never touched. The trial state is restored by
+ * copying, so no errors accumulate from repeated up and down scaling.
+ */
 void VirtualVolume::_sample() {
     if (fabs(dV) > 1e-10) {
         double Vold = getVolume(), Uold = pot.energy(c); // store old volume and energy
-        scaleVolume(Vold + dV);                          // scale entire system to new volume
-        double Unew = pot.energy(c);                     // energy after scaling
-        scaleVolume(Vold);                               // restore saved system
+        double Unew;
+        if (trial) {
+            trial->spc.scaleVolume(Vold + dV); // scale trial system to new volume
+            Unew = trial->pot.energy(c);       // energy after scaling
+            trial->restore(c);                 // copy back accepted state
+        } else {
+            scaleVolume(Vold + dV); // scale entire system to new volume
+            Unew = pot.energy(c);   // energy after scaling
+            scaleVolume(Vold);      // restore saved system
+        }
 
         double du = Unew - Uold;          // system energy change
         if (-du < pc::max_exp_argument) { // does minus energy change fit exp() function?
             double exp_du = std::exp(-du);
             assert(not std::isnan(exp_du));
             duexp += exp_du; // collect average, <exp(-du)>
-            if (output_file) // write sample event to output file
-                output_file << cnt << " " << dV << " " << du << " " << exp_du << " " << std::log(duexp.avg()) / dV
-                            << "\n";
+            if (output) // write sample event to output file
+                *output << cnt << dV << du << exp_du << std::log(duexp.avg()) / dV;
 
             // Check if volume and particle positions are properly restored.
             // Expensive and one would normally not perform this test and we trigger it
             // only when using log-level "debug" or lower
             if (faunus_logger->level() <= spdlog::level::debug and Uold != 0) {
-                double should_be_small = std::fabs((Uold - pot.energy(c)) / Uold); // expensive!
+                double Urestored = trial ? trial->pot.energy(c) : pot.energy(c); // expensive!
+                double should_be_small = std::fabs((Uold - Urestored) / Uold);
                 if (should_be_small > 1e-6)
                     faunus_logger->error("{} failed to restore system", name);
             }
@@ -301,15 +510,12 @@ void VirtualVolume::_from_json(const json &j) {
     dV = j.at("dV");
     file = MPI::prefix + j.value("file", std::string());
     if (not file.empty()) { // if filename is given, create output file
-        if (output_file)
-            output_file.close();
-        output_file.open(file);
-        if (!output_file)
-            throw std::runtime_error(name + ": cannot open output file " + file);
-        output_file << "# steps dV/" + u8::angstrom + u8::cubed + " du/kT exp(-du/kT) <Pex>/kT/" + u8::angstrom +
-                           u8::cubed
-                    << "\n"; // file header
-        output_file.precision(14);
+        output = std::make_unique<TimeSeriesWriter>(file);
+        output->addColumn("steps", TimeSeriesWriter::Type::INT64)
+            .addColumn("dV/" + u8::angstrom + u8::cubed)
+            .addColumn("du/kT")
+            .addColumn("exp(-du/kT)")
+            .addColumn("<Pex>/kT/" + u8::angstrom + u8::cubed);
     }
 }
 
@@ -318,7 +524,8 @@ void VirtualVolume::_to_json(json &j) const {
     j = {{"dV", dV}, {"Pex/mM", pex / 1.0_mM}, {"Pex/Pa", pex / 1.0_Pa}, {"Pex/kT/" + u8::angstrom + u8::cubed, pex}};
     _roundjson(j, 5);
 }
-VirtualVolume::VirtualVolume(const json &j, Space &spc, Energy::Energybase &pot) : pot(pot) {
+VirtualVolume::VirtualVolume(const json &j, Space &spc, Energy::Energybase &pot, std::shared_ptr<TrialState> trial)
+    : pot(pot), trial(trial) {
     from_json(j);
     c.dV = true;
     c.all = true;
@@ -328,17 +535,28 @@ VirtualVolume::VirtualVolume(const json &j, Space &spc, Energy::Energybase &pot)
     scaleVolume = [&spc](double Vnew) { spc.scaleVolume(Vnew); };
 }
 void VirtualVolume::_to_disk() {
-    if (output_file)
-        output_file.flush(); // empty buffer
+    if (output)
+        output->flush();
 }
 
 void QRtraj::_sample() { write_to_file(); }
 
-void QRtraj::_to_json(json &j) const { j = {{"file", file}}; }
+void QRtraj::_to_json(json &j) const {
+    j = {{"file", file}};
+    if (writer)
+        j["precision"] = precision;
+}
+
 QRtraj::QRtraj(const json &j, Space &spc) {
     from_json(j);
     name = "qrfile";
     file = j.value("file", "qrtraj.dat"s);
+    if (QRTrajectoryWriter::isBinary(file)) {
+        precision = j.value("precision", precision);
+        writer = std::make_unique<QRTrajectoryWriter>(MPI::prefix + file, precision);
+        write_to_file = [&groups = spc.groups, &writer = *writer]() { writer.save(groups); };
+        return;
+    }
     f.open(MPI::prefix + file);
     if (not f)
         throw std::runtime_error("error opening "s + file);
@@ -354,79 +572,357 @@ QRtraj::QRtraj(const json &j, Space &spc) {
     };
 }
 void QRtraj::_to_disk() {
-    if (f)
+    if (writer)
+        writer->flush();
+    else if (f)
         f.flush(); // empty buffer
 }
 
+void Snapshot::copyFrom(const Space &spc) {
+    const size_t n = spc.p.size();
+    positions.resize(n);
+    charges.resize(n);
+    ids.resize(n);
+    extensions.clear();
+    for (size_t i = 0; i < n; i++) {
+        const auto &particle = spc.p[i];
+        positions[i] = particle.pos;
+        charges[i] = particle.charge;
+        ids[i] = particle.id;
+        if (particle.hasExtension())
+            extensions.emplace_back(i, particle.getExt());
+    }
+    group_sizes.resize(spc.groups.size());
+    confids.resize(spc.groups.size());
+    mass_centers.resize(spc.groups.size());
+    for (size_t i = 0; i < spc.groups.size(); i++) {
+        group_sizes[i] = spc.groups[i].size();
+        confids[i] = spc.groups[i].confid;
+        mass_centers[i] = spc.groups[i].cm;
+    }
+    geo = spc.geo;
+}
+
+void Snapshot::copyTo(Space &spc) const {
+    if (spc.p.size() != positions.size() or spc.groups.size() != group_sizes.size())
+        throw std::runtime_error("snapshot does not match system size");
+    for (size_t i = 0; i < positions.size(); i++) {
+        auto &particle = spc.p[i];
+        particle.pos = positions[i];
+        particle.charge = charges[i];
+        particle.id = ids[i];
+    }
+    for (auto &[i, extension] : extensions)
+        spc.p[i].getExt() = extension;
+    for (size_t i = 0; i < group_sizes.size(); i++) {
+        auto &group = spc.groups[i];
+        group.resize(group_sizes[i]);
+        group.confid = confids[i];
+        group.cm = mass_centers[i];
+    }
+    spc.geo = geo;
+}
+
+/**
+ * @brief Samples analyses on worker threads from a bounded ring buffer of snapshots
+ *
+ * Each worker owns a private copy of the Space onto which snapshots are unpacked,
+ * as well as a fixed subset of the asynchronous analyses which are constructed
+ * against that copy. Step counters are advanced on the simulation thread and a
+ * snapshot is pushed only when at least one analysis is due. All workers visit all
+ * snapshots in order so that each analysis sees the same sequence of states as if
+ * sampled inline. A slot is reused only when all workers are done with it and the
+ * simulation thread waits if the buffer is full.
+ */
+class AnalysisPipeline {
+    struct Worker {
+        Space spc;                                                              // private copy of the system
+        std::vector<std::pair<size_t, std::shared_ptr<Analysisbase>>> analyses; // (index in `due`, analysis)
+        size_t tail = 0;                                                        // number of processed snapshots
+        std::thread thread;
+    };
+    const Space &spc;                                   // system to take snapshots of
+    std::vector<std::unique_ptr<Worker>> workers;       // stable addresses as analyses refer to `Worker::spc`
+    std::vector<std::shared_ptr<Analysisbase>> analyses; // all asynchronous analyses
+    std::vector<Snapshot> ring;                         // ring buffer
+    size_t head = 0;                                    // number of pushed snapshots
+    std::string prefix;                                 // file prefix (`MPI::prefix` is thread local)
+    double temperature;                                 // `pc::temperature` is also thread local
+    std::mutex mutex;
+    std::condition_variable produced, consumed;
+    std::exception_ptr error = nullptr;
+    bool stop = false;
+
+    size_t minTail() const; //!< Number of snapshots processed by all workers (lock required)
+    void run(Worker &worker);
+    void rethrow(); //!< Rethrow error from worker thread (lock required)
+
+  public:
+    AnalysisPipeline(const json &j, Space &spc);
+    ~AnalysisPipeline();
+    Space &nextSpace();                                //!< Space to construct the next analysis with
+    void add(std::shared_ptr<Analysisbase> analysis);  //!< Add analysis constructed with `nextSpace()`
+    void start();                                      //!< Start worker threads
+    void sample();                                     //!< Advance step counters and push snapshot if due
+    void flush();                                      //!< Wait until all snapshots have been processed
+    void join();                                       //!< Process remaining snapshots and stop workers
+    auto size() const { return analyses.size(); }      //!< Number of asynchronous analyses
+};
+
+AnalysisPipeline::AnalysisPipeline(const json &j, Space &spc) : spc(spc) {
+    int num_workers = j.value("workers", 1);
+    int buffer = j.value("buffer", 8);
+    if (num_workers < 1 or buffer < 1)
+        throw std::runtime_error("`workers` and `buffer` must be positive");
+    prefix = MPI::prefix;
+    temperature = pc::temperature;
+    ring.resize(buffer);
+    Change change;
+    change.all = true;
+    for (int i = 0; i < num_workers; i++) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->spc.sync(spc, change); // deep copy
+    }
+}
+
+AnalysisPipeline::~AnalysisPipeline() { join(); }
+
+Space &AnalysisPipeline::nextSpace() { return workers[analyses.size() % workers.size()]->spc; }
+
+void AnalysisPipeline::add(std::shared_ptr<Analysisbase> analysis) {
+    workers[analyses.size() % workers.size()]->analyses.emplace_back(analyses.size(), analysis);
+    analyses.push_back(analysis);
+}
+
+void AnalysisPipeline::start() {
+    for (auto &worker : workers)
+        if (not worker->analyses.empty())
+            worker->thread = std::thread(&AnalysisPipeline::run, this, std::ref(*worker));
+        else
+            worker->tail = std::numeric_limits<size_t>::max(); // idle workers never hold back the buffer
+    faunus_logger->debug("{} analyses sampled asynchronously by {} worker(s)", analyses.size(), workers.size());
+}
+
+size_t AnalysisPipeline::minTail() const {
+    size_t tail = head;
+    for (auto &worker : workers)
+        tail = std::min(tail, worker->tail);
+    return tail;
+}
+
+void AnalysisPipeline::rethrow() {
+    if (error)
+        std::rethrow_exception(std::exchange(error, nullptr));
+}
+
+void AnalysisPipeline::sample() {
+    bool any_due = false;
+    auto &due = ring[head % ring.size()].due; // safe: the slot is not read until `head` is incremented
+    std::unique_lock lock(mutex, std::defer_lock);
+    for (size_t i = 0; i < analyses.size(); i++) {
+        bool is_due = analyses[i]->countStep();
+        if (is_due and not any_due) {
+            lock.lock(); // wait for free slot before touching it
+            consumed.wait(lock, [&] { return error or head - minTail() < ring.size(); });
+            rethrow();
+            lock.unlock();
+            due.assign(analyses.size(), false);
+            any_due = true;
+        }
+        if (is_due)
+            due[i] = true;
+    }
+    if (any_due) {
+        ring[head % ring.size()].copyFrom(spc);
+        lock.lock();
+        head++;
+        lock.unlock();
+        produced.notify_all();
+    }
+}
+
+void AnalysisPipeline::flush() {
+    std::unique_lock lock(mutex);
+    consumed.wait(lock, [&] { return error or minTail() == head; });
+    rethrow();
+}
+
+void AnalysisPipeline::join() {
+    {
+        std::lock_guard lock(mutex);
+        stop = true;
+    }
+    produced.notify_all();
+    for (auto &worker : workers)
+        if (worker->thread.joinable())
+            worker->thread.join();
+}
+
+void AnalysisPipeline::run(Worker &worker) {
+    MPI::prefix = prefix;
+    pc::temperature = temperature;
+    try {
+        while (true) {
+            {
+                std::unique_lock lock(mutex);
+                produced.wait(lock, [&] { return stop or worker.tail < head; });
+                if (worker.tail == head)
+                    return; // stopped and nothing left to do
+            }
+            const auto &snapshot = ring[worker.tail % ring.size()];
+            bool unpacked = false;
+            for (auto &[index, analysis] : worker.analyses)
+                if (snapshot.due[index]) {
+                    if (not unpacked) {
+                        snapshot.copyTo(worker.spc);
+                        unpacked = true;
+                    }
+                    analysis->sampleNow();
+                }
+            {
+                std::lock_guard lock(mutex);
+                worker.tail++;
+            }
+            consumed.notify_all();
+        }
+    } catch (...) {
+        {
+            std::lock_guard lock(mutex);
+            if (not error)
+                error = std::current_exception();
+            worker.tail = std::numeric_limits<size_t>::max(); // never hold back the buffer again
+        }
+        consumed.notify_all();
+    }
+}
+
+/*
+ * Analyses that need the Hamiltonian, or state not captured by `Snapshot`
+ * (implicit reservoirs, particle vector layout), are always sampled on the
+ * simulation thread.
+ */
+const std::set<std::string> CombinedAnalysis::synchronous_keys = {
+    "systemenergy", "virtualvolume", "virtualtranslate", "widom", "sanity", "savestate", "spacetraj"};
+
 void CombinedAnalysis::sample() {
-    for (auto &ptr : this->vec)
+    for (auto &ptr : synchronous)
         ptr->sample();
+    if (pipeline)
+        pipeline->sample();
+}
+
+void CombinedAnalysis::flush() {
+    if (pipeline)
+        pipeline->flush();
 }
 
 void CombinedAnalysis::to_disk() {
+    flush();
     for (auto &ptr : this->vec)
         ptr->to_disk();
 }
 
-CombinedAnalysis::CombinedAnalysis(const json &j, Space &spc, Energy::Hamiltonian &pot) {
+void CombinedAnalysis::saveCheckpoint(cereal::BinaryOutputArchive &archive) {
+    flush();
+    archive(this->vec.size());
+    for (auto &ptr : this->vec)
+        ptr->saveCheckpoint(archive);
+}
+
+void CombinedAnalysis::loadCheckpoint(cereal::BinaryInputArchive &archive) {
+    flush();
+    size_t size;
+    archive(size);
+    if (size != this->vec.size())
+        throw std::runtime_error("checkpoint mismatch: number of analyses");
+    for (auto &ptr : this->vec)
+        ptr->loadCheckpoint(archive);
+}
+
+/*
+ * Worker threads must be stopped before the analyses and
+ * the copies of Space that they refer to are destroyed.
+ */
+CombinedAnalysis::~CombinedAnalysis() {
+    if (pipeline)
+        pipeline->join();
+}
+
+CombinedAnalysis::CombinedAnalysis(const json &j, Space &spc, Energy::Hamiltonian &pot,
+                                   std::shared_ptr<TrialState> trial) {
     if (j.is_array()) {
+        for (auto &m : j) // pipeline must exist before analyses are constructed
+            if (auto it = m.find("async"); it != m.end())
+                try {
+                    pipeline = std::make_unique<AnalysisPipeline>(*it, spc);
+                } catch (std::exception &e) {
+                    throw std::runtime_error("async: "s + e.what());
+                }
         for (auto &m : j) {
             for (auto it = m.begin(); it != m.end(); ++it) {
+                if (it.key() == "async")
+                    continue;
                 if (it->is_object()) {
                     try {
+                        bool is_async = pipeline and synchronous_keys.count(it.key()) == 0;
+                        Space &analysis_spc = is_async ? pipeline->nextSpace() : spc;
                         size_t oldsize = this->vec.size();
                         if (it.key() == "atomprofile")
-                            emplace_back<AtomProfile>(it.value(), spc);
+                            emplace_back<AtomProfile>(it.value(), analysis_spc);
                         else if (it.key() == "atomrdf")
-                            emplace_back<AtomRDF>(it.value(), spc);
+                            emplace_back<AtomRDF>(it.value(), analysis_spc);
                         else if (it.key() == "atomdipdipcorr")
-                            emplace_back<AtomDipDipCorr>(it.value(), spc);
+                            emplace_back<AtomDipDipCorr>(it.value(), analysis_spc);
                         else if (it.key() == "density")
-                            emplace_back<Density>(it.value(), spc);
+                            emplace_back<Density>(it.value(), analysis_spc);
                         else if (it.key() == "chargefluctuations")
-                            emplace_back<ChargeFluctuations>(it.value(), spc);
+                            emplace_back<ChargeFluctuations>(it.value(), analysis_spc);
                         else if (it.key() == "molrdf")
-                            emplace_back<MoleculeRDF>(it.value(), spc);
+                            emplace_back<MoleculeRDF>(it.value(), analysis_spc);
                         else if (it.key() == "multipole")
-                            emplace_back<Multipole>(it.value(), spc);
+                            emplace_back<Multipole>(it.value(), analysis_spc);
                         else if (it.key() == "atominertia")
-                            emplace_back<AtomInertia>(it.value(), spc);
+                            emplace_back<AtomInertia>(it.value(), analysis_spc);
                         else if (it.key() == "inertia")
-                            emplace_back<InertiaTensor>(it.value(), spc);
+                            emplace_back<InertiaTensor>(it.value(), analysis_spc);
                         else if (it.key() == "multipolemoments")
-                            emplace_back<MultipoleMoments>(it.value(), spc);
+                            emplace_back<MultipoleMoments>(it.value(), analysis_spc);
                         else if (it.key() == "multipoledist")
-                            emplace_back<MultipoleDistribution>(it.value(), spc);
+                            emplace_back<MultipoleDistribution>(it.value(), analysis_spc);
                         else if (it.key() == "polymershape")
-                            emplace_back<PolymerShape>(it.value(), spc);
+                            emplace_back<PolymerShape>(it.value(), analysis_spc);
                         else if (it.key() == "qrfile")
-                            emplace_back<QRtraj>(it.value(), spc);
+                            emplace_back<QRtraj>(it.value(), analysis_spc);
                         else if (it.key() == "reactioncoordinate")
-                            emplace_back<FileReactionCoordinate>(it.value(), spc);
+                            emplace_back<FileReactionCoordinate>(it.value(), analysis_spc);
                         else if (it.key() == "sanity")
-                            emplace_back<SanityCheck>(it.value(), spc);
+                            emplace_back<SanityCheck>(it.value(), analysis_spc);
                         else if (it.key() == "savestate")
-                            emplace_back<SaveState>(it.value(), spc);
+                            emplace_back<SaveState>(it.value(), analysis_spc);
                         else if (it.key() == "scatter")
-                            emplace_back<ScatteringFunction>(it.value(), spc);
+                            emplace_back<ScatteringFunction>(it.value(), analysis_spc);
                         else if (it.key() == "sliceddensity")
-                            emplace_back<SlicedDensity>(it.value(), spc);
+                            emplace_back<SlicedDensity>(it.value(), analysis_spc);
                         else if (it.key() == "systemenergy")
                             emplace_back<SystemEnergy>(it.value(), pot);
                         else if (it.key() == "virtualvolume")
-                            emplace_back<VirtualVolume>(it.value(), spc, pot);
+                            emplace_back<VirtualVolume>(it.value(), analysis_spc, pot, trial);
                         else if (it.key() == "virtualtranslate")
-                            emplace_back<VirtualTranslate>(it.value(), spc, pot);
+                            emplace_back<VirtualTranslate>(it.value(), analysis_spc, pot, trial);
                         else if (it.key() == "widom")
-                            emplace_back<WidomInsertion>(it.value(), spc, pot);
+                            emplace_back<WidomInsertion>(it.value(), analysis_spc, pot);
                         else if (it.key() == "xtcfile")
-                            emplace_back<XTCtraj>(it.value(), spc);
+                            emplace_back<XTCtraj>(it.value(), analysis_spc);
                         else if (it.key() == "spacetraj")
-                            emplace_back<SpaceTrajectory>(it.value(), spc.groups);
+                            emplace_back<SpaceTrajectory>(it.value(), analysis_spc);
                         // additional analysis go here...
 
                         if (this->vec.size() == oldsize)
                             throw std::runtime_error("unknown analysis: "s + it.key());
+                        if (is_async)
+                            pipeline->add(this->vec.back());
+                        else
+                            synchronous.push_back(this->vec.back());
 
                     } catch (std::exception &e) {
                         throw std::runtime_error(e.what() + usageTip[it.key()]);
@@ -435,6 +931,8 @@ CombinedAnalysis::CombinedAnalysis(const json &j, Space &spc, Energy::Hamiltonia
             }
         }
     }
+    if (pipeline)
+        pipeline->start();
 }
 
 void FileReactionCoordinate::_to_json(json &j) const {
@@ -451,24 +949,79 @@ void FileReactionCoordinate::_to_json(json &j) const {
 }
 
 void FileReactionCoordinate::_sample() {
-    if (file) {
-        double val = (*rc)();
-        avg += val;
-        file << fmt::format("{} {:.6f} {:.6f}\n", cnt * steps, val, avg.avg());
-    }
+    double val = (*rc)();
+    avg += val;
+    *output << cnt * steps << val << avg.avg();
 }
 
 FileReactionCoordinate::FileReactionCoordinate(const json &j, Space &spc) {
     from_json(j);
     name = "reactioncoordinate";
     filename = MPI::prefix + j.at("file").get<std::string>();
-    file.open(filename); // output file
     type = j.at("type").get<std::string>();
+    output = std::make_unique<TimeSeriesWriter>(filename);
+    output->addColumn("step", TimeSeriesWriter::Type::INT64)
+        .addColumn(j.value("property", type), TimeSeriesWriter::Type::FLOAT32)
+        .addColumn("average");
     rc = ReactionCoordinate::createReactionCoordinate({{type, j}}, spc);
 }
-void FileReactionCoordinate::_to_disk() {
-    if (file)
-        file.flush(); // empty buffer
+void FileReactionCoordinate::_to_disk() { output->flush(); }
+
+void CavityGrid::resize(const Geometry::Chameleon &geo) {
+    if (geo.type != Geometry::CUBOID)
+        throw std::runtime_error("cavity grid requires a cuboidal geometry");
+    box = geo.getLength();
+    dims = (box / spacing).array().floor().cast<int>().max(1);
+    cell_length = box.cwiseQuotient(dims.cast<double>());
+    block_radius = radius - 0.5 * cell_length.norm();
+    if (block_radius <= 0)
+        throw std::runtime_error("cavity grid spacing too large compared to cavity radius");
+    blocked.assign(dims.prod(), false);
+}
+
+void CavityGrid::block(const Geometry::Chameleon &geo, const Point &pos) {
+    const auto &periodic = geo.boundaryConditions().direction;
+    Point lower = (pos + 0.5 * box - Point::Constant(block_radius)).cwiseQuotient(cell_length);
+    Point upper = (pos + 0.5 * box + Point::Constant(block_radius)).cwiseQuotient(cell_length);
+    Eigen::Vector3i first = (lower.array() - 0.5).ceil().cast<int>();
+    Eigen::Vector3i last = (upper.array() - 0.5).floor().cast<int>();
+    Eigen::Vector3i c;
+    for (int i = first.x(); i <= last.x(); i++)
+        for (int j = first.y(); j <= last.y(); j++)
+            for (int k = first.z(); k <= last.z(); k++) {
+                c = {i, j, k};
+                bool inside = true;
+                for (int d = 0; d < 3; d++) {
+                    if (periodic[d] == Geometry::PERIODIC)
+                        c[d] = (c[d] % dims[d] + dims[d]) % dims[d];
+                    else if (c[d] < 0 or c[d] >= dims[d])
+                        inside = false;
+                }
+                if (inside) {
+                    Point center = (c.cast<double>().array() + 0.5).matrix().cwiseProduct(cell_length) - 0.5 * box;
+                    if (geo.sqdist(center, pos) < block_radius * block_radius)
+                        blocked[(size_t(c.x()) * dims.y() + c.y()) * dims.z() + c.z()] = true;
+                }
+            }
+}
+
+void CavityGrid::collect() {
+    cavities.clear();
+    for (size_t i = 0; i < blocked.size(); i++)
+        if (not blocked[i])
+            cavities.push_back(i);
+}
+
+double CavityGrid::fraction() const { return blocked.empty() ? 0.0 : double(cavities.size()) / blocked.size(); }
+
+bool CavityGrid::empty() const { return cavities.empty(); }
+
+Point CavityGrid::randomPoint(Random &rand) const {
+    assert(not cavities.empty());
+    size_t index = cavities[rand.range(0, int(cavities.size()) - 1)];
+    Eigen::Vector3i c(int(index / (dims.y() * dims.z())), int(index / dims.z() % dims.y()), int(index % dims.z()));
+    Point r(rand(), rand(), rand());
+    return (c.cast<double>() + r).cwiseProduct(cell_length) - 0.5 * box;
 }
 
 void WidomInsertion::_sample() {
@@ -476,6 +1029,10 @@ void WidomInsertion::_sample() {
         ParticleVector pin;
         auto &g = spc.groups.at(change.groups.at(0).index);
         assert(g.empty() && g.capacity() > 0);
+        if (cavity_grid.radius > 0 or not rotations.empty()) {
+            sampleBiased(g);
+            return;
+        }
         g.resize(g.capacity()); // active group
         for (int i = 0; i < ninsert; ++i) {
             pin = rins(spc.geo, spc.p, molecules.at(molid));
@@ -488,16 +1045,95 @@ void WidomInsertion::_sample() {
                 assert(pin.size() == g.size());
 
                 std::copy(pin.begin(), pin.end(), g.begin()); // copy into ghost group
-                if (not g.atomic)                             // update molecular mass-center
-                    g.cm = Geometry::massCenter(g.begin(), g.end(), spc.geo.getBoundaryFunc(), -g.begin()->pos);
-
-                expu += exp(-pot->energy(change)); // widom average
+                expu += exp(-ghostEnergy(g));                 // widom average
             }
         }
         g.resize(0); // deactive molecule
     }
 }
 
+double WidomInsertion::ghostEnergy(Group<Particle> &g) {
+    if (not g.atomic) // update molecular mass-center
+        g.cm = Geometry::massCenter(g.begin(), g.end(), spc.geo.getBoundaryFunc(), -g.begin()->pos);
+    return pot->energy(change);
+}
+
+/**
+ * With a cavity grid, points are drawn uniformly from the cavity cells only,
+ * and the returned weight is the cavity volume fraction. Trials that would
+ * have been placed outside cavities are assumed to have a vanishing Boltzmann
+ * factor. Without a grid, points are uniform in the container (weight one).
+ *
+ * @return False if there are no cavities
+ */
+bool WidomInsertion::insertionPoint(Point &pos, double &weight) {
+    if (cavity_grid.radius > 0) {
+        if (cavity_grid.empty())
+            return false;
+        pos = cavity_grid.randomPoint(random);
+        weight *= cavity_grid.fraction();
+    } else
+        spc.geo.randompos(pos, random);
+    return true;
+}
+
+/*
+ * The occupancy grid is built once per sample from all active particles
+ * (the ghost is still inactive) and shared by all `ninsert` trials. For
+ * atomic groups each atom is inserted independently so that the weight is
+ * the cavity fraction to the power of the number of atoms. Rigid molecules
+ * are inserted with their mass center in a cavity and, if `rotations` is
+ * non-empty, the Boltzmann factor is averaged over all fixed orientations at
+ * that point.
+ */
+void WidomInsertion::sampleBiased(Group<Particle> &g) {
+    if (cavity_grid.radius > 0) {
+        cavity_grid.update(spc.geo, spc.activeParticles());
+        cavity_fraction += cavity_grid.fraction();
+    }
+    g.resize(g.capacity()); // active group
+    for (int i = 0; i < ninsert; ++i) {
+        double weight = 1.0;
+        double boltzmann = 0.0; // remains zero if no cavity is found
+        Point cm;
+        molecules.at(molid).sampleConformation(ghost); // random, weighted conformation
+        if (g.atomic) {
+            bool inserted = true;
+            for (auto &particle : ghost) {
+                QuaternionRotate rot;
+                rot.set(2 * pc::pi * random(), ranunit(random));
+                particle.rotate(rot.first, rot.second);
+                inserted = inserted and insertionPoint(particle.pos, weight);
+            }
+            if (inserted) {
+                std::copy(ghost.begin(), ghost.end(), g.begin());
+                boltzmann = weight * std::exp(-ghostEnergy(g));
+            }
+        } else if (insertionPoint(cm, weight)) {
+            Geometry::cm2origo(ghost.begin(), ghost.end());
+            if (rotations.empty()) {
+                QuaternionRotate rot;
+                rot.set(random() * 2 * pc::pi, ranunit(random));
+                Geometry::rotate(ghost.begin(), ghost.end(), rot.first);
+                Geometry::translate(ghost.begin(), ghost.end(), cm, spc.geo.getBoundaryFunc());
+                std::copy(ghost.begin(), ghost.end(), g.begin());
+                boltzmann = weight * std::exp(-ghostEnergy(g));
+            } else {
+                double sum = 0;
+                for (auto &q : rotations) {
+                    std::copy(ghost.begin(), ghost.end(), g.begin());
+                    Geometry::rotate(g.begin(), g.end(), q);
+                    Geometry::translate(g.begin(), g.end(), cm, spc.geo.getBoundaryFunc());
+                    sum += std::exp(-ghostEnergy(g));
+                }
+                boltzmann = weight * sum / rotations.size();
+            }
+        }
+        expu += boltzmann; // every attempt counts in the average
+    }
+    g.resize(0); // deactive molecule
+}
+
 void WidomInsertion::_to_json(json &j) const {
     double excess = -std::log(expu.avg());
     j = {{"dir", rins.dir},
@@ -505,6 +1141,14 @@ void WidomInsertion::_to_json(json &j) const {
          {"insertions", expu.cnt},
          {"absz", absolute_z},
          {u8::mu + "/kT", {{"excess", excess}}}};
+    if (cavity_grid.radius > 0) {
+        j["cavity"] = cavity_grid.radius;
+        j["spacing"] = cavity_grid.spacing;
+        if (not cavity_fraction.empty())
+            j["cavity fraction"] = cavity_fraction.avg();
+    }
+    if (not rotations.empty())
+        j["orientations"] = rotations.size();
 }
 
 void WidomInsertion::_from_json(const json &j) {
@@ -512,6 +1156,19 @@ void WidomInsertion::_from_json(const json &j) {
     molname = j.at("molecule");
     absolute_z = j.value("absz", false);
     rins.dir = j.value("dir", Point({1, 1, 1}));
+    cavity_grid.radius = j.value("cavity", 0.0);
+    cavity_grid.spacing = j.value("spacing", 0.5 * cavity_grid.radius);
+    if (cavity_grid.radius < 0 or (cavity_grid.radius > 0 and cavity_grid.spacing <= 0))
+        throw std::runtime_error("`cavity` and `spacing` must be positive");
+
+    rotations.resize(j.value("orientations", 0));
+    for (auto &q : rotations) { // uniformly distributed orientations (Shoemake, 1992)
+        double u1 = random(), u2 = 2 * pc::pi * random(), u3 = 2 * pc::pi * random();
+        q = Eigen::Quaterniond(std::sqrt(u1) * std::cos(u3), std::sqrt(1 - u1) * std::sin(u2),
+                               std::sqrt(1 - u1) * std::cos(u2), std::sqrt(u1) * std::sin(u3));
+    }
+    if ((cavity_grid.radius > 0 or not rotations.empty()) and (absolute_z or rins.dir != Point(1, 1, 1)))
+        throw std::runtime_error("`absz` and `dir` cannot be combined with `cavity` or `orientations`");
 
     auto it = findName(molecules, molname); // loop for molecule in topology
     if (it != molecules.end()) {
@@ -591,6 +1248,14 @@ void Density::_sample() {
         }
     }
 }
+void Density::_saveCheckpoint(cereal::BinaryOutputArchive &archive) const {
+    archive(rho_mol, rho_atom, Lavg, Vavg, invVavg);
+}
+
+void Density::_loadCheckpoint(cereal::BinaryInputArchive &archive) {
+    archive(rho_mol, rho_atom, Lavg, Vavg, invVavg);
+}
+
 void Density::_to_json(json &j) const {
     using namespace u8;
     j[bracket("V")] = Vavg.avg();
@@ -732,67 +1397,82 @@ SanityCheck::SanityCheck(const json &j, Space &spc) : spc(spc) {
     name = "sanity";
     steps = j.value("nstep", -1);
 }
+/**
+ * Particles of the selected atom types are copied to contiguous arrays
+ * whereafter all requested pairs are binned in a single pass.
+ */
 void AtomRDF::_sample() {
     V += spc.geo.getVolume(dim);
-    auto active = spc.activeParticles();
-    for (auto i = active.begin(); i != active.end(); ++i)
-        for (auto j = i; ++j != active.end();)
-            if ((i->id == id1 && j->id == id2) || (i->id == id2 && j->id == id1)) {
-                Point rvec = spc.geo.vdist(i->pos, j->pos);
-                if (slicedir.sum() > 0) {
-                    if (rvec.cwiseProduct(slicedir.cast<double>()).norm() < thickness) {
-                        // rvec = rvec.cwiseProduct( Point(1.,1.,1.) - slice.cast<double>() );
-                        hist(rvec.norm())++;
-                    }
-                } else {
-                    hist(rvec.norm())++;
-                }
+    counter.positions.clear();
+    counter.types.clear();
+    for (auto &group : spc.groups)
+        for (auto &particle : group)
+            if (selected[particle.id]) {
+                counter.positions.push_back(particle.pos);
+                counter.types.push_back(particle.id);
             }
+    counter.count(spc.geo);
+    num_pairs += counter.addTo(0, hist);
+    for (auto &pair : pairs)
+        pair.num_pairs += counter.addTo(pair.index, pair.hist);
 }
 AtomRDF::AtomRDF(const json &j, Space &spc) : PairFunctionBase(j), spc(spc) {
     name = "atomrdf";
-    auto it = findName(atoms, name1);
-    if (it == atoms.end())
-        throw std::runtime_error("unknown atom '" + name1 + "'");
-    id1 = it->id();
-
-    it = findName(atoms, name2);
-    if (it == atoms.end())
-        throw std::runtime_error("unknown atom '" + name2 + "'");
-    id2 = it->id();
+    auto find = [&](const std::string &atom_name) {
+        auto it = findName(atoms, atom_name);
+        if (it == atoms.end())
+            throw std::runtime_error("unknown atom '" + atom_name + "'");
+        return it->id();
+    };
+    id1 = find(name1);
+    id2 = find(name2);
+    counter = PairDistanceCounter(dr, rmax, atoms.size());
+    counter.setSlice(slicedir.cast<double>(), thickness);
+    counter.addPair(id1, id2);
+    selected.assign(atoms.size(), false);
+    selected[id1] = selected[id2] = true;
+    for (auto &pair : pairs) {
+        pair.id1 = find(pair.name1);
+        pair.id2 = find(pair.name2);
+        pair.index = counter.addPair(pair.id1, pair.id2);
+        selected[pair.id1] = selected[pair.id2] = true;
+    }
 }
 void MoleculeRDF::_sample() {
     V += spc.geo.getVolume(dim);
-    auto mollist1 = spc.findMolecules(id1, Space::ACTIVE);
-    auto mollist2 = spc.findMolecules(id2, Space::ACTIVE);
-    // auto mollist = ranges::views::concat(mollist1, mollist2);
-
-    std::vector<std::reference_wrapper<Tspace::Tgroup>> mollist;
-    mollist.insert(mollist.end(), mollist1.begin(), mollist1.end());
-    mollist.insert(mollist.end(), mollist2.begin(), mollist2.end());
-
-    for (auto i = mollist.begin(); i != mollist.end(); ++i) {
-        for (auto j = i; ++j != mollist.end();) {
-            if ((i->get().id == id1 && j->get().id == id2) || (i->get().id == id2 && j->get().id == id1)) {
-                double r = std::sqrt(spc.geo.sqdist(i->get().cm, j->get().cm));
-                hist(r)++;
-            }
+    counter.positions.clear();
+    counter.types.clear();
+    for (auto &group : spc.groups)
+        if (group.size() == group.capacity() and selected[group.id]) {
+            counter.positions.push_back(group.cm);
+            counter.types.push_back(group.id);
         }
-    }
+    counter.count(spc.geo);
+    num_pairs += counter.addTo(0, hist);
+    for (auto &pair : pairs)
+        pair.num_pairs += counter.addTo(pair.index, pair.hist);
 }
 MoleculeRDF::MoleculeRDF(const json &j, Space &spc) : PairFunctionBase(j), spc(spc) {
     name = "molrdf";
-
-    auto it = findName(molecules, name1);
-    if (it == molecules.end())
-        throw std::runtime_error(name + ": unknown molecule '" + name1 + "'\n");
-    id1 = it->id();
-
-    it = findName(molecules, name2);
-    if (it == molecules.end())
-        throw std::runtime_error(name + ": unknown molecule '" + name2 + "'\n");
-    id2 = it->id();
+    auto find = [&](const std::string &molecule_name) {
+        auto it = findName(molecules, molecule_name);
+        if (it == molecules.end())
+            throw std::runtime_error(name + ": unknown molecule '" + molecule_name + "'\n");
+        return it->id();
+    };
+    id1 = find(name1);
+    id2 = find(name2);
     assert(id1 >= 0 && id2 >= 0);
+    counter = PairDistanceCounter(dr, rmax, molecules.size());
+    counter.addPair(id1, id2);
+    selected.assign(molecules.size(), false);
+    selected[id1] = selected[id2] = true;
+    for (auto &pair : pairs) {
+        pair.id1 = find(pair.name1);
+        pair.id2 = find(pair.name2);
+        pair.index = counter.addPair(pair.id1, pair.id2);
+        selected[pair.id1] = selected[pair.id2] = true;
+    }
 }
 
 void AtomDipDipCorr::_sample() {
@@ -838,54 +1518,51 @@ AtomDipDipCorr::AtomDipDipCorr(const json &j, Space &spc) : PairAngleFunctionBas
 
 // =============== XTCtraj ===============
 
-XTCtraj::XTCtraj(const json &j, Space &s) : filter([](Particle &) { return true; }), xtc(1e6), spc(s) {
-    from_json(j);
+XTCtraj::XTCtraj(const json &j, Space &s) : spc(s) {
     name = "xtcfile";
-    assert(filter); // filter must be callable
+    from_json(j);
+    writer = std::make_unique<XTCWriter>(file, buffer);
 }
 
 void XTCtraj::_to_json(json &j) const {
     j["file"] = file;
+    j["buffer"] = buffer;
     if (not names.empty())
         j["molecules"] = names;
 }
 
 void XTCtraj::_from_json(const json &j) {
     file = MPI::prefix + j.at("file").get<std::string>();
+    if (int n = j.value("buffer", int(buffer)); n > 0)
+        buffer = n;
+    else
+        throw std::runtime_error(name + ": buffer must be positive");
 
     // By default, *all* active and inactive groups are saved,
     // but here allow for a user defined list of molecule ids
     names = j.value("molecules", std::vector<std::string>());
-    if (not names.empty()) {
+    if (not names.empty())
         molids = Faunus::names2ids(Faunus::molecules, names); // molecule types to save
-        if (not molids.empty())
-            filter = [&](Particle &i) {
-                for (auto &g : spc.groups)     // loop over all active and inactive groups
-                    if (g.contains(i, true)) { // does group contain particle?
-                        if (std::find(molids.begin(), molids.end(), g.id) != molids.end())
-                            return true;
-                        else
-                            return false;
-                    }
-                return false;
-            };
-    };
 }
 
-void XTCtraj::_sample() {
-    xtc.setLength(spc.geo.getLength()); // set box dimensions for frame
+void XTCtraj::updateIndex() {
+    index.clear();
+    for (auto &group : spc.groups) // loop over all active and inactive groups
+        if (molids.empty() or std::find(molids.begin(), molids.end(), group.id) != molids.end())
+            for (auto it = group.begin(); it != group.trueend(); ++it)
+                index.push_back(it - spc.p.begin());
+    num_particles = spc.p.size();
+    num_groups = spc.groups.size();
+}
 
-    // On some gcc/clang and certain ubuntu/macos combinations,
-    // the ranges::view::filter(rng,unaryp) clears the `filter` function.
-    // Using the ranges piping seem to solve the issue.
-    assert(filter);
-    auto particles = spc.p | ranges::cpp20::views::filter(filter);
-    assert(filter);
-    bool rc = xtc.save(file, particles.begin(), particles.end());
-    if (rc == false)
-        faunus_logger->warn("error saving xtc");
+void XTCtraj::_sample() {
+    if (spc.p.size() != num_particles or spc.groups.size() != num_groups)
+        updateIndex();
+    writer->save(spc.geo.getLength(), index, spc.p);
 }
 
+void XTCtraj::_to_disk() { writer->flush(); }
+
 // =============== MultipoleDistribution ===============
 
 double MultipoleDistribution::g2g(const MultipoleDistribution::Tgroup &g1, const MultipoleDistribution::Tgroup &g2) {
@@ -1319,21 +1996,27 @@ Multipole::Multipole(const json &j, const Space &spc) : spc(spc) {
 }
 void ScatteringFunction::_sample() {
     p.clear();
+    weights.clear();
     for (int id : ids) { // loop over molecule names
         auto groups = spc.findMolecules(id);
         for (auto &g : groups) // loop over groups
-            if (use_com && !g.atomic)
+            if (use_com && !g.atomic) {
                 p.push_back(g.cm);
-            else
-                for (auto &i : g) // loop over particle index in group
+                if (use_charge)
+                    weights.push_back(monopoleMoment(g.begin(), g.end()));
+            } else
+                for (auto &i : g) { // loop over particle index in group
                     p.push_back(i.pos);
+                    if (use_charge)
+                        weights.push_back(i.charge);
+                }
     }
 
     // zero-padded suffix to use with `save_after_sample`
     std::string suffix = fmt::format("{:07d}", cnt);
     switch (scheme) {
     case DEBYE:
-        debye->sample(p, spc.geo.getVolume());
+        debye->sample(p, 1.0, spc.geo.getVolume());
         if (save_after_sample)
             IO::write(filename + "." + suffix, debye->getIntensity());
         break;
@@ -1347,6 +2030,11 @@ void ScatteringFunction::_sample() {
         if (save_after_sample)
             IO::write(filename + "." + suffix, explicit_average_ipbc->getSampling());
         break;
+    case FFT:
+        fft_average->sample(p, spc.geo.getLength(), weights);
+        if (save_after_sample)
+            IO::write(filename + "." + suffix, fft_average->getSampling());
+        break;
     }
 }
 void ScatteringFunction::_to_json(json &j) const {
@@ -1366,6 +2054,12 @@ void ScatteringFunction::_to_json(json &j) const {
         j["pmax"] = explicit_average_ipbc->getQMultiplier();
         j["ipbc"] = true;
         break;
+    case FFT:
+        j["scheme"] = "fft";
+        j["pmax"] = fft_average->getQMultiplier();
+        j["grid"] = fft_average->getGridSize();
+        j["charge"] = use_charge;
+        break;
     }
 }
 
@@ -1397,6 +2091,12 @@ ScatteringFunction::ScatteringFunction(const json &j, Space &spc) try : spc(spc)
             explicit_average_pbc = std::make_shared<Scatter::StructureFactorPBC<>>(pmax);
         }
         // todo: add warning if used a non-cubic system
+    } else if (scheme_str == "fft") {
+        scheme = FFT;
+        if (spc.geo.type != Geometry::CUBOID)
+            throw std::runtime_error("fft scheme requires a cuboid");
+        use_charge = j.value("charge", false);
+        fft_average = std::make_shared<Scatter::StructureFactorFFT<double>>(j.value("pmax", 15), j.value("grid", 0));
     } else
         throw std::runtime_error("unknown scheme");
 } catch (std::exception &e) {
@@ -1414,6 +2114,9 @@ void ScatteringFunction::_to_disk() {
     case EXPLICIT_IPBC:
         IO::write(filename, explicit_average_ipbc->getSampling());
         break;
+    case FFT:
+        IO::write(filename, fft_average->getSampling());
+        break;
     }
 }
 
@@ -1430,11 +2133,11 @@ void VirtualTranslate::_from_json(const json &j) {
     // if filename is given, open output stream and add header
     if (file = j.value("file", ""s); not file.empty()) {
         file = MPI::prefix + file;
-        output_file.open(file);
-        if (!output_file)
-            throw std::runtime_error(name + ": cannot open output file " + file);
-        output_file << "# steps dL/" + u8::angstrom + " du/kT <force>/kT/" + u8::angstrom + "\n"s;
-        output_file.precision(14);
+        output = std::make_unique<TimeSeriesWriter>(file);
+        output->addColumn("steps", TimeSeriesWriter::Type::INT64)
+            .addColumn("dL/" + u8::angstrom)
+            .addColumn("du/kT")
+            .addColumn("<force>/kT/" + u8::angstrom);
     }
 }
 void VirtualTranslate::_sample() {
@@ -1444,20 +2147,27 @@ void VirtualTranslate::_sample() {
             throw std::runtime_error(name + ": maximum ONE active molecule allowed");
         if (not ranges::cpp20::empty(mollist)) {
             if (auto it = random.sample(mollist.begin(), mollist.end()); not it->empty()) {
-                change.groups[0].index = &*it - &*spc.groups.begin(); // group index
-                double uold = pot.energy(change);              // old energy
-                Point dr = dL * dir;                           // translation vector
-                it->translate(dr, spc.geo.getBoundaryFunc());  // translate
-                double unew = pot.energy(change);              // new energy
-                it->translate(-dr, spc.geo.getBoundaryFunc()); // restore positions
+                int index = &*it - &*spc.groups.begin(); // group index
+                change.groups[0].index = index;
+                double uold = pot.energy(change); // old energy
+                Point dr = dL * dir;              // translation vector
+                double unew;
+                if (trial) { // translate copy in trial state
+                    trial->spc.groups[index].translate(dr, trial->spc.geo.getBoundaryFunc());
+                    unew = trial->pot.energy(change);
+                    trial->restore(change);
+                } else {
+                    it->translate(dr, spc.geo.getBoundaryFunc());  // translate
+                    unew = pot.energy(change);                     // new energy
+                    it->translate(-dr, spc.geo.getBoundaryFunc()); // restore positions
+                }
                 double du = unew - uold;
                 if (-du > pc::max_exp_argument)
                     faunus_logger->warn("{}: energy too negative to sample", name);
                 else {
                     average_exp_du += std::exp(-du); // widom / perturbation average
-                    if (output_file)                 // write sample event to output file
-                        output_file << fmt::format("{:d} {:.3f} {:.10f} {:.6f}\n", cnt, dL, du,
-                                                   std::log(average_exp_du) / dL);
+                    if (output)                      // write sample event to output file
+                        *output << cnt << dL << du << std::log(average_exp_du) / dL;
                 }
             }
         }
@@ -1466,56 +2176,53 @@ void VirtualTranslate::_sample() {
 void VirtualTranslate::_to_json(json &j) const {
     j = {{"dL", dL}, {"force", std::log(average_exp_du) / dL}, {"dir", dir}};
 }
-VirtualTranslate::VirtualTranslate(const json &j, Space &spc, Energy::Energybase &pot) : pot(pot), spc(spc) {
+VirtualTranslate::VirtualTranslate(const json &j, Space &spc, Energy::Energybase &pot,
+                                   std::shared_ptr<TrialState> trial)
+    : pot(pot), spc(spc), trial(trial) {
     from_json(j);
     name = "virtualtranslate";
     data.internal = false;
+    data.all = true;
     change.groups.push_back(data);
 }
 void VirtualTranslate::_to_disk() {
-    if (output_file)
-        output_file.flush(); // empty buffer
+    if (output)
+        output->flush();
 }
 
-SpaceTrajectory::SpaceTrajectory(const json &j, Space::Tgvec &groups) : groups(groups) {
+SpaceTrajectory::SpaceTrajectory(const json &j, Space &spc) : spc(spc) {
     from_json(j);
     name = "space trajectory";
-    filename = j.at("file");
-    if (useCompression())
-        stream = std::make_unique<zstr::ofstream>(MPI::prefix + filename, std::ios::binary);
-    else
-        stream = std::make_unique<std::ofstream>(MPI::prefix + filename, std::ios::binary);
-
-    if (stream != nullptr && *stream)
-        archive = std::make_unique<cereal::BinaryOutputArchive>(*stream);
-
-    if (not archive)
-        throw std::runtime_error("error creating "s + filename);
+    try {
+        filename = j.at("file").get<std::string>();
+        precision = j.value("precision", precision);
+        writer = std::make_unique<SpaceTrajectoryWriter>(MPI::prefix + filename, topology(spc), precision);
+    } catch (std::exception &e) {
+        throw std::runtime_error(name + ": " + e.what());
+    }
 }
 
-bool SpaceTrajectory::useCompression() const {
-    assert(!filename.empty());
-    std::string suffix = filename.substr(filename.find_last_of(".") + 1);
-    if (suffix == "ztraj")
-        return true;
-    else if (suffix == "traj")
-        return false;
-    else
-        throw std::runtime_error("Trajectory file suffix must be `.traj` or `.ztraj`");
+json SpaceTrajectory::topology(const Space &spc) {
+    json j = {{"geometry", spc.geo}, {"atoms", json::array()}, {"groups", json::array()}};
+    for (auto &atom : atoms)
+        j["atoms"].push_back(atom.name);
+    for (auto &group : spc.groups)
+        j["groups"].push_back({{"molecule", molecules.at(group.id).name}, {"capacity", group.capacity()}});
+    return j;
 }
 
 void SpaceTrajectory::_sample() {
-    assert(archive);
-    for (auto &group : groups) {
-        (*archive)(group);
-    }
+    assert(writer);
+    frame.copyFrom(spc);
+    frame.step = uint64_t(nskip) + uint64_t(cnt) * steps; // MC step of this sample
+    writer->save(frame);
 }
 
-void SpaceTrajectory::_to_json(json &j) const { j = {{"file", filename}}; }
-
-void SpaceTrajectory::_to_disk() {
-    assert(*stream);
-    stream->flush();
+void SpaceTrajectory::_to_json(json &j) const {
+    j = {{"file", filename}, {"precision", precision}, {"frames", writer->size()}};
 }
+
+void SpaceTrajectory::_to_disk() { writer->flush(); }
+
 } // namespace Analysis
 } // namespace Faunus
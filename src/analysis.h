@@ -5,12 +5,9 @@
 #include "scatter.h"
 #include "reactioncoordinate.h"
 #include "auxiliary.h"
+#include "celllist.h"
 #include <set>
 
-namespace cereal {
-class BinaryOutputArchive;
-}
-
 namespace Faunus {
 
 namespace Energy {
@@ -35,6 +32,8 @@ class Analysisbase {
     virtual void _from_json(const json &);
     virtual void _sample() = 0;
     virtual void _to_disk(); //!< save data to disk
+    virtual void _saveCheckpoint(cereal::BinaryOutputArchive &) const; //!< Save accumulated data, if supported
+    virtual void _loadCheckpoint(cereal::BinaryInputArchive &);        //!< Load accumulated data, if supported
     int stepcnt = 0;
     int totstepcnt = 0;
     TimeRelativeOfTotal<std::chrono::microseconds> timer;
@@ -51,7 +50,11 @@ class Analysisbase {
     void to_json(json &) const;    //!< JSON report w. statistics, output etc.
     void from_json(const json &);  //!< configure from json object
     void to_disk();                //!< Save data to disk (if defined)
-    virtual void sample();
+    bool countStep();              //!< Advance step counters; true if a sample is due now
+    void sampleNow();              //!< Sample regardless of step counters
+    virtual void sample();         //!< Sample if due according to `nstep` and `nskip`
+    void saveCheckpoint(cereal::BinaryOutputArchive &) const; //!< Save step counters and accumulated data
+    void loadCheckpoint(cereal::BinaryInputArchive &);        //!< Load step counters and accumulated data
     virtual ~Analysisbase() = default;
 };
 
@@ -64,7 +67,7 @@ class FileReactionCoordinate : public Analysisbase {
   private:
     Average<double> avg;
     std::string type, filename;
-    std::ofstream file;
+    std::unique_ptr<TimeSeriesWriter> output;
     std::shared_ptr<ReactionCoordinate::ReactionCoordinateBase> rc = nullptr;
 
     void _to_json(json &j) const override;
@@ -75,8 +78,51 @@ class FileReactionCoordinate : public Analysisbase {
     FileReactionCoordinate(const json &j, Space &spc);
 };
 
+/**
+ * @brief Occupancy grid to locate cavities in cuboidal boxes
+ *
+ * The box is divided into cells of equal volume. A cell is _blocked_ if every
+ * point in it lies within `radius` of a particle, i.e. if the cell center is
+ * closer than `radius` minus half the cell diagonal. Points drawn uniformly
+ * from the remaining cells therefore cover all of the cavity volume and the
+ * volume fraction of these cells is the exact bias of such insertions.
+ */
+class CavityGrid {
+    Point box = {0, 0, 0};           // box side lengths
+    Point cell_length = {0, 0, 0};   // cell side lengths
+    Eigen::Vector3i dims = {0, 0, 0}; // number of cells in each direction
+    double block_radius = 0;         // cells with centers closer than this to a particle are blocked
+    std::vector<char> blocked;       // blocked flag for each cell (row-major)
+    std::vector<size_t> cavities;    // index of all cells that are not blocked
+
+    void resize(const Geometry::Chameleon &geo);
+    void block(const Geometry::Chameleon &geo, const Point &pos); //!< Block cells around position
+    void collect();                                               //!< Collect unblocked cells
+
+  public:
+    double radius = 0;  //!< Cavity radius (Å)
+    double spacing = 1; //!< Target cell side length (Å)
+
+    template <class Tparticles> void update(const Geometry::Chameleon &geo, Tparticles &&particles) {
+        resize(geo);
+        for (const auto &particle : particles)
+            block(geo, particle.pos);
+        collect();
+    } //!< Rebuild grid from all particles
+
+    double fraction() const;           //!< Volume fraction of cavity cells
+    Point randomPoint(Random &) const; //!< Uniformly distributed point in cavity cells
+    bool empty() const;                //!< True if there are no cavity cells
+};
+
 /**
  * @brief Excess chemical potential of molecules
+ *
+ * Trial insertions are by default placed randomly in the container. If a
+ * cavity radius is given, insertion points are drawn from a `CavityGrid` only
+ * and each trial is weighted by the volume fraction of cavities.
+ * Rigid molecules may further be averaged over a fixed set of orientations
+ * at each insertion point.
  */
 class WidomInsertion : public Analysisbase {
     Space &spc;
@@ -89,6 +135,14 @@ class WidomInsertion : public Analysisbase {
     Average<double> expu;
     Change change;
 
+    CavityGrid cavity_grid;                     // occupancy grid for cavity biased insertion
+    Average<double> cavity_fraction;            // volume fraction of cavities
+    std::vector<Eigen::Quaterniond> rotations;  // fixed orientations for rigid molecules
+    ParticleVector ghost;                       // ghost conformation with mass center at origin
+
+    bool insertionPoint(Point &pos, double &weight); //!< Random insertion point and its bias weight
+    double ghostEnergy(Group<Particle> &group);      //!< Energy of active ghost group; updates mass center
+    void sampleBiased(Group<Particle> &group);       //!< Cavity biased and/or orientation averaged insertions
     void _sample() override;
     void _to_json(json &j) const override;
     void _from_json(const json &j) override;
@@ -166,6 +220,8 @@ class Density : public Analysisbase {
     void _sample() override;
     void _to_json(json &) const override;
     void _to_disk() override;
+    void _saveCheckpoint(cereal::BinaryOutputArchive &) const override;
+    void _loadCheckpoint(cereal::BinaryInputArchive &) override;
 
   public:
     Density(const json &, Space &);
@@ -209,23 +265,28 @@ class Multipole : public Analysisbase {
 }; // Molecular multipoles and their fluctuations
 
 class SystemEnergy : public Analysisbase {
-    std::string file, sep = " ";
-    std::ofstream f;
+    std::string file;
+    std::unique_ptr<TimeSeriesWriter> output;
+    Energy::Hamiltonian &pot;
     std::function<std::vector<double>()> energyFunc;
     Average<double> uavg, u2avg; //!< mean energy and mean squared energy
     std::vector<std::string> names;
     Table2D<double, double> ehist; // Density histograms
     double uinit;
+    int recompute = 1;               //!< Samples between full recalculations; otherwise use running energies
+    Average<double> running_error;   //!< Relative deviation of running energy at recalculations
 
     void normalize();
     void _sample() override;
     void _to_json(json &) const override;
     void _from_json(const json &) override;
     void _to_disk() override;
+    void _saveCheckpoint(cereal::BinaryOutputArchive &) const override;
+    void _loadCheckpoint(cereal::BinaryInputArchive &) override;
 
   public:
     SystemEnergy(const json &, Energy::Hamiltonian &);
-}; //!< Save system energy to disk. Keywords: `nstep`, `file`.
+}; //!< Save system energy to disk. Keywords: `nstep`, `file`, `recompute`.
 
 /**
  * @brief Checks if system is sane. If not, abort program.
@@ -252,6 +313,41 @@ class SaveState : public Analysisbase {
     SaveState(const json &, Space &);
 };
 
+/**
+ * @brief Distance histograms for many pairs of point types in a single pass
+ *
+ * Selected points are stored in contiguous arrays of positions and types,
+ * filled by the caller before each call to `count()`. Only pairs closer than
+ * `rmax` are binned; if finite, candidate pairs in orthogonal geometries are found
+ * with a `PeriodicCellList` while other geometries loop over all pairs.
+ * The loop over points is distributed over OpenMP threads, each with its own
+ * histograms that are merged by `addTo()`.
+ */
+class PairDistanceCounter {
+    double dr_inv = 10;                                          // inverse distance resolution
+    double rmax = pc::infty;                                     // ignore pairs further apart
+    bool slice = false;                                          // true if only pairs within a slice are counted
+    Point slicedir = {0, 0, 0};
+    double thickness = 0;
+    std::vector<int> pair_index;                                 // histogram index for each type pair (or -1)
+    std::vector<std::pair<int, int>> pair_types;                 // types of each histogram
+    std::vector<double> pair_count;                              // number of pairs in last pass
+    std::vector<size_t> type_count;                              // number of points of each type
+    std::vector<std::vector<std::vector<double>>> thread_counts; // thread -> histogram -> bin
+    PeriodicCellList cells;
+    int num_types = 0;
+
+  public:
+    std::vector<Point> positions; //!< Positions of selected points
+    std::vector<int> types;       //!< Type of each selected point, [0:num_types)
+
+    PairDistanceCounter(double dr = 0.1, double rmax = pc::infty, int num_types = 0);
+    void setSlice(const Point &dir, double thickness); //!< Count only pairs within slice
+    int addPair(int type1, int type2); //!< Add type pair; returns histogram index
+    void count(const Geometry::Chameleon &geo); //!< Bin all pairs of added types
+    double addTo(int index, Equidistant2DTable<double, double> &hist) const; //!< Merge histogram; returns number of pairs
+};
+
 /**
  * @brief Base class for distribution functions etc.
  */
@@ -267,6 +363,20 @@ class PairFunctionBase : public Analysisbase {
     std::string file;         // output filename
     double Rhypersphere = -1; // Radius of 2D hypersphere
     Average<double> V;        // average volume (angstrom^3)
+    double rmax = pc::infty;  // maximum distance to sample
+    double num_pairs = 0;     // number of pairs considered in all samples
+
+    struct Pair {
+        std::string name1, name2, file;
+        int id1 = -1, id2 = -1;
+        int index = 0; // histogram index in `PairDistanceCounter`
+        Equidistant2DTable<double, double> hist;
+        double num_pairs = 0;
+    };                       //!< Additional pair sampled in the same pass (`pairs`)
+    std::vector<Pair> pairs; // additional pairs
+    PairDistanceCounter counter;
+
+    void save(const std::string &, Equidistant2DTable<double, double> &, double) const; //!< Normalize and save
 
   private:
     void _from_json(const json &) override;
@@ -292,6 +402,7 @@ class PairAngleFunctionBase : public PairFunctionBase {
 /** @brief Atomic radial distribution function, g(r) */
 class AtomRDF : public PairFunctionBase {
     Space &spc;
+    std::vector<char> selected; // true for atom ids in any pair
 
     void _sample() override;
 
@@ -302,6 +413,7 @@ class AtomRDF : public PairFunctionBase {
 /** @brief Same as `AtomRDF` but for molecules. Identical input. */
 class MoleculeRDF : public PairFunctionBase {
     Space &spc;
+    std::vector<char> selected; // true for molecule ids in any pair
     void _sample() override;
   public:
     MoleculeRDF(const json &, Space &);
@@ -315,16 +427,27 @@ class AtomDipDipCorr : public PairAngleFunctionBase {
     AtomDipDipCorr(const json &, Space &);
 };
 
-/** @brief Write XTC trajectory file */
+/**
+ * @brief Write XTC trajectory file
+ *
+ * The selected particles are resolved into a list of indices which is updated only
+ * if the number of particles or groups changes. Frames are written by a `XTCWriter`
+ * on a background thread.
+ */
 class XTCtraj : public Analysisbase {
     std::vector<int> molids;        // molecule ids to save to disk
     std::vector<std::string> names; // molecule names of above
-    std::function<bool(Particle &)> filter; // function to filter molecule ids
+    std::vector<size_t> index;      // index of particles to save
+    size_t num_particles = 0;       // number of particles when `index` was last updated
+    size_t num_groups = 0;          // number of groups when `index` was last updated
+    size_t buffer = 4;              // maximum number of frames pending to be written
 
     void _to_json(json &) const override;
     void _from_json(const json &) override;
+    void _to_disk() override;
+    void updateIndex(); //!< Resolve selected molecules into particle index
 
-    FormatXTC xtc;
+    std::unique_ptr<XTCWriter> writer;
     Space &spc;
     std::string file;
 
@@ -334,15 +457,32 @@ class XTCtraj : public Analysisbase {
     XTCtraj(const json &j, Space &s);
 };
 
+/**
+ * @brief Trial copy of the system used for virtual perturbations
+ *
+ * Refers to the trial state of the simulation which, between MC steps, is
+ * identical to the accepted state. Analyses may perturb the trial state to
+ * evaluate energy changes without touching the accepted state, and must
+ * call `restore()` afterwards, similar to a rejected move.
+ */
+struct TrialState {
+    Space &spc;                        //!< Trial space
+    Energy::Hamiltonian &pot;          //!< Trial Hamiltonian
+    Space &accepted_spc;               //!< Accepted space
+    Energy::Hamiltonian &accepted_pot; //!< Accepted Hamiltonian
+    void restore(Change &change);      //!< Copy changes from accepted state into trial state
+};
+
 /**
  * @brief Excess pressure using virtual volume move
  */
 class VirtualVolume : public Analysisbase {
     std::string file; // output filename
-    std::ofstream output_file; // output filestream
+    std::unique_ptr<TimeSeriesWriter> output; // output time series
     double dV; // volume perturbation
     Change c;
     Energy::Energybase &pot;
+    std::shared_ptr<TrialState> trial; // perturbations are done here, if available
     std::function<double()> getVolume;
     std::function<void(double)> scaleVolume;
     Average<double> duexp; // < exp(-du/kT) >
@@ -353,7 +493,7 @@ class VirtualVolume : public Analysisbase {
     void _to_disk() override;
 
   public:
-    VirtualVolume(const json &, Space &, Energy::Energybase &);
+    VirtualVolume(const json &, Space &, Energy::Energybase &, std::shared_ptr<TrialState> = nullptr);
 };
 
 /**
@@ -372,8 +512,9 @@ class VirtualTranslate : public Analysisbase {
     double dL = 0;         //!< distance perturbation
     Energy::Energybase &pot;
     Space &spc;
-    Average<double> average_exp_du; //!< <exp(-du/kT)>
-    std::ofstream output_file;      // output filestream
+    std::shared_ptr<TrialState> trial; //!< perturbations are done here, if available
+    Average<double> average_exp_du;           //!< <exp(-du/kT)>
+    std::unique_ptr<TimeSeriesWriter> output; //!< output time series
 
     void _sample() override;
     void _from_json(const json &) override;
@@ -381,7 +522,7 @@ class VirtualTranslate : public Analysisbase {
     void _to_disk() override;
 
   public:
-    VirtualTranslate(const json &, Space &, Energy::Energybase &);
+    VirtualTranslate(const json &, Space &, Energy::Energybase &, std::shared_ptr<TrialState> = nullptr);
 };
 
 /**
@@ -420,13 +561,15 @@ class MultipoleDistribution : public Analysisbase {
  */
 class ScatteringFunction : public Analysisbase {
   private:
-    enum Schemes { DEBYE, EXPLICIT_PBC, EXPLICIT_IPBC}; // three different schemes
+    enum Schemes { DEBYE, EXPLICIT_PBC, EXPLICIT_IPBC, FFT}; // four different schemes
     Schemes scheme = DEBYE;
     Space &spc;
     bool use_com;                   // scatter from mass center, only?
+    bool use_charge = false;        // weight scattering points by charge (fft scheme)
     bool save_after_sample = false; // if true, save average S(q) after each sample point
     std::string filename;           // output file name
     std::vector<Point> p;           // vector of scattering points
+    std::vector<double> weights;    // charge of scattering points (if `use_charge`)
     std::vector<int> ids;           // Molecule ids
     std::vector<std::string> names; // Molecule names
     typedef Scatter::FormFactorUnity<double> Tformfactor;
@@ -434,6 +577,7 @@ class ScatteringFunction : public Analysisbase {
     std::shared_ptr<Scatter::DebyeFormula<Tformfactor>> debye;
     std::shared_ptr<Scatter::StructureFactorPBC<>> explicit_average_pbc;
     std::shared_ptr<Scatter::StructureFactorIPBC<>> explicit_average_ipbc;
+    std::shared_ptr<Scatter::StructureFactorFFT<double>> fft_average;
     void _sample() override;
     void _to_disk() override;
     void _to_json(json &j) const override;
@@ -534,12 +678,16 @@ class PolymerShape : public Analysisbase {
 /**
  * @brief "Trajectory" with charge and radius, only, for all (active, inactive) particles
  *
- * For use w. VMD to visualize charge fluctuations and grand canonical ensembles
+ * For use w. VMD to visualize charge fluctuations and grand canonical ensembles.
+ * Files with the suffix `.qrtraj` are written in a compact binary format
+ * (see `QRTrajectoryWriter`); otherwise as text.
  */
 class QRtraj : public Analysisbase {
   private:
     std::string file;
+    double precision = 10000; // inverse charge quantization step for binary output (1/e)
     std::ofstream f;
+    std::unique_ptr<QRTrajectoryWriter> writer;
     std::function<void()> write_to_file;
     void _sample() override;
     void _to_json(json &j) const override;
@@ -552,36 +700,71 @@ class QRtraj : public Analysisbase {
 /**
  * @brief Trajectory with full Space information
  *
- * The following are saved in (compressed) binary form:
- *
- * - all particle properties (id, position, charge, dipole etc.)
- * - all group properties (id, size, capacity etc.)
- *
- * If zlib compression is enabled the file size
- * is reduced by roughly a factor of two.
- *
- * @todo Geometry information
+ * Saves geometry, group sizes, conformations and mass centers, as well as
+ * id, charge and position of all particles to a random-access binary
+ * trajectory (see `FormatSpaceTrajectory`). The header contains the topology
+ * so that frames can be loaded back into a `Space` with `SpaceTrajectoryReader`.
  */
 class SpaceTrajectory : public Analysisbase {
   private:
-    Space::Tgvec &groups; // reference to all groups
+    Space &spc;
     std::string filename;
-    std::unique_ptr<std::ostream> stream;
-    std::unique_ptr<cereal::BinaryOutputArchive> archive;
+    double precision = 1000; // inverse quantization step (1/angstrom)
+    TrajectoryFrame frame;
+    std::unique_ptr<SpaceTrajectoryWriter> writer;
     void _sample() override;
     void _to_json(json &j) const override;
     void _to_disk() override;
-    bool useCompression() const; //!< decide from filename if zlib should be used
 
   public:
-    SpaceTrajectory(const json &, Space::Tgvec &);
+    SpaceTrajectory(const json &, Space &);
+    static json topology(const Space &); //!< Topology stored in the trajectory header
 };
 
+/**
+ * @brief Lightweight copy of the system state used for asynchronous analysis
+ *
+ * Stores positions, charges and ids of all particles; size, mass center and
+ * conformation of all groups; and the geometry. Extended properties (dipoles etc.)
+ * are stored only for particles that have them. Memory is retained between copies.
+ */
+struct Snapshot {
+    std::vector<Point> positions;
+    std::vector<double> charges;
+    std::vector<int> ids;
+    std::vector<std::pair<size_t, Particle::ParticleExtension>> extensions; //!< (particle index, extension)
+    std::vector<size_t> group_sizes;
+    std::vector<int> confids;
+    std::vector<Point> mass_centers;
+    Geometry::Chameleon geo;
+    std::vector<char> due; //!< Flag for each asynchronous analysis that should sample this snapshot
+
+    void copyFrom(const Space &spc); //!< Store state of space
+    void copyTo(Space &spc) const;   //!< Restore state into space of identical size
+};
+
+class AnalysisPipeline;
+
+/**
+ * @brief Aggregates analysis
+ *
+ * If the input contains an `async` entry, analyses that do not need the Hamiltonian
+ * or the full system state are sampled on worker threads (see `AnalysisPipeline`).
+ */
 struct CombinedAnalysis : public BasePointerVector<Analysisbase> {
-    CombinedAnalysis(const json &j, Space &spc, Energy::Hamiltonian &pot);
+    CombinedAnalysis(const json &j, Space &spc, Energy::Hamiltonian &pot, std::shared_ptr<TrialState> trial = nullptr);
+    ~CombinedAnalysis();
     void sample();
-    void to_disk(); // prompt all analysis to safe to disk if appropriate
-}; //!< Aggregates analysis
+    void to_disk(); // prompt all analysis to safe to disk if appropriate; calls `flush()`
+    void flush();   //!< Wait for asynchronous analyses to process all pending samples
+    void saveCheckpoint(cereal::BinaryOutputArchive &); //!< Save all analyses; calls `flush()`
+    void loadCheckpoint(cereal::BinaryInputArchive &);  //!< Load all analyses; calls `flush()`
+
+  private:
+    std::vector<std::shared_ptr<Analysisbase>> synchronous; //!< Analyses sampled on the calling thread
+    std::unique_ptr<AnalysisPipeline> pipeline;             //!< Asynchronous analyses (if any)
+    static const std::set<std::string> synchronous_keys;    //!< Analyses that need the Hamiltonian or full state
+};
 
 /** @brief Example analysis */
 template <class T, class Enable = void> struct _analyse {
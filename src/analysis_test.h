@@ -0,0 +1,188 @@
+#include "analysis.h"
+#include "montecarlo.h"
+
+namespace Faunus {
+namespace Analysis {
+
+TEST_CASE("[Faunus] Snapshot") {
+    Space spc1;
+    spc1.geo = R"( {"type": "cuboid", "length": [10, 20, 30]} )"_json;
+    Particle a;
+    a.id = 0;
+    spc1.p.assign(3, a);
+    spc1.groups.emplace_back(spc1.p.begin(), spc1.p.end());
+
+    Change change;
+    change.all = true;
+    Space spc2;
+    spc2.sync(spc1, change); // identical copy
+
+    spc1.p[1].pos = {1, 2, 3};
+    spc1.p[1].charge = -1;
+    spc1.p[2].getExt().mu = {0, 0, 1};
+    spc1.groups[0].resize(2);
+    spc1.groups[0].cm = {0.5, 1, 1.5};
+    spc1.geo.setLength({20, 20, 20});
+
+    Snapshot snapshot;
+    snapshot.copyFrom(spc1);
+    CHECK(snapshot.extensions.size() == 1);
+    snapshot.copyTo(spc2);
+    CHECK(spc2.p[1].pos == Point(1, 2, 3));
+    CHECK(spc2.p[1].charge == doctest::Approx(-1));
+    CHECK(spc2.p[2].getExt().mu == Point(0, 0, 1));
+    CHECK(spc2.groups[0].size() == 2);
+    CHECK(spc2.groups[0].cm == Point(0.5, 1, 1.5));
+    CHECK(spc2.geo.getVolume() == doctest::Approx(8000));
+    CHECK(&spc2.p[1] != &spc1.p[1]);
+
+    Space spc3; // empty
+    CHECK_THROWS(snapshot.copyTo(spc3));
+}
+
+TEST_CASE("[Faunus] CavityGrid") {
+    Geometry::Chameleon geo;
+    geo = R"( {"type": "cuboid", "length": 10} )"_json;
+    ParticleVector p(1);
+    p[0].pos = {4.9, 0, 0}; // close to boundary
+    CavityGrid grid;
+    grid.radius = 2;
+    grid.spacing = 0.5;
+    grid.update(geo, p);
+    double excluded = 4.0 / 3.0 * pc::pi * std::pow(grid.radius, 3) / geo.getVolume();
+    CHECK(grid.fraction() < 1.0);
+    CHECK(grid.fraction() >= 1.0 - excluded);
+    Random rand;
+    int overlaps = 0; // cavity points are never deep inside the excluded sphere
+    for (int i = 0; i < 1000; i++)
+        overlaps += (geo.sqdist(grid.randomPoint(rand), p[0].pos) < 1.0);
+    CHECK(overlaps == 0);
+    grid.radius = 0.1;
+    CHECK_THROWS(grid.update(geo, p)); // spacing too coarse
+}
+
+TEST_CASE("[Faunus] PairDistanceCounter") {
+    Geometry::Chameleon geo;
+    geo = R"( {"type": "cuboid", "length": [10, 12, 14]} )"_json;
+    Random rand;
+    const double rmax = 3.0;
+    PairDistanceCounter cells(0.5, rmax, 2), all_pairs(0.5, pc::infty, 2);
+    Point pos;
+    for (int i = 0; i < 200; i++) {
+        geo.randompos(pos, rand);
+        for (auto counter : {&cells, &all_pairs}) {
+            counter->positions.push_back(pos);
+            counter->types.push_back(i % 2);
+        }
+    }
+    for (auto counter : {&cells, &all_pairs}) {
+        CHECK(counter->addPair(0, 1) == 0);
+        CHECK(counter->addPair(1, 1) == 1);
+        counter->count(geo);
+    }
+    for (int index : {0, 1}) {
+        Equidistant2DTable<double, double> hist_cells(0.5, 0), hist_all(0.5, 0);
+        CHECK(cells.addTo(index, hist_cells) == doctest::Approx(all_pairs.addTo(index, hist_all)));
+        CHECK(hist_cells.sumy() > 0);
+        for (double r = 0.25; r < rmax; r += 0.5) // identical below rmax
+            CHECK(hist_cells(r) == doctest::Approx(hist_all(r)));
+        CHECK(hist_cells.sumy() < hist_all.sumy());
+    }
+}
+
+TEST_CASE("[Faunus] SystemEnergy and energy drift") {
+    auto atoms_backup = atoms;         // restored below as the
+    auto molecules_backup = molecules; // topology is global
+    atoms.clear();                     // topology is loaded
+    molecules.clear();                 // only if empty
+    json j = R"({
+        "temperature": 300,
+        "geometry": {"type": "cuboid", "length": 50},
+        "atomlist": [{"Na": {"q": 1.0, "eps": 0.15, "sigma": 4.0, "dp": 10}},
+                     {"Cl": {"q": -1.0, "eps": 0.20, "sigma": 4.0, "dp": 10}}],
+        "moleculelist": [{"salt": {"atoms": ["Na", "Cl"], "atomic": true}}],
+        "insertmolecules": [{"salt": {"N": 5}}],
+        "energy": [{"nonbonded": {"default": [{"lennardjones": {"mixing": "LB"}},
+                                              {"coulomb": {"type": "plain", "epsr": 80}}]}}],
+        "moves": [{"transrot": {"molecule": "salt"}}],
+        "random": {"seed": "fixed"}
+    })"_json;
+    const std::string filename = "systemenergy_test.dat";
+    {
+        MCSimulation sim(j, MPI::mpi);
+        SystemEnergy systemenergy(R"({"file": "systemenergy_test.dat", "nstep": 1})"_json, sim.pot());
+        for (int i = 0; i < 20; i++) {
+            sim.move();
+            systemenergy.sampleNow();
+        }
+        CHECK(sim.drift() == doctest::Approx(0.0));
+
+        auto &particle = sim.space().p.front(); // displace without a move to cause drift
+        particle.pos = sim.space().p.back().pos + Point(4.5, 0, 0);
+        sim.space().geo.boundary(particle.pos);
+        systemenergy.sampleNow(); // resets the running energies of the Hamiltonian...
+        sim.drift();
+        REQUIRE(sim.driftTerms().size() == 1);
+        CHECK(std::fabs(sim.driftTerms().front()) > 1e-3); // ...but not the drift of each term
+    }
+    std::remove(filename.c_str());
+    atoms = atoms_backup;
+    molecules = molecules_backup;
+}
+
+TEST_CASE("[Faunus] AnalysisPipeline") {
+    auto atoms_backup = atoms;
+    auto molecules_backup = molecules;
+    atoms.clear();
+    molecules.clear();
+    json j = R"({
+        "temperature": 300,
+        "geometry": {"type": "cuboid", "length": 50},
+        "atomlist": [{"Na": {"q": 1.0, "eps": 0.15, "sigma": 4.0, "dp": 10}},
+                     {"Cl": {"q": -1.0, "eps": 0.20, "sigma": 4.0, "dp": 10}}],
+        "moleculelist": [{"salt": {"atoms": ["Na", "Cl"], "atomic": true}}],
+        "insertmolecules": [{"salt": {"N": 5}}],
+        "energy": [{"nonbonded": {"default": [{"lennardjones": {"mixing": "LB"}},
+                                              {"coulomb": {"type": "plain", "epsr": 80}}]}}],
+        "moves": [{"transrot": {"molecule": "salt"}}],
+        "random": {"seed": "fixed"}
+    })"_json;
+    auto input = [](const std::string &suffix) { // same analyses but different files
+        json list = json::array();
+        for (std::string property : {"x", "y"})
+            list.push_back({{"reactioncoordinate",
+                             {{"type", "atom"}, {"index", 0}, {"property", property}, {"nstep", 3},
+                              {"file", "pipeline_test_" + property + suffix + ".dat"}}}});
+        return list;
+    };
+    {
+        MCSimulation sim(j, MPI::mpi);
+        CombinedAnalysis inline_analysis(input("_inline"), sim.space(), sim.pot());
+        json async_input = input("_async");
+        async_input.push_back({{"async", {{"workers", 2}, {"buffer", 2}}}});
+        CombinedAnalysis async_analysis(async_input, sim.space(), sim.pot());
+        for (int i = 0; i < 100; i++) {
+            sim.move();
+            inline_analysis.sample();
+            async_analysis.sample();
+        }
+        async_analysis.flush();
+        REQUIRE(inline_analysis.vec.size() == 2);
+        REQUIRE(async_analysis.vec.size() == 2);
+        for (size_t i = 0; i < 2; i++) {
+            json a = json(*inline_analysis.vec[i]).at("reactioncoordinate");
+            json b = json(*async_analysis.vec[i]).at("reactioncoordinate");
+            CHECK(a.at("samples").get<int>() > 0);
+            CHECK(b.at("samples") == a.at("samples"));
+            CHECK(b.at("average").get<double>() == doctest::Approx(a.at("average").get<double>()));
+        }
+    }
+    for (std::string property : {"x", "y"})
+        for (std::string suffix : {"_inline", "_async"})
+            std::remove(("pipeline_test_" + property + suffix + ".dat").c_str());
+    atoms = atoms_backup;
+    molecules = molecules_backup;
+}
+
+} // namespace Analysis
+} // namespace Faunus
@@ -1530,6 +1530,10 @@ namespace Faunus
 
               void stop() { delta += std::chrono::duration_cast<Tunit>(std::chrono::steady_clock::now() - tx); }
 
+              double seconds() const {
+                  return std::chrono::duration<double>(delta).count();
+              } //!< Accumulated time in seconds
+
               double result() const {
                   auto now = std::chrono::steady_clock::now();
                   auto total = std::chrono::duration_cast<Tunit>(now - t0);
@@ -6,6 +6,9 @@
 #include <cassert>
 #include <cmath>
 #include <array>
+#include <algorithm>
+#include <functional>
+#include <map>
 #include <Eigen/Core>
 
 namespace Faunus {
@@ -130,7 +133,150 @@ template <typename CellPoint = Eigen::Vector3i> class CellList {
     } //!< Index from all 26+1 neighboring+own cells (complexity: N neighbors)
 };
 
+/**
+ * @brief Dense, periodic cell list for orthogonal boxes
+ *
+ * Unlike `CellList`, cells are obtained by flooring and wrapping so that every
+ * cell has a side length of _at least_ the given cutoff and the 27 neighboring cells
+ * hence contain all points within the cutoff. Cells are stored row-major in
+ * a single vector of `std::vector<size_t>` which is cheap to clear and refill.
+ *
+ * - cartesian space is assumed to be centered around 0,0,0 (as `Geometry::Cuboid`)
+ * - boxes with fewer than three cells in a direction are handled without
+ *   visiting the same cell twice
+ *
+ * @date Malmo, 2020
+ */
+class PeriodicCellList {
+  public:
+    typedef size_t Tindex;
+    typedef Eigen::Vector3d Point;
+    typedef Eigen::Vector3i CellPoint;
+
+  private:
+    Point box = {0, 0, 0};
+    Point cellsize = {0, 0, 0};
+    CellPoint dims = {0, 0, 0};
+    std::vector<std::vector<Tindex>> cells;
+
+    static inline int wrap(int i, int n) { return (i % n + n) % n; }
+
+  public:
+    /**
+     * @param box Side lengths of box
+     * @param cutoff Minimum cell side length
+     */
+    void resize(const Point &box, double cutoff) {
+        assert(cutoff > 0);
+        this->box = box;
+        CellPoint new_dims = (box / cutoff).array().floor().template cast<int>().max(1);
+        cellsize = box.cwiseQuotient(new_dims.template cast<double>());
+        if (new_dims != dims) {
+            dims = new_dims;
+            cells.assign(dims.prod(), {});
+        } else
+            clear(); // retain memory
+    }
+
+    const CellPoint &size() const { return dims; }          //!< Number of cells in each direction
+    const Point &getCellLength() const { return cellsize; } //!< Side lengths of a single cell
+
+    CellPoint p2c(const Point &p) const {
+        CellPoint c = (p + 0.5 * box).cwiseQuotient(cellsize).array().floor().template cast<int>();
+        for (int d = 0; d < 3; d++)
+            c[d] = wrap(c[d], dims[d]);
+        return c;
+    } //!< cartesian point --> cell point (wrapped into box)
+
+    size_t index(const CellPoint &c) const {
+        return (size_t(c[0]) * dims[1] + c[1]) * dims[2] + c[2];
+    } //!< row-major index of cell point
+
+    std::vector<Tindex> &operator[](const CellPoint &c) { return cells[index(c)]; }
+    const std::vector<Tindex> &operator[](const CellPoint &c) const { return cells[index(c)]; }
+
+    void clear() {
+        for (auto &cell : cells)
+            cell.clear();
+    } //!< clear all index in cell list; memory is retained
+
+    void insert(Tindex i, const Point &p) { (*this)[p2c(p)].push_back(i); } //!< insert index at position
+
+    void erase(Tindex i, const CellPoint &c) {
+        auto &cell = (*this)[c];
+        auto it = std::find(cell.begin(), cell.end(), i);
+        assert(it != cell.end() && "index not present in cell");
+        *it = cell.back();
+        cell.pop_back();
+    } //!< remove index from cell (order in cell is not preserved)
+
+    void move(Tindex i, const CellPoint &src, const CellPoint &dst) {
+        if (src != dst) {
+            erase(i, src);
+            (*this)[dst].push_back(i);
+        }
+    } //!< move index from one cell to another
+
+    template <class Tpvec, class T = std::function<Point(const typename Tpvec::value_type &)>>
+    void update(
+        const Tpvec &p, T getpos = [](auto &i) { return i; }) {
+        clear();
+        for (Tindex i = 0; i < p.size(); i++)
+            insert(i, getpos(p[i]));
+    } //!< fill cell list from all positions in vector
+
+    /**
+     * @brief Call function for each index in own and neighboring cells
+     *
+     * Each cell is visited only once, also for boxes with less than
+     * three cells in a given direction.
+     */
+    template <class Tfunction> void forEachNeighbor(const CellPoint &c, Tfunction f) const {
+        std::array<std::array<int, 3>, 3> offsets;
+        std::array<int, 3> n;
+        for (int d = 0; d < 3; d++) {
+            n[d] = std::min(dims[d], 3);
+            for (int k = 0; k < n[d]; k++)
+                offsets[d][k] = wrap(c[d] + k - 1, dims[d]);
+        }
+        for (int i = 0; i < n[0]; i++)
+            for (int j = 0; j < n[1]; j++)
+                for (int k = 0; k < n[2]; k++)
+                    for (auto index : (*this)[CellPoint(offsets[0][i], offsets[1][j], offsets[2][k])])
+                        f(index);
+    }
+
+    void neighbors(const CellPoint &c, std::vector<Tindex> &index, bool clear = true) const {
+        if (clear)
+            index.clear();
+        forEachNeighbor(c, [&](Tindex i) { index.push_back(i); });
+    } //!< Index from all 26+1 neighboring+own cells (complexity: N neighbors)
+};
+
 #ifdef DOCTEST_LIBRARY_INCLUDED
+TEST_CASE("[Faunus] PeriodicCellList") {
+    typedef Eigen::Vector3d Point;
+    PeriodicCellList l;
+    l.resize({10, 20, 5}, 3);
+    CHECK(l.size() == Eigen::Vector3i(3, 6, 1));
+    CHECK(l.getCellLength().x() == doctest::Approx(10.0 / 3));
+    CHECK(l.p2c({-5, -10, -2.5}) == Eigen::Vector3i(0, 0, 0));
+    CHECK(l.p2c({4.99, 9.99, 2.49}) == Eigen::Vector3i(2, 5, 0));
+    CHECK(l.p2c({5.1, 0, 0}) == Eigen::Vector3i(0, 3, 0)); // wrapped
+
+    std::vector<size_t> index;
+    std::vector<Point> vec = {{-4.9, 0, 0}, {4.9, 0, 0}, {0, 9, 0}};
+    l.update(vec);
+    l.neighbors(l.p2c(vec[0]), index);
+    CHECK(index.size() == 2); // periodic neighbor across x-boundary
+    l.neighbors(l.p2c(vec[2]), index);
+    CHECK(index.size() == 1); // single cell in z is visited only once
+
+    l.move(0, l.p2c(vec[0]), l.p2c({0, 9, 0}));
+    l.neighbors(l.p2c(vec[2]), index);
+    CHECK(index.size() == 2);
+}
+
 TEST_CASE("[Faunus] CellList") {
     typedef Eigen::Vector3d Point;
     Point box = {10, 20, 6};
@@ -8,6 +8,7 @@ namespace Move {
 void ChainRotationMovebase::_from_json(const json &j) {
     molname = j.at("molecule");
     dprot = j.at("dprot");
+    dprot_tuner = &addTunable("dprot", dprot, 2 * pc::pi);
     allow_small_box = j.value("skiplarge", true); // todo rename the json attribute and make false default
 }
 
@@ -34,7 +35,10 @@ void ChainRotationMovebase::_move(Change &change) {
     }
 }
 
-void ChainRotationMovebase::_accept(Change &) { msqdispl += sqdispl; }
+void ChainRotationMovebase::_accept(Change &) {
+    msqdispl += sqdispl;
+    dprot_tuner->sample(sqdispl);
+}
 void ChainRotationMovebase::_reject(Change &) { msqdispl += 0; }
 double ChainRotationMovebase::bias(Change &, double, double) { return permit_move ? 0 : pc::infty; }
 
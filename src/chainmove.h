@@ -15,6 +15,7 @@ class ChainRotationMovebase : public Movebase {
     double dprot;             //!< maximal angle of rotation, ±0.5*dprot
     double sqdispl;           //!< center-of-mass displacement squared
     Average<double> msqdispl; //!< center-of-mass mean squared displacement
+    StepTuner *dprot_tuner = nullptr;
     bool permit_move = true;
     bool allow_small_box = false;
     int small_box_encountered = 0; //!< number of skipped moves due to too small container
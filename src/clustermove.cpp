@@ -44,17 +44,16 @@ void Cluster::_to_json(json &j) const {
 }
 void Cluster::_from_json(const json &j) {
     dptrans = j.at("dp");
+    dp_tuner = &addTunable("dp", dptrans);
     dir = j.value("dir", Point(1, 1, 1));
     dirrot = j.value("dirrot", Point(0, 0, 0)); // predefined axis of rotation
     dirrot.normalize();                         // make sure dirrot is a unit-vector
     dprot = j.at("dprot");
+    dprot_tuner = &addTunable("dprot", dprot, 2 * pc::pi);
     spread = j.value("spread", true);
     molecule_names = j.at("molecules").get<decltype(molecule_names)>(); // molecule names
     molids = names2ids(molecules, molecule_names);                      // names --> molids
 
-    updateMoleculeIndex();
-
-    repeat = std::max<size_t>(1, molecule_index.size());
 
     // read satellite ids (molecules NOT to be considered as cluster centers)
     auto satnames = j.value("satellites", std::vector<std::string>()); // molecule names
@@ -92,50 +91,80 @@ void Cluster::_from_json(const json &j) {
         } else
             throw std::runtime_error("threshold must be a number or object");
     }
+
+    // largest threshold determines the cell size for finding neighbors
+    max_threshold = 0;
+    for (auto i : molids)
+        for (auto j : molids)
+            if (size_t(std::max(i, j)) < group_thresholds.size())
+                max_threshold = std::max(max_threshold, std::sqrt(group_thresholds(i, j)));
+
+    updateMoleculeIndex();
+    repeat = std::max<size_t>(1, molecule_index.size());
 }
-void Cluster::findCluster(Space &spc, size_t first, std::set<size_t> &cluster) {
-    assert(first < spc.p.size());
-    std::set<size_t> pool(molecule_index.begin(), molecule_index.end());
-    assert(pool.count(first) > 0);
+/**
+ * The cluster is grown breadth-first from the nucleus, using the cell list of mass
+ * centers to find candidate molecules. If `spread` is false, only the first layer of
+ * molecules around the nucleus is considered.
+ */
+void Cluster::findCluster(Space &spc, size_t first, std::vector<size_t> &cluster) {
+    assert(first < spc.groups.size());
+    assert(not is_member[first]);
 
     cluster.clear();
-    cluster.insert(first);
-    pool.erase(first);
+    cluster.push_back(first);
+    is_member[first] = true;
 
-    size_t n;
-    do { // find cluster (not very clever...)
-    start:
-        n = cluster.size();
-        for (size_t i : cluster)
-            if (not spc.groups.at(i).empty()) // check if group is inactive
-                for (size_t j : pool)
-                    if (i != j)
-                        if (not spc.groups.at(j).empty()) { // check if group is inactive
-                            // probability to cluster
-                            double P = clusterProbability(spc.groups.at(i), spc.groups.at(j));
-                            if (Movebase::slump() <= P) {
-                                cluster.insert(j);
-                                pool.erase(j);
-				if(spread)
-				  goto start; // wow, first goto ever!
-                            }
-                        }
-    } while (cluster.size() != n);
+    for (size_t n = 0; n < cluster.size(); n++) { // cluster doubles as the queue
+        auto &g1 = spc.groups[cluster[n]];
+        cells.forEachNeighbor(cells.p2c(g1.cm), [&](size_t j) {
+            if (not is_member[j]) {
+                double P = clusterProbability(g1, spc.groups[j]); // probability to cluster
+                if (P >= 1.0 or (P > 0.0 and Movebase::slump() < P)) {
+                    cluster.push_back(j);
+                    is_member[j] = true;
+                }
+            }
+        });
+        if (not spread)
+            break; // only the first layer around the nucleus
+    }
 
     // check if cluster is too large
     double max = spc.geo.getLength().minCoeff() / 2;
-    for (auto i : cluster)
-        for (auto j : cluster)
-            if (j > i)
-                if (spc.geo.sqdist(spc.groups.at(i).cm, spc.groups.at(j).cm) >= max * max)
-                    rotate = false; // skip rotation if cluster larger than half the box length
+    for (size_t i = 0; i < cluster.size() and rotate; i++)
+        for (size_t j = i + 1; j < cluster.size(); j++)
+            if (spc.geo.sqdist(spc.groups[cluster[i]].cm, spc.groups[cluster[j]].cm) >= max * max) {
+                rotate = false; // skip rotation if cluster larger than half the box length
+                break;
+            }
 }
+
+/**
+ * As for `findCluster()`, this assumes a binary 0/1 probability function.
+ */
+bool Cluster::clusterIsIntact(const std::vector<size_t> &cluster) const {
+    size_t n = spread ? cluster.size() : 1; // molecules that may recruit others
+    for (size_t i = 0; i < n; i++) {
+        auto &g1 = spc.groups[cluster[i]];
+        bool intact = true;
+        cells.forEachNeighbor(cells.p2c(g1.cm), [&](size_t j) {
+            if (intact and not is_member[j])
+                if (clusterProbability(g1, spc.groups[j]) > 0.0)
+                    intact = false;
+        });
+        if (not intact)
+            return false;
+    }
+    return true;
+}
+
 void Cluster::_move(Change &change) {
     _bias = 0;
     rotate = true;
     updateMoleculeIndex();
     if (not molecule_index.empty()) {
-        std::set<size_t> cluster; // all group index in cluster
+        std::vector<size_t> cluster; // all group index in cluster (nucleus first)
 
         // find "nuclei" or cluster center and exclude any molecule id listed as "satellite".
         size_t index_of_nuclei;
@@ -157,7 +186,7 @@ void Cluster::_move(Change &change) {
         auto clusterCOM = [&]() {
             double mass_sum = 0;
             Point cm(0, 0, 0);
-            Point O = spc.groups[*cluster.begin()].cm;
+            Point O = spc.groups[cluster.front()].cm;
             for (auto i : cluster) { // loop over clustered molecules (index)
                 auto &g = spc.groups[i];
                 Point t = g.cm - O;
@@ -186,6 +215,7 @@ void Cluster::_move(Change &change) {
 
         for (auto i : cluster) { // loop over molecules in cluster
             auto &g = spc.groups[i];
+            auto old_cell = cells.p2c(g.cm);
             if (rotate) {
                 Geometry::rotate(g.begin(), g.end(), Q, boundary, -COM);
                 g.cm = g.cm - COM;
@@ -194,24 +224,25 @@ void Cluster::_move(Change &change) {
                 boundary(g.cm);
             }
             g.translate(dp, boundary);
+            cells.move(i, old_cell, cells.p2c(g.cm));
             d.index = i;
             change.groups.push_back(d);
         }
+        std::sort(change.groups.begin(), change.groups.end()); // by group index
 
         change.moved2moved = false; // do not calc. internal cluster energy
 
         // Reject if cluster composition changes during move
         // Note: this only works for the binary 0/1 probability function
         // currently implemented in `findCluster()`.
-
-        std::set<size_t> aftercluster;         // all group index in cluster _after_move
-        findCluster(spc, index_of_nuclei, aftercluster); // find cluster around first
-        if (aftercluster == cluster)
+        if (clusterIsIntact(cluster))
             _bias = 0;
         else {
             _bias = pc::infty; // bias is infinite --> reject
             bias_rejected++;   // count how many time we reject due to bias
         }
+        for (auto i : cluster)
+            is_member[i] = false;
 #ifndef NDEBUG
         // check if cluster mass center movement matches displacement
         if (_bias == 0) {
@@ -234,6 +265,8 @@ void Cluster::_reject(Change &) {
 void Cluster::_accept(Change &) {
     msqd += dp.squaredNorm();
     msqd_angle += angle * angle;
+    dp_tuner->sample(dp.squaredNorm());
+    dprot_tuner->sample(angle * angle);
 }
 Cluster::Cluster(Space &spc) : spc(spc) {
     cite = "doi:10/cj9gnn";
@@ -245,16 +278,31 @@ Cluster::Cluster(Space &spc) : spc(spc) {
  * search for molecules participating in the cluster
  * move. This is called for every move event as a
  * grand canonical move may have changed the number
- * of particles.
+ * of particles, or a volume move the box size.
+ *
+ * Mass centers are stored in a cell list with a cell length of at least the
+ * largest threshold. Only orthogonal geometries with all mass centers inside
+ * the bounding box can be split into cells; other geometries use a single cell.
  */
 void Cluster::updateMoleculeIndex() {
     assert(not molids.empty());
+    Point box = spc.geo.getLength();
+    bool orthogonal = spc.geo.type == Geometry::CUBOID or spc.geo.type == Geometry::SLIT or
+                      spc.geo.type == Geometry::SPHERE or spc.geo.type == Geometry::CYLINDER;
+    if (orthogonal and max_threshold > 0)
+        cells.resize(box, max_threshold);
+    else
+        cells.resize(box, box.maxCoeff());
+    is_member.assign(spc.groups.size(), false);
+
     molecule_index.clear();
     for (auto &g : spc.groups) {          // loop over all groups
         if (not g.atomic)                 // only molecular groups
             if (g.size() == g.capacity()) // only active particles
-                if (std::find(molids.begin(), molids.end(), g.id) != molids.end())
+                if (std::find(molids.begin(), molids.end(), g.id) != molids.end()) {
                     molecule_index.push_back(&g - &spc.groups.front());
+                    cells.insert(molecule_index.back(), g.cm);
+                }
     }
 }
 } // namespace Move
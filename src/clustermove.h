@@ -1,6 +1,7 @@
 #pragma once
 
 #include "move.h"
+#include "celllist.h"
 #include <set>
 
 namespace Faunus {
@@ -16,7 +17,7 @@ class Cluster : public Movebase {
     Average<double> msqd, msqd_angle, N;
     double dptrans = 0, dprot = 0, angle = 0, _bias = 0;
     size_t bias_rejected = 0;
-    bool rotate; // true if cluster should be rotated
+    bool rotate = true; // true if cluster should be rotated
     bool spread; // true if cluster should spread outside of the first layer of surrounding molecules
     Point dir = {1, 1, 1}, dp;
     Point dirrot = {0, 0, 0}; // predefined axis of rotation
@@ -26,28 +27,103 @@ class Cluster : public Movebase {
     std::vector<size_t> molecule_index; // index of all possible molecules to be considered
     std::map<size_t, size_t> clusterSizeDistribution; // distribution of cluster sizes
     PairMatrix<double, true> group_thresholds;
-
-    void updateMoleculeIndex(); //!< update `molecule_index`
-
-    virtual double clusterProbability(const Tgroup &g1, const Tgroup &g2) const;
+    double max_threshold = 0;                // largest threshold (not squared)
+    PeriodicCellList cells;                  // cell list of mass centers (group index)
+    std::vector<char> is_member;             // flag for each group index; true if in current cluster
+    StepTuner *dp_tuner = nullptr, *dprot_tuner = nullptr;
 
     void _to_json(json &j) const override;
     void _from_json(const json &j) override;
+    void _move(Change &change) override;
+    double bias(Change &, double, double) override; //!< adds extra energy change not captured by the Hamiltonian
+    void _reject(Change &) override;
+    void _accept(Change &) override;
+
+  protected:
+    void updateMoleculeIndex(); //!< update `molecule_index` and the cell list of mass centers
+
+    virtual double clusterProbability(const Tgroup &g1, const Tgroup &g2) const;
 
     /**
      * @param spc Space
      * @param first Index of initial molecule (randomly selected)
-     * @param index w. all molecules clustered around first (first included)
+     * @param cluster Index of all molecules clustered around first (first included)
      */
-    void findCluster(Space &spc, size_t first, std::set<size_t> &cluster);
-    void _move(Change &change) override;
-    double bias(Change &, double, double) override; //!< adds extra energy change not captured by the Hamiltonian
-    void _reject(Change &) override;
-    void _accept(Change &) override;
+    void findCluster(Space &spc, size_t first, std::vector<size_t> &cluster);
+
+    /**
+     * @brief Test if a rigidly moved cluster has picked up new molecules
+     *
+     * Links within the cluster are unaffected by the rigid move, so only pairs between
+     * cluster molecules and surrounding molecules need to be evaluated.
+     */
+    bool clusterIsIntact(const std::vector<size_t> &cluster) const;
 
   public:
     Cluster(Space &spc);
 };
 
+#ifdef DOCTEST_LIBRARY_INCLUDED
+TEST_CASE("[Faunus] Cluster") {
+    struct ClusterTest : public Cluster { // access to cluster search
+        using Cluster::Cluster;
+        using Cluster::clusterIsIntact;
+        using Cluster::findCluster;
+        using Cluster::updateMoleculeIndex;
+    };
+    auto atoms_backup = atoms;         // restored below as the
+    auto molecules_backup = molecules; // topology is global
+    atoms = R"([{"A": {"sigma": 2.0}}])"_json.get<decltype(atoms)>();
+    molecules = R"([{"M": {"atoms": ["A"], "atomic": false}}])"_json.get<decltype(molecules)>();
+
+    Space spc;
+    spc.geo = R"( {"type": "cuboid", "length": 20} )"_json;
+    std::vector<Point> positions = {{9, 0, 0},    // nucleus
+                                    {-9.5, 0, 0}, // 1.5 from nucleus across the periodic boundary
+                                    {-7, 0, 0},   // 2.5 from the above; 4 from nucleus
+                                    {9, 3.1, 0},  // just outside threshold of nucleus
+                                    {0, 0, 0}};   // far away
+    spc.p.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        spc.p[i].id = 0;
+        spc.p[i].pos = positions[i];
+    }
+    for (auto it = spc.p.begin(); it != spc.p.end(); ++it) {
+        spc.groups.emplace_back(it, it + 1);
+        spc.groups.back().id = 0;
+        spc.groups.back().atomic = false;
+        spc.groups.back().cm = it->pos;
+    }
+
+    std::vector<size_t> cluster;
+    for (bool spread : {true, false}) {
+        ClusterTest mv(spc);
+        json j = R"( {"molecules": ["M"], "threshold": 3.0, "dp": 1.0, "dprot": 1.0} )"_json;
+        j["spread"] = spread;
+        mv.from_json(j);
+        mv.findCluster(spc, 0, cluster);
+        std::sort(cluster.begin(), cluster.end());
+        if (spread)
+            CHECK(cluster == std::vector<size_t>({0, 1, 2}));
+        else
+            CHECK(cluster == std::vector<size_t>({0, 1})); // first layer only
+    }
+
+    ClusterTest mv(spc);
+    mv.from_json(R"( {"molecules": ["M"], "threshold": 3.0, "dp": 1.0, "dprot": 1.0} )"_json);
+    mv.findCluster(spc, 0, cluster);
+    CHECK(mv.clusterIsIntact(cluster));
+    for (auto i : cluster) // rigid move away from the outsider keeps the cluster intact...
+        spc.groups[i].cm.y() -= 0.5;
+    CHECK(mv.clusterIsIntact(cluster));
+    for (auto i : cluster) // ...but not towards it
+        spc.groups[i].cm.y() += 0.7;
+    CHECK(not mv.clusterIsIntact(cluster));
+
+    atoms = atoms_backup;
+    molecules = molecules_backup;
+}
+#endif
+
 } // namespace Move
 } // namespace Faunus
@@ -9,6 +9,12 @@ namespace spdlog {
     class logger;
 }
 
+// forward declare binary archives used for checkpoints
+namespace cereal {
+    class BinaryOutputArchive;
+    class BinaryInputArchive;
+}
+
 extern template class nlohmann::basic_json<>;
 
 /** @brief Faunus main namespace */
@@ -2,6 +2,8 @@
 #include "penalty.h"
 #include "potentials.h"
 #include "externalpotential.h"
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/string.hpp>
 
 namespace Faunus {
 namespace Energy {
@@ -731,20 +733,70 @@ Hamiltonian::Hamiltonian(Space &spc, const json &j) {
 }
 double Hamiltonian::energy(Change &change) {
     double du = 0;
-    for (auto i : this->vec) { // loop over terms in Hamiltonian
+    latest_energies.assign(this->vec.size(), std::numeric_limits<double>::quiet_NaN()); // no allocation after first call
+    for (size_t n = 0; n < this->vec.size(); n++) { // loop over terms in Hamiltonian
+        auto &i = this->vec[n];
         i->key = key;
         i->timer.start(); // time each term
-        du += i->energy(change);
+        latest_energies[n] = i->energy(change);
+        du += latest_energies[n];
         i->timer.stop();
         if (du >= maxenergy)
             break; // stop summing energies
     }
     return du;
 }
+
+const std::vector<double> &Hamiltonian::latestEnergies() const { return latest_energies; }
+
+const std::vector<double> &Hamiltonian::runningEnergies() const { return running_energies; }
+
+const std::vector<double> &Hamiltonian::recomputeRunningEnergies() {
+    Change change;
+    change.all = true;
+    energy(change);
+    running_energies = latest_energies;
+    return running_energies;
+}
+
+/**
+ * Both this (old) and the `trial` (new) Hamiltonian must have been evaluated for
+ * the same change. Terms that were not evaluated, e.g. due to `maxenergy`, turn
+ * the running energy into NaN until the next recalculation.
+ */
+void Hamiltonian::updateRunningEnergies(const Hamiltonian &trial) {
+    if (running_energies.size() != this->vec.size())
+        return; // running energies not initialized
+    assert(trial.latest_energies.size() == latest_energies.size());
+    for (size_t n = 0; n < running_energies.size(); n++)
+        running_energies[n] += trial.latest_energies[n] - latest_energies[n];
+}
 void Hamiltonian::init() {
     for (auto i : this->vec)
         i->init();
 }
+void Hamiltonian::saveCheckpoint(cereal::BinaryOutputArchive &archive) const {
+    archive(this->vec.size());
+    for (auto &term : this->vec) {
+        archive(term->name);
+        term->saveCheckpoint(archive);
+    }
+}
+
+void Hamiltonian::loadCheckpoint(cereal::BinaryInputArchive &archive) {
+    size_t num_terms;
+    archive(num_terms);
+    if (num_terms != this->vec.size())
+        throw std::runtime_error("checkpoint mismatch: number of energy terms");
+    for (auto &term : this->vec) {
+        std::string name;
+        archive(name);
+        if (name != term->name)
+            throw std::runtime_error("checkpoint mismatch: expected energy term " + term->name);
+        term->loadCheckpoint(archive);
+    }
+}
+
 void Hamiltonian::sync(Energybase *basePtr, Change &change) {
     auto other = dynamic_cast<decltype(this)>(basePtr);
     if (other)
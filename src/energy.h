@@ -1174,9 +1174,19 @@ struct Example2D : public Energybase {
     double energy(Change &change) override;
 };
 
+/**
+ * @brief Aggregates and sum energy terms
+ *
+ * The energy of each term from the latest call to `energy()` is kept, and
+ * running system energies of each term can be maintained by adding the
+ * per-term differences to the trial Hamiltonian after each accepted move.
+ * This avoids full recomputations merely to report the system energy.
+ */
 class Hamiltonian : public Energybase, public BasePointerVector<Energybase> {
   protected:
     double maxenergy = pc::infty; //!< Maximum allowed energy change
+    std::vector<double> latest_energies;  //!< Energy of each term from latest `energy()` call; NaN if not evaluated
+    std::vector<double> running_energies; //!< System energy of each term, updated by accepted moves
     void to_json(json &j) const override;
     void addEwald(const json &j, Space &spc); //!< Adds an instance of reciprocal space Ewald energies (if appropriate)
   public:
@@ -1184,7 +1194,14 @@ class Hamiltonian : public Energybase, public BasePointerVector<Energybase> {
     double energy(Change &change) override; //!< Energy due to changes
     void init() override;
     void sync(Energybase *basePtr, Change &change) override;
-}; //!< Aggregates and sum energy terms
+    void saveCheckpoint(cereal::BinaryOutputArchive &) const override; //!< Save state of all terms
+    void loadCheckpoint(cereal::BinaryInputArchive &) override;        //!< Load state of all terms
+
+    const std::vector<double> &latestEnergies() const;     //!< Energy of each term from latest `energy()` call
+    const std::vector<double> &runningEnergies() const;    //!< Running system energy of each term
+    const std::vector<double> &recomputeRunningEnergies(); //!< Reset running energies by full recalculation
+    void updateRunningEnergies(const Hamiltonian &trial);  //!< Add per-term energy change after accepted move
+};
 
 } // namespace Energy
 } // namespace Faunus
@@ -0,0 +1,251 @@
+#include "eventchain.h"
+#include "potentials.h"
+#include "aux/eigensupport.h"
+#include <algorithm>
+
+namespace Faunus {
+namespace Move {
+
+void EventChain::_to_json(json &j) const {
+    j = {{"molecules", molecule_names},
+         {"length", chain_length},
+         {"dir", dir},
+         {"hardsphere", hardsphere},
+         {"max step", max_step},
+         {"lifts per chain", lifts.avg()},
+         {"mean free path", path.avg()}};
+    if (soft) {
+        j["soft"] = soft_json;
+        j["cutoff"] = soft_cutoff;
+        j["resolution"] = resolution;
+        j["residual energy"] = residual.avg();
+    }
+    _roundjson(j, 3);
+}
+
+void EventChain::_from_json(const json &j) {
+    try {
+        assertKeys(j, {"molecules", "length", "dir", "hardsphere", "soft", "cutoff", "resolution", "repeat"});
+        molecule_names = j.at("molecules").get<decltype(molecule_names)>(); // molecule names
+        molids = names2ids(molecules, molecule_names);                      // names --> molids
+        for (auto id : molids)
+            if (not molecules.at(id).atomic)
+                throw std::runtime_error("'" + molecules.at(id).name + "' is not atomic");
+        chain_length = j.at("length").get<double>();
+        if (chain_length <= 0)
+            throw std::runtime_error("chain length must be positive");
+        dir = j.value("dir", Point(1, 1, 1));
+        if (dir.isZero())
+            throw std::runtime_error("at least one direction required");
+        hardsphere = j.value("hardsphere", true);
+        if (auto it = j.find("soft"); it != j.end()) {
+            soft_json = *it;
+            soft = std::make_shared<Tpairpot>("soft");
+            soft->from_json(soft_json);
+            soft_cutoff = j.at("cutoff").get<double>();
+            resolution = j.value("resolution", resolution);
+            if (soft_cutoff <= 0 or resolution <= 0)
+                throw std::runtime_error("positive `cutoff` and `resolution` required");
+        }
+        if (not hardsphere and not soft)
+            throw std::runtime_error("`hardsphere` and/or `soft` interactions required");
+
+        auto &bc = spc.geo.boundaryConditions().direction;
+        if (spc.geo.type != Geometry::CUBOID or bc.x() != Geometry::PERIODIC or bc.y() != Geometry::PERIODIC or
+            bc.z() != Geometry::PERIODIC)
+            throw std::runtime_error("fully periodic cuboid required");
+        if (repeat < 0) { // one chain per active particle
+            repeat = 0;
+            for (auto id : molids)
+                for (auto &group : spc.findMolecules(id))
+                    repeat += group.size();
+            repeat = std::max(repeat, 1);
+        }
+    } catch (std::exception &e) {
+        throw std::runtime_error(name + ": " + e.what());
+    }
+}
+
+/**
+ * Members are all active particles in atomic groups of the selected molecules.
+ * As the volume and number of particles may fluctuate, this is done for every
+ * move event. The cell side length is at least twice the interaction range,
+ * `r`, and the chain is propagated in steps of at most `cell length - r`, so that
+ * all interacting particles along a step are found in the 27 neighboring cells.
+ */
+void EventChain::updateMembers() {
+    members.clear();
+    for (auto &group : spc.groups) {
+        if (group.atomic and std::find(molids.begin(), molids.end(), group.id) != molids.end()) {
+            int group_index = &group - &spc.groups.front();
+            for (auto it = group.begin(); it != group.end(); ++it)
+                members.push_back({size_t(it - spc.p.begin()), group_index, int(it - group.begin())});
+        }
+    }
+    moved.assign(members.size(), 0);
+
+    double range = soft_cutoff;
+    if (hardsphere)
+        for (auto &member : members)
+            range = std::max(range, atoms[spc.p[member.particle].id].sigma);
+    if (range <= 0)
+        throw std::runtime_error(name + ": zero interaction range");
+
+    Point box = spc.geo.getLength();
+    cells.resize(box, 2 * range);
+    max_step = std::min(cells.getCellLength().minCoeff(), 0.5 * box.minCoeff()) - range;
+    if (max_step <= 0)
+        throw std::runtime_error(name + ": box too small compared to interaction range");
+    for (size_t k = 0; k < members.size(); k++)
+        cells.insert(k, spc.p[members[k].particle].pos);
+}
+
+double EventChain::softEnergy(const Particle &a, const Particle &b, const Point &r) const {
+    double r2 = r.squaredNorm();
+    return (r2 < soft_cutoff * soft_cutoff) ? (*soft)(a, b, r2, r) : 0.0;
+}
+
+/**
+ * Factorized Metropolis filter for a single pair: the positive energy increments
+ * along the path are summed until they exceed a random, exponentially distributed
+ * energy budget.
+ *
+ * @param a Active particle
+ * @param b Target particle
+ * @param d Distance vector from `a` to `b` before displacement
+ * @param e Unit vector of displacement direction
+ * @param smax Maximum displacement of `a` to consider
+ * @return Displacement of `a` at which the pair event occurs; infinity if no event
+ */
+double EventChain::softEvent(const Particle &a, const Particle &b, const Point &d, const Point &e, double smax) {
+    double along = std::clamp(d.dot(e), 0.0, smax);
+    if ((d - along * e).squaredNorm() >= soft_cutoff * soft_cutoff)
+        return pc::infty; // never within cutoff along the path
+    double budget = -std::log(slump());
+    double u_increase = 0;
+    double u_prev = softEnergy(a, b, -d);
+    for (double s = 0; s < smax;) {
+        double s_next = std::min(s + resolution, smax);
+        double u_next = softEnergy(a, b, s_next * e - d);
+        if (not std::isfinite(u_next))
+            return s; // hard cores should be handled by `hardsphere`
+        if (u_next > u_prev) {
+            u_increase += u_next - u_prev;
+            if (u_increase >= budget)
+                return s_next - (s_next - s) * (u_increase - budget) / (u_next - u_prev); // interpolate
+        }
+        u_prev = u_next;
+        s = s_next;
+    }
+    return pc::infty;
+}
+
+void EventChain::_move(Change &change) {
+    updateMembers();
+    if (members.empty())
+        return;
+    moved_members.clear();
+    du_chain = 0;
+
+    std::vector<int> axes; // enabled chain directions
+    for (int k = 0; k < 3; k++)
+        if (dir[k] != 0)
+            axes.push_back(k);
+    Point e = Point::Zero();
+    e[*slump.sample(axes.begin(), axes.end())] = 1.0;
+
+    size_t active = slump.range(0, members.size() - 1);
+    double remaining = chain_length;
+    int num_lifts = 0;
+    std::vector<std::pair<size_t, Point>> neighbors; // member index and distance from active particle
+
+    while (remaining > 0) {
+        auto &a = spc.p[members[active].particle];
+        double event = std::min(remaining, max_step);
+        size_t next = active;
+        auto cell = cells.p2c(a.pos);
+
+        neighbors.clear();
+        cells.forEachNeighbor(cell, [&](size_t k) {
+            if (k == active)
+                return;
+            const auto &b = spc.p[members[k].particle];
+            Point d = spc.geo.vdist(b.pos, a.pos);
+            if (hardsphere) {
+                double along = d.dot(e);
+                if (along > 0) {
+                    double sigma = 0.5 * (atoms[a.id].sigma + atoms[b.id].sigma);
+                    double perp2 = d.squaredNorm() - along * along;
+                    if (perp2 < sigma * sigma) {
+                        double s = std::max(0.0, along - std::sqrt(sigma * sigma - perp2));
+                        if (s < event) {
+                            event = s;
+                            next = k;
+                        }
+                    }
+                }
+            }
+            if (soft)
+                neighbors.emplace_back(k, d);
+        });
+
+        if (soft) {
+            for (auto &[k, d] : neighbors)
+                if (double s = softEvent(a, spc.p[members[k].particle], d, e, event); s < event) {
+                    event = s;
+                    next = k;
+                }
+            for (auto &[k, d] : neighbors) {
+                const auto &b = spc.p[members[k].particle];
+                du_chain += softEnergy(a, b, event * e - d) - softEnergy(a, b, -d);
+            }
+        }
+
+        a.pos += event * e;
+        spc.geo.boundary(a.pos);
+        cells.move(active, cell, cells.p2c(a.pos));
+        if (not moved[active]) {
+            moved[active] = 1;
+            moved_members.push_back(active);
+        }
+        remaining -= event;
+        if (next != active) {
+            path += event;
+            active = next; // lift
+            num_lifts++;
+        }
+    }
+    lifts += num_lifts;
+
+    std::map<int, Change::data> touched; // sorted by group index
+    for (auto k : moved_members) {
+        auto &data = touched[members[k].group];
+        data.index = members[k].group;
+        data.internal = true;
+        data.atoms.push_back(members[k].atom);
+    }
+    for (auto &[index, data] : touched) {
+        std::sort(data.atoms.begin(), data.atoms.end());
+        change.groups.push_back(data);
+    }
+}
+
+/**
+ * The soft pair energy change has already been accounted for by the event chain
+ * and is removed from the Metropolis criterion. The remainder is zero if the
+ * Hamiltonian contains only hard-sphere and the given soft interactions.
+ */
+double EventChain::bias(Change &, double uold, double unew) {
+    if (soft and std::isfinite(unew - uold))
+        residual += unew - uold - du_chain;
+    return -du_chain;
+}
+
+EventChain::EventChain(Space &spc) : spc(spc) {
+    name = "eventchain";
+    cite = "doi:10.1103/PhysRevE.80.056704";
+    repeat = 1;
+}
+
+} // namespace Move
+} // namespace Faunus
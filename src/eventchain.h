@@ -0,0 +1,149 @@
+#pragma once
+
+#include "move.h"
+#include "celllist.h"
+#include <memory>
+
+namespace Faunus {
+
+namespace Potential {
+class FunctorPotential;
+}
+
+namespace Move {
+
+/**
+ * @brief Event-chain Monte Carlo for atomic groups in periodic, cuboidal boxes
+ *
+ * A randomly picked particle is displaced along a random axis (+x, +y, or +z)
+ * until it either collides with a hard-sphere neighbor, or until a pair event
+ * is triggered by the factorized Metropolis filter of an optional soft pair
+ * potential. The displacement is then transferred ("lifted") to the
+ * neighbor, and so forth, until the total chain length is consumed.
+ *
+ * Events are found using a `PeriodicCellList` where each cell is at least
+ * twice the interaction range. The chain displaces particles in steps that
+ * never exceed the range covered by the 27 neighboring cells.
+ *
+ * The energy change from the soft pair potential is tracked along the chain
+ * and subtracted via `bias()` so that only interactions _not_ handled by the
+ * chain (e.g. external potentials) enter the final Metropolis test.
+ *
+ * @note Rejection free only if all Hamiltonian terms are handled by the chain
+ * @date Malmo, 2020
+ */
+class EventChain : public Movebase {
+  private:
+    typedef Potential::FunctorPotential Tpairpot;
+
+    struct Member {
+        size_t particle; //!< Index in `Space::p`
+        int group;       //!< Index of group in `Space::groups`
+        int atom;        //!< Index relative to start of group
+    };                   //!< Particle that may participate in the chain
+
+    Space &spc;
+    std::vector<std::string> molecule_names; // names of molecules to be considered
+    std::vector<int> molids;                 // molecule id's of molecules to be considered
+    Point dir = {1, 1, 1};                   // enabled chain directions
+    double chain_length = 0;                 // total displacement of each chain (angstrom)
+    double soft_cutoff = 0;                  // cutoff for soft pair potential (angstrom)
+    double resolution = 0.05;                // path discretization when searching for soft events (angstrom)
+    double max_step = 0;                     // max. displacement between neighbor list lookups (angstrom)
+    double du_chain = 0;                     // soft energy change accumulated along current chain (kT)
+    bool hardsphere = true;                  // true if particles collide as hard spheres
+    std::shared_ptr<Tpairpot> soft;          // optional soft pair potential handled by factorized Metropolis
+    json soft_json;                          // input for soft pair potential
+
+    std::vector<Member> members;       // particles in the chain candidates
+    std::vector<char> moved;           // moved flag for each member
+    std::vector<size_t> moved_members; // index of all moved members
+    PeriodicCellList cells;            // cell list of member index
+    Average<double> lifts, path, residual; // lifts per chain, free path between lifts, energy not handled by chain
+
+    void updateMembers(); //!< Rebuild list of members and the cell list
+    double softEvent(const Particle &, const Particle &, const Point &, const Point &, double);
+    double softEnergy(const Particle &, const Particle &, const Point &) const;
+
+    void _to_json(json &j) const override;
+    void _from_json(const json &j) override;
+    void _move(Change &change) override;
+    double bias(Change &, double, double) override;
+
+  public:
+    EventChain(Space &spc);
+};
+
+#ifdef DOCTEST_LIBRARY_INCLUDED
+TEST_CASE("[Faunus] EventChain") {
+    auto atoms_backup = atoms;         // restored below as the
+    auto molecules_backup = molecules; // topology is global
+    atoms = R"([{"A": {"sigma": 2.0}}])"_json.get<decltype(atoms)>();
+    molecules = R"([{"M": {"atoms": ["A"], "atomic": true}}])"_json.get<decltype(molecules)>();
+    Change change;
+
+    SUBCASE("Lifting") {
+        Space spc = R"({"geometry": {"type": "cuboid", "length": [8, 20, 20]},
+                        "insertmolecules": [{"M": {"N": 2}}]})"_json;
+        spc.p[0].pos = {-3, 0, 0}; // gap of 1 to the next particle along +x...
+        spc.p[1].pos = {0, 0, 0};  // ...and of 3 across the periodic boundary
+        auto old_particles = spc.p;
+        EventChain mv(spc);
+        mv.from_json(R"({"molecules": ["M"], "length": 4.5, "dir": [1, 0, 0], "repeat": "N"})"_json);
+        CHECK(mv.repeat == 2); // one chain per particle
+        mv.move(change);
+        mv.accept(change);
+        REQUIRE(change.groups.size() == 1);
+        CHECK(change.groups[0].atoms == std::vector<int>({0, 1})); // whichever starts, the other is hit
+        CHECK(json(mv).at(mv.name).at("lifts per chain") == 1);
+        double displacement = 0;
+        for (size_t i = 0; i < spc.p.size(); i++) {
+            Point d = spc.geo.vdist(spc.p[i].pos, old_particles[i].pos);
+            CHECK(d.x() > 0);
+            CHECK(d.tail(2).isZero());
+            displacement += d.x();
+        }
+        CHECK(displacement == doctest::Approx(4.5));
+        CHECK(spc.geo.sqdist(spc.p[0].pos, spc.p[1].pos) >= doctest::Approx(4.0));
+    }
+
+    SUBCASE("Hard spheres") {
+        Space spc = R"({"geometry": {"type": "cuboid", "length": 20},
+                        "insertmolecules": [{"M": {"N": 150}}]})"_json;
+        Random random;
+        auto overlaps = [&](size_t i, size_t end) {
+            for (size_t j = 0; j < end; j++)
+                if (j != i and spc.geo.sqdist(spc.p[i].pos, spc.p[j].pos) < 4.0 - 1e-9)
+                    return true;
+            return false;
+        };
+        for (size_t i = 0; i < spc.p.size(); i++)
+            do
+                spc.geo.randompos(spc.p[i].pos, random);
+            while (overlaps(i, i));
+
+        EventChain mv(spc);
+        mv.from_json(R"({"molecules": ["M"], "length": 8})"_json);
+        CHECK(mv.repeat == 1);
+        for (int chain = 0; chain < 100; chain++) {
+            auto old_particles = spc.p;
+            mv.move(change);
+            mv.accept(change);
+            double displacement = 0; // each particle moves less than half the box
+            for (size_t i = 0; i < spc.p.size(); i++)
+                displacement += spc.geo.vdist(spc.p[i].pos, old_particles[i].pos).norm();
+            CHECK(displacement == doctest::Approx(8.0));
+        }
+        size_t num_overlaps = 0;
+        for (size_t i = 0; i < spc.p.size(); i++)
+            num_overlaps += overlaps(i, spc.p.size());
+        CHECK(num_overlaps == 0);
+        CHECK(json(mv).at(mv.name).at("lifts per chain").get<double>() > 0);
+    }
+    atoms = atoms_backup;
+    molecules = molecules_backup;
+}
+#endif
+
+} // namespace Move
+} // namespace Faunus
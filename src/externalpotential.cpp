@@ -16,6 +16,10 @@ void Energybase::sync(Energybase *, Change &) {}
 
 void Energybase::init() {}
 
+void Energybase::saveCheckpoint(cereal::BinaryOutputArchive &) const {}
+
+void Energybase::loadCheckpoint(cereal::BinaryInputArchive &) {}
+
 void to_json(json &j, const Energybase &base) {
     assert(not base.name.empty());
     if (base.timer)
@@ -27,6 +27,8 @@ class Energybase {
     virtual void to_json(json &j) const;                  //!< json output
     virtual void sync(Energybase *, Change &);
     virtual void init();                               //!< reset and initialize
+    virtual void saveCheckpoint(cereal::BinaryOutputArchive &) const; //!< Save internal state, if any
+    virtual void loadCheckpoint(cereal::BinaryInputArchive &);        //!< Load internal state, if any
     virtual inline void force(std::vector<Point> &){}; // update forces on all particles
     inline virtual ~Energybase(){};
 };
@@ -4,6 +4,7 @@
 #include "montecarlo.h"
 #include "analysis.h"
 #include "multipole.h"
+#include "penalty.h"
 #include "docopt.h"
 #include "progress_tracker.h"
 #include <cstdlib>
@@ -11,6 +12,13 @@
 #include <spdlog/sinks/null_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <iomanip>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <unistd.h>
 
 #ifdef ENABLE_SID
@@ -40,19 +48,27 @@ static const char USAGE[] =
     http://github.com/mlund/faunus
 
     Usage:
-      faunus [-q] [--verbosity <N>] [--nobar] [--nopfx] [--notips] [--nofun] [--state=<file>] [--input=<file>] [--output=<file>]
+      faunus [-q] [--verbosity <N>] [--nobar] [--nopfx] [--notips] [--nofun] [--replicas <N>] [--image=<file>] [--state=<file>] [--input=<file>] [--output=<file>]
+      faunus [-q] [--verbosity <N>] [--nopfx] [--notips] [--nofun] [--workers <N>] [--state=<file>] [--input=<file>] [--output=<file>] --rerun=<file>
+      faunus [-q] [--verbosity <N>] [--nopfx] [--input=<file>] [--double] --conflib=<file> <structure>...
       faunus (-h | --help)
       faunus --version
 
     Options:
       -i <file> --input <file>   Input file [default: /dev/stdin].
       -o <file> --output <file>  Output file [default: out.json].
-      -s <file> --state <file>   State file to start from (.json/.ubj).
+      -s <file> --state <file>   State file to start from (.json/.ubj/.cpt).
+      --image <file>             Binary system image to start from; created if missing or outdated.
       -v <N> --verbosity <N>     Log verbosity level (0 = off, 1 = critical, ..., 6 = trace) [default: 4]
       -q --quiet                 Less verbose output. It implicates -v0 --nobar --notips --nofun.
       -h --help                  Show this screen.
       --nobar                    No progress bar.
       --nopfx                    Do not prefix input file with MPI rank.
+      -r <N> --replicas <N>      Number of replicas to run as threads in a single process [default: 1].
+      --rerun <file>             Run analysis on trajectory (.xtc/.traj/.ztraj) instead of simulating.
+      -w <N> --workers <N>       Number of threads sharing the rerun frames [default: 1].
+      --conflib <file>           Convert structures (.pqr trajectories, .aam, .xyz) to a conformation library (.conflib).
+      --double                   Store conformation library in double precision.
       --notips                   Do not give input assistance
       --nofun                    No fun
       --version                  Show version.
@@ -62,12 +78,38 @@ static const char USAGE[] =
     1. input and output files are prefixed with "mpi{rank}."
     2. standard output is redirected to "mpi{rank}.stdout"
     3. Input prefixing can be suppressed with --nopfx
+
+    Multiple replicas using threads (--replicas):
+
+    1. input and output files are prefixed with "mpi{replica}."
+    2. topology (atoms, molecules, reactions) is shared and must be identical in all replicas
+
+    Rerun of trajectory (--rerun):
+
+    1. frames are distributed round-robin over workers, each with its own space and analysis
+    2. for more than one worker, analysis output files are prefixed with "worker{n}."
+
+    Conformation libraries (--conflib):
+
+    1. atom names in the structures are resolved using the atomlist of the input file
+    2. all structures must have the same sequence of atoms
 )";
 
 using ProgressIndicator::ProgressTracker;
 
 // forward declarations
 std::shared_ptr<ProgressTracker> createProgressTracker(bool, unsigned int);
+typedef std::map<std::string, docopt::value> Toptions; // command line options
+void runSimulation(Toptions &, MPI::MPIController &, bool, const std::function<void()> &);
+void runReplicas(Toptions &, int, bool);
+void runRerun(Toptions &, MPI::MPIController &);
+void runConversion(Toptions &);
+json loadInput(Toptions &);
+std::string readInput(Toptions &);
+json loadState(Toptions &);
+bool isCheckpoint(Toptions &);
+
+static std::atomic<int> checkpoint_requests(0); //!< Incremented by SIGUSR1 to request a checkpoint
 
 int main(int argc, char **argv) {
     using namespace Faunus::MPI;
@@ -126,106 +168,18 @@ int main(int argc, char **argv) {
         usageTip.asciiart = false; // if SID is enabled, disable ascii
 #endif
 
-        // --nopfx
-        bool prefix = !args["--nopfx"].asBool();
-
-        // --input
-        json json_in;
-        auto input = args["--input"].asString();
-        if (input == "/dev/stdin") {
-            std::cin >> json_in;
-        } else {
-            if (prefix) {
-                input = Faunus::MPI::prefix + input;
-            }
-            json_in = openjson(input);
-        }
-
-        {
-            pc::temperature = json_in.at("temperature").get<double>() * 1.0_K;
-            MCSimulation sim(json_in, mpi);
-
-            // --state
-            if (args["--state"]) {
-                std::ifstream f;
-                std::string state = Faunus::MPI::prefix + args["--state"].asString();
-                std::string suffix = state.substr(state.find_last_of(".") + 1);
-                bool binary = (suffix == "ubj");
-                auto mode = std::ios::in;
-                if (binary)
-                    mode = std::ifstream::ate | std::ios::binary; // ate = open at end
-                f.open(state, mode);
-                if (f) {
-                    json json_state;
-                    faunus_logger->info("loading state file {}", state);
-                    if (binary) {
-                        size_t size = f.tellg(); // get file size
-                        std::vector<std::uint8_t> v(size / sizeof(std::uint8_t));
-                        f.seekg(0, f.beg); // go back to start
-                        f.read((char *)v.data(), size);
-                        json_state = json::from_ubjson(v);
-                    } else {
-                        f >> json_state;
-                    }
-                    sim.restore(json_state);
-                } else {
-                    throw std::runtime_error("state file error: " + state);
-                }
-            }
-
-            // warn if initial system has a net charge
-            {
-                auto p = sim.space().activeParticles();
-                double system_charge = Faunus::monopoleMoment(p.begin(), p.end());
-                if (std::fabs(system_charge) > 0)
-                    faunus_logger->warn("non-zero system charge of {}e", system_charge);
-            }
-
-            Analysis::CombinedAnalysis analysis(json_in.at("analysis"), sim.space(), sim.pot());
-
-            auto &loop = json_in.at("mcloop");
-            int macro = loop.at("macro");
-            int micro = loop.at("micro");
-
-            auto progress_tracker = createProgressTracker(show_progress, macro * micro);
-            for (int i = 0; i < macro; i++) {
-                for (int j = 0; j < micro; j++) {
-                    if (progress_tracker && mpi.isMaster()) {
-                        if(++(*progress_tracker) % 10 == 0) {
-                            progress_tracker->display();
-                        }
-                    }
-                    sim.move();
-                    analysis.sample();
-                }                   // end of micro steps
-                analysis.to_disk(); // save analysis to disk
-            }                       // end of macro steps
-            if (progress_tracker && mpi.isMaster()) {
-                progress_tracker->done();
-            }
-
-            faunus_logger->log((sim.drift() < 1E-9) ? spdlog::level::info : spdlog::level::warn,
-                               "relative drift = {}", sim.drift());
-
-            // --output
-            std::ofstream f(Faunus::MPI::prefix + args["--output"].asString());
-            if (f) {
-                json json_out;
-                Faunus::to_json(json_out, sim);
-                json_out["relative drift"] = sim.drift();
-                json_out["analysis"] = analysis;
-                if (mpi.nproc() > 1) {
-                    json_out["mpi"] = mpi;
-                }
-#ifdef GIT_COMMIT_HASH
-                json_out["git revision"] = GIT_COMMIT_HASH;
-#endif
-#ifdef __VERSION__
-                json_out["compiler"] = __VERSION__;
-#endif
-                f << std::setw(4) << json_out << endl;
-            }
-        }
+        // --replicas
+        int replicas = args["--replicas"].asLong();
+        if (args["--conflib"])
+            runConversion(args);
+        else if (args["--rerun"])
+            runRerun(args, mpi);
+        else if (replicas > 1) {
+            if (mpi.nproc() > 1)
+                throw std::runtime_error("replicas cannot be combined with MPI");
+            runReplicas(args, replicas, show_progress);
+        } else
+            runSimulation(args, mpi, show_progress, [] {});
 
         mpi.finalize();
 
@@ -335,3 +289,546 @@ std::shared_ptr<ProgressTracker> createProgressTracker(bool show_progress, unsig
     }
     return tracker;
 }
+
+/**
+ * Read raw input text from file or standard input (--input)
+ *
+ * Unless --nopfx is given, the filename is prefixed with the MPI rank (or replica).
+ */
+std::string readInput(Toptions &args) {
+    auto input = args["--input"].asString();
+    if (input == "/dev/stdin")
+        return std::string(std::istreambuf_iterator<char>(std::cin), {});
+    if (!args["--nopfx"].asBool()) {
+        input = Faunus::MPI::prefix + input;
+    }
+    std::ifstream f(input);
+    if (!f)
+        throw std::runtime_error("Cannot find or read JSON file " + input);
+    return std::string(std::istreambuf_iterator<char>(f), {});
+}
+
+/**
+ * Load input from file or standard input (--input)
+ */
+json loadInput(Toptions &args) {
+    try {
+        return json::parse(readInput(args));
+    } catch (json::parse_error &e) {
+        throw std::runtime_error("Syntax error in JSON input: "s + e.what());
+    }
+}
+
+/**
+ * True if the state file (--state) is a binary checkpoint (.cpt)
+ *
+ * Checkpoints include move and analysis data and are loaded with `loadCheckpoint()`
+ * once the analysis is set up.
+ */
+bool isCheckpoint(Toptions &args) {
+    if (args["--state"]) {
+        std::string state = args["--state"].asString();
+        return state.substr(state.find_last_of(".") + 1) == "cpt";
+    }
+    return false;
+}
+
+/**
+ * Load state file (--state) in json or binary (ubj) format
+ *
+ * @return State; empty if no state file is given or if it is a checkpoint
+ */
+json loadState(Toptions &args) {
+    json json_state;
+    if (args["--state"] and not isCheckpoint(args)) {
+        std::ifstream f;
+        std::string state = Faunus::MPI::prefix + args["--state"].asString();
+        std::string suffix = state.substr(state.find_last_of(".") + 1);
+        bool binary = (suffix == "ubj");
+        auto mode = std::ios::in;
+        if (binary)
+            mode = std::ifstream::ate | std::ios::binary; // ate = open at end
+        f.open(state, mode);
+        if (f) {
+            faunus_logger->info("loading state file {}", state);
+            if (binary) {
+                size_t size = f.tellg(); // get file size
+                std::vector<std::uint8_t> v(size / sizeof(std::uint8_t));
+                f.seekg(0, f.beg); // go back to start
+                f.read((char *)v.data(), size);
+                json_state = json::from_ubjson(v);
+            } else {
+                f >> json_state;
+            }
+        } else {
+            throw std::runtime_error("state file error: " + state);
+        }
+    }
+    return json_state;
+}
+
+/**
+ * Run a single simulation (replica) from input to output
+ *
+ * @param args Command line options
+ * @param mpi Controller of replica (MPI process or thread)
+ * @param show_progress Show progress bar (master replica only)
+ * @param setup_complete Called after setup and before the first MC step
+ */
+void runSimulation(Toptions &args, MPI::MPIController &mpi, bool show_progress,
+                   const std::function<void()> &setup_complete) {
+    // the system image (--image) holds the parsed input and the initial space
+    json json_in;
+    Space initial_space;
+    bool from_image = false;
+    std::string image_file, input_source;
+    if (args["--image"]) {
+        image_file = Faunus::MPI::prefix + args["--image"].asString();
+        input_source = readInput(args);
+        from_image = loadSystemImage(image_file, input_source, json_in, initial_space);
+        if (not from_image)
+            json_in = json::parse(input_source);
+    } else
+        json_in = loadInput(args);
+    pc::temperature = json_in.at("temperature").get<double>() * 1.0_K;
+    MCSimulation sim(json_in, mpi, from_image ? &initial_space : nullptr);
+    if (args["--image"] and not from_image)
+        saveSystemImage(image_file, input_source, json_in, sim.space());
+    if (json json_state = loadState(args); not json_state.empty())
+        sim.restore(json_state);
+
+    // warn if initial system has a net charge
+    {
+        auto p = sim.space().activeParticles();
+        double system_charge = Faunus::monopoleMoment(p.begin(), p.end());
+        if (std::fabs(system_charge) > 0)
+            faunus_logger->warn("non-zero system charge of {}e", system_charge);
+    }
+
+    auto trial = std::make_shared<Analysis::TrialState>(
+        Analysis::TrialState{sim.trialSpace(), sim.trialPot(), sim.space(), sim.pot()});
+    Analysis::CombinedAnalysis analysis(json_in.at("analysis"), sim.space(), sim.pot(), trial);
+    LoopPosition position; // restarts continue from the saved position
+    if (isCheckpoint(args))
+        loadCheckpoint(Faunus::MPI::prefix + args["--state"].asString(), sim, position, analysis);
+    setup_complete();
+
+    auto &loop = json_in.at("mcloop");
+    int macro = loop.at("macro");
+    int micro = loop.at("micro");
+    int equilibration = loop.value("equilibration", 0); // macro steps before production
+    if (loop.value("reweight", false) and equilibration == 0)
+        faunus_logger->warn("move reweighting requires equilibration steps");
+
+    // binary checkpoints are saved at wall-clock intervals, on SIGUSR1, and after the last step
+    std::string checkpoint_file;
+    std::chrono::seconds checkpoint_interval(0);
+    if (auto it = loop.find("checkpoint"); it != loop.end()) {
+        checkpoint_file = Faunus::MPI::prefix + it->at("file").get<std::string>();
+        checkpoint_interval = std::chrono::seconds(it->value("interval", 0));
+#ifdef SIGUSR1
+        std::signal(SIGUSR1, [](int) { checkpoint_requests++; });
+#endif
+    }
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    int handled_requests = checkpoint_requests;
+    auto checkpoint_step = [&]() {
+        if (checkpoint_file.empty())
+            return;
+        auto now = std::chrono::steady_clock::now();
+        bool timeout = checkpoint_interval.count() > 0 and now - last_checkpoint >= checkpoint_interval;
+        if (timeout or handled_requests != checkpoint_requests) {
+            handled_requests = checkpoint_requests;
+            last_checkpoint = now;
+            saveCheckpoint(checkpoint_file, sim, position, analysis);
+        }
+    };
+
+    int remaining_steps = (position.equilibrated ? 0 : equilibration * micro) +
+                          std::max(0, (macro - position.macro) * micro - position.micro);
+    auto progress_tracker = createProgressTracker(show_progress, remaining_steps);
+    auto show_progress_step = [&]() {
+        if (progress_tracker && mpi.isMaster()) {
+            if (++(*progress_tracker) % 10 == 0) {
+                progress_tracker->display();
+            }
+        }
+    };
+
+    if (position.equilibrated)
+        faunus_logger->info("continuing from macro step {} and micro step {}", position.macro, position.micro);
+    else if (equilibration > 0) {
+        faunus_logger->info("equilibrating for {} x {} steps with step size tuning", equilibration, micro);
+        sim.moves.tune(true, loop.value("reweight", false));
+        for (int i = 0; i < equilibration * micro; i++) {
+            show_progress_step();
+            sim.move();
+        }
+        sim.moves.tune(false); // displacement parameters are now fixed
+    }
+    position.equilibrated = true;
+
+    for (; position.macro < macro; position.macro++) {
+        while (position.micro < micro) {
+            show_progress_step();
+            sim.move();
+            analysis.sample();
+            position.micro++;
+            checkpoint_step();
+        }                   // end of micro steps
+        analysis.to_disk(); // save analysis to disk
+        position.micro = 0;
+    }                       // end of macro steps
+#ifdef ENABLE_MPI
+    for (auto penalty : sim.pot().find<Energy::PenaltyMPI>())
+        penalty->finalize(); // collective calls on all walkers
+#endif
+    if (progress_tracker && mpi.isMaster()) {
+        progress_tracker->done();
+    }
+    if (not checkpoint_file.empty())
+        saveCheckpoint(checkpoint_file, sim, position, analysis);
+
+    if (double drift = sim.drift(); std::fabs(drift) < 1E-9)
+        faunus_logger->info("relative drift = {}", drift);
+    else {
+        faunus_logger->warn("relative drift = {}", drift);
+        const auto &drift_terms = sim.driftTerms(); // point to the responsible energy terms
+        for (size_t n = 0; n < drift_terms.size(); n++)
+            if (not(std::fabs(drift_terms[n]) <= 1E-6)) // also if NaN
+                faunus_logger->warn("energy drift in {} = {} kT", sim.pot().vec[n]->name, drift_terms[n]);
+    }
+
+    // --output
+    std::ofstream f(Faunus::MPI::prefix + args["--output"].asString());
+    if (f) {
+        json json_out;
+        Faunus::to_json(json_out, sim);
+        json_out["relative drift"] = sim.drift();
+        json_out["analysis"] = analysis;
+        if (mpi.nproc() > 1) {
+            json_out["mpi"] = mpi;
+        }
+#ifdef GIT_COMMIT_HASH
+        json_out["git revision"] = GIT_COMMIT_HASH;
+#endif
+#ifdef __VERSION__
+        json_out["compiler"] = __VERSION__;
+#endif
+        f << std::setw(4) << json_out << endl;
+    }
+}
+
+/**
+ * Run replicas as threads in the current process, each with its own `MCSimulation`.
+ *
+ * Replicas are set up one at a time as the topology (atoms, molecules, reactions) is
+ * global and loaded by the first replica only, while the others verify that their
+ * topology is identical; all replicas then wait for each other
+ * before starting. Replica exchange moves (`temper`) use a `MPI::SharedExchange`.
+ * If a replica fails, all other replicas are aborted and the first error is rethrown.
+ *
+ * @param args Command line options
+ * @param replicas Number of replicas
+ * @param show_progress Show progress bar of first replica
+ */
+void runReplicas(Toptions &args, int replicas, bool show_progress) {
+    if (args["--input"].asString() == "/dev/stdin")
+        throw std::runtime_error("replicas require an input file");
+    faunus_logger->info("running {} replicas as threads", replicas);
+
+    auto exchange = std::make_shared<MPI::SharedExchange>(replicas);
+    std::mutex setup_mutex; // protects the below as well as global topology during setup
+    std::condition_variable setup_cv;
+    int setup_pending = replicas;
+    bool failed = false;
+    std::string error;
+
+    std::vector<std::thread> threads;
+    for (int rank = 0; rank < replicas; rank++) {
+        threads.emplace_back([&, rank] {
+            MPI::MPIController controller;
+            controller.initThread(rank, exchange);
+            try {
+                std::unique_lock<std::mutex> lock(setup_mutex); // one replica is set up at a time
+                runSimulation(args, controller, show_progress and rank == 0, [&] {
+                    setup_pending--;
+                    setup_cv.notify_all();
+                    setup_cv.wait(lock, [&] { return setup_pending == 0 or failed; });
+                    if (failed)
+                        throw std::runtime_error("replica " + controller.id + " aborted");
+                    lock.unlock();
+                });
+            } catch (std::exception &e) {
+                {
+                    std::lock_guard<std::mutex> lock(setup_mutex);
+                    if (not failed)
+                        error = "replica " + controller.id + ": " + e.what();
+                    failed = true;
+                }
+                setup_cv.notify_all();
+                exchange->abort();
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    if (failed)
+        throw std::runtime_error(error);
+}
+
+/**
+ * @brief Frames of a trajectory assigned to a single rerun worker
+ *
+ * Frames are distributed round-robin, i.e. worker `w` of `n` loads frames
+ * `w, w+n, w+2n, ...`. Space trajectories (.traj/.ztraj) are accessed directly by
+ * frame index, whereas XTC files are read sequentially, skipping frames of other workers.
+ * As XTC files contain only positions and box, molecular mass centers are recalculated.
+ */
+class RerunFrames {
+    std::unique_ptr<SpaceTrajectoryReader> reader;
+    std::unique_ptr<FormatXTC> xtc;
+    TrajectoryFrame frame;
+    size_t next_frame;     // index of next frame to load
+    size_t stride;         // number of workers
+    size_t xtc_frames = 0; // number of frames read from xtc file
+
+  public:
+    RerunFrames(const std::string &filename, const Space &spc, size_t worker, size_t workers)
+        : next_frame(worker), stride(workers) {
+        if (filename.substr(filename.find_last_of(".") + 1) == "xtc") {
+            xtc = std::make_unique<FormatXTC>(spc.geo.getLength().x());
+            if (not xtc->open(filename))
+                throw std::runtime_error("cannot open " + filename);
+            if (xtc->getNumAtoms() != int(spc.p.size()))
+                throw std::runtime_error(filename + " must contain all particles, active and inactive; found " +
+                                         std::to_string(xtc->getNumAtoms()) + " out of " +
+                                         std::to_string(spc.p.size()));
+        } else
+            reader = std::make_unique<SpaceTrajectoryReader>(filename);
+    }
+
+    /**
+     * @brief Load next frame of this worker into space
+     * @param spc Space with the same topology as the trajectory
+     * @param index Set to the index of the loaded frame
+     * @return False if there are no more frames
+     */
+    bool load(Space &spc, size_t &index) {
+        if (reader) {
+            if (next_frame >= reader->size())
+                return false;
+            reader->load(next_frame, frame);
+            frame.copyTo(spc);
+        } else {
+            while (xtc_frames <= next_frame) {
+                if (not xtc->loadNextFrame(spc, true, true))
+                    return false;
+                xtc_frames++;
+            }
+            for (auto &group : spc.groups)
+                if (not group.atomic and not group.empty())
+                    group.cm = Geometry::massCenter(group.begin(), group.end(), spc.geo.getBoundaryFunc(), -group.cm);
+        }
+        index = next_frame;
+        next_frame += stride;
+        return true;
+    }
+};
+
+/**
+ * Run analysis on an existing trajectory (--rerun) instead of simulating
+ *
+ * Each worker thread has its own copy of the space, Hamiltonian, and analysis,
+ * and processes a subset of the frames (see `RerunFrames`). Analysis intervals,
+ * `nstep`, hence refer to frames handled by each worker. With MPI, frames are
+ * further distributed over processes and the frame count and free energy are
+ * reduced over all processes. If the input contains a `reweight` section,
+ * the energy of each frame is also calculated with this alternative Hamiltonian,
+ * and the free energy difference between the two Hamiltonians is estimated by
+ * exponential averaging.
+ *
+ * @param args Command line options
+ * @param mpi MPI controller
+ */
+void runRerun(Toptions &args, MPI::MPIController &mpi) {
+    json json_in = loadInput(args);
+    const double temperature = json_in.at("temperature").get<double>() * 1.0_K;
+    pc::temperature = temperature;
+    Space spc;
+    from_json(json_in, spc);
+    if (json json_state = loadState(args); not json_state.empty())
+        from_json(json_state, spc);
+    json json_reweight = json_in.value("reweight", json::object());
+
+    const std::string trajectory = args["--rerun"].asString();
+    const size_t num_threads = std::max(1L, args["--workers"].asLong());
+    const size_t num_workers = num_threads * mpi.nproc();
+    faunus_logger->info("rerun of {} using {} workers", trajectory, num_workers);
+
+    struct Worker {
+        json analysis;                                    // analysis output
+        size_t frames = 0;                                // number of processed frames
+        std::vector<std::tuple<size_t, double, double>> energies; // frame, energy, and reweight energy
+    };
+    std::vector<Worker> workers(num_threads);
+    const std::string prefix = MPI::prefix;
+    std::mutex setup_mutex; // setup reads global topology and may write to the log
+    std::exception_ptr error = nullptr;
+
+    auto run = [&](size_t thread) {
+        try {
+            size_t worker = mpi.rank() * num_threads + thread;
+            MPI::prefix = (num_workers > 1) ? prefix + "worker" + std::to_string(worker) + "." : prefix;
+            pc::temperature = temperature; // thread local
+            if (auto it = json_in.find("random"); it != json_in.end())
+                Faunus::random = *it; // thread local
+            if (worker > 0) {
+                std::seed_seq seed{uint32_t(Faunus::random.engine()), uint32_t(worker)};
+                Faunus::random.engine.seed(seed); // distinct stream for each worker
+            }
+            std::unique_lock<std::mutex> lock(setup_mutex);
+            Space worker_spc;
+            Change change;
+            change.all = true;
+            worker_spc.sync(spc, change);
+            Energy::Hamiltonian pot(worker_spc, json_in.at("energy"));
+            pot.key = Energy::Energybase::OLD; // frames are treated as accepted states
+            std::unique_ptr<Energy::Hamiltonian> reweight_pot;
+            if (not json_reweight.empty()) {
+                reweight_pot = std::make_unique<Energy::Hamiltonian>(worker_spc, json_reweight.at("energy"));
+                reweight_pot->key = Energy::Energybase::OLD;
+            }
+            Analysis::CombinedAnalysis analysis(json_in.at("analysis"), worker_spc, pot);
+            RerunFrames frames(trajectory, worker_spc, worker, num_workers);
+            lock.unlock();
+
+            auto &result = workers[thread];
+            for (size_t index; frames.load(worker_spc, index);) {
+                pot.init();
+                if (reweight_pot) {
+                    reweight_pot->init();
+                    result.energies.emplace_back(index, pot.energy(change), reweight_pot->energy(change));
+                }
+                analysis.sample();
+                result.frames++;
+            }
+            analysis.to_disk();
+            result.analysis = analysis;
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(setup_mutex);
+            if (not error)
+                error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t thread = 1; thread < num_threads; thread++)
+        threads.emplace_back(run, thread);
+    run(0);
+    for (auto &thread : threads)
+        thread.join();
+    MPI::prefix = prefix;
+
+    // sum and minimum over all MPI processes
+    auto reduce_sum = [&](double local) {
+#ifdef ENABLE_MPI
+        if (mpi.nproc() > 1)
+            return MPI::reduceDouble(mpi, local);
+#endif
+        return local;
+    };
+    auto reduce_min = [&](double local) {
+#ifdef ENABLE_MPI
+        if (mpi.nproc() > 1)
+            return MPI::reduceMin(mpi, local);
+#endif
+        return local;
+    };
+
+    // all processes must agree on failure as the others would otherwise wait in the reductions below
+    const double num_failed = reduce_sum(error ? 1.0 : 0.0);
+    if (error)
+        std::rethrow_exception(error);
+    if (num_failed > 0)
+        throw std::runtime_error("rerun failed on " + std::to_string(int(num_failed)) + " other MPI process(es)");
+
+    json json_out = {{"rerun", {{"trajectory", trajectory}, {"workers", num_workers}}}};
+    size_t frames = 0;
+    for (auto &worker : workers)
+        frames += worker.frames;
+    frames = size_t(reduce_sum(double(frames)));
+    if (frames == 0)
+        throw std::runtime_error("no frames found in " + trajectory);
+    json_out["rerun"]["frames"] = frames;
+    faunus_logger->info("analysed {} frames", frames);
+    if (num_threads == 1)
+        json_out["analysis"] = workers.front().analysis;
+    else
+        for (auto &worker : workers)
+            json_out["analysis"].push_back(worker.analysis);
+
+    if (not json_reweight.empty()) {
+        std::vector<std::tuple<size_t, double, double>> energies;
+        for (auto &worker : workers)
+            energies.insert(energies.end(), worker.energies.begin(), worker.energies.end());
+        std::sort(energies.begin(), energies.end());
+        double du_min = pc::infty; // shift to avoid overflow in exponential average
+        for (auto [index, u, u_new] : energies)
+            du_min = std::min(du_min, u_new - u);
+        du_min = reduce_min(du_min);
+        double boltzmann = 0;
+        for (auto [index, u, u_new] : energies)
+            boltzmann += std::exp(-(u_new - u - du_min));
+        boltzmann = reduce_sum(boltzmann);
+        const auto num_energies = size_t(reduce_sum(double(energies.size())));
+        if (num_energies > 0)
+            json_out["reweight"] = {{"free energy", du_min - std::log(boltzmann / num_energies)},
+                                    {"frames", num_energies},
+                                    {"unit", "kT"}};
+        if (auto it = json_reweight.find("file"); it != json_reweight.end()) {
+            std::ofstream f(MPI::prefix + it->get<std::string>());
+            if (not f)
+                throw std::runtime_error("cannot create reweight file");
+            f << "# frame energy reweight_energy (kT)\n";
+            for (auto [index, u, u_new] : energies)
+                f << index << " " << u << " " << u_new << "\n";
+        }
+    }
+
+    std::ofstream f(MPI::prefix + args["--output"].asString());
+    if (f) {
+        if (mpi.nproc() > 1) {
+            json_out["mpi"] = mpi;
+        }
+#ifdef GIT_COMMIT_HASH
+        json_out["git revision"] = GIT_COMMIT_HASH;
+#endif
+        f << std::setw(4) << json_out << endl;
+    }
+}
+
+/**
+ * @brief Convert structures to a conformation library
+ *
+ * PQR files are read frame by frame so that trajectories larger than the
+ * available memory can be converted.
+ */
+void runConversion(Toptions &args) {
+    json json_in = loadInput(args);
+    Faunus::atoms = json_in.at("atomlist").get<decltype(Faunus::atoms)>();
+    const std::string library = args["--conflib"].asString();
+    ConformationLibraryWriter writer(library, args["--double"].asBool());
+    for (const auto &file : args["<structure>"].asStringList()) {
+        std::string suffix = file.substr(file.find_last_of(".") + 1);
+        if (suffix == "pqr") {
+            auto n = FormatPQR::loadTrajectory(file, [&](ParticleVector &frame) { writer.save(frame); });
+            faunus_logger->info("{} conformations from {}", n, file);
+        } else if (ParticleVector particles; loadStructure(file, particles, false))
+            writer.save(particles);
+        else
+            throw std::runtime_error("structure " + file + " not loaded. Filetype must be .aam/.pqr/.xyz");
+    }
+    writer.close();
+    faunus_logger->info("{} conformations written to {}", writer.size(), library);
+}
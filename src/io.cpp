@@ -3,7 +3,20 @@
 #include "random.h"
 #include <spdlog/spdlog.h>
 #include <zstr.hpp>
+#include <zlib.h>
+#include <cstring>
+#include <sstream>
+#include <array>
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define FAUNUS_MMAP
+#endif
 #include <cereal/archives/binary.hpp>
+#include <cereal/types/utility.hpp>
+#include <cereal/types/vector.hpp>
 #include <fstream>
 #include <iostream>
 
@@ -270,25 +283,43 @@ Point FormatPQR::load(const std::string &filename, ParticleVector &destination,
  * ignored.
  */
 void FormatPQR::loadTrajectory(const std::string &filename, std::vector<ParticleVector> &traj) {
+    traj.clear();
+    loadTrajectory(filename, [&](ParticleVector &frame) { traj.push_back(std::move(frame)); });
+}
+
+/**
+ * @param filename PQR trajectory filename
+ * @param function Called for each frame; the frame may be moved from
+ * @return Number of frames
+ *
+ * Frames are read one at a time, allowing trajectories larger than the available memory
+ * to be processed.
+ */
+size_t FormatPQR::loadTrajectory(const std::string &filename, const std::function<void(ParticleVector &)> &function) {
     if (std::ifstream file(filename); bool(file)) {
         std::string record;
-        traj.clear();
-        traj.resize(1); // prepare first frame
+        ParticleVector frame;
+        size_t frame_size = 0, num_frames = 0;
         while (std::getline(file, record)) {
             Particle particle;
             double radius = 0;
             if (readAtomRecord(record, particle, radius)) {
-                traj.back().push_back(particle);
-            } else if (record.find("END") == 0) {         // if END record, advance to next frame
-                traj.back().shrink_to_fit();              // attempt to clean up
-                traj.push_back(ParticleVector());         // prepare next frame
-                traj.back().reserve(traj.front().size()); // reserve memory
+                frame.push_back(particle);
+            } else if (record.find("END") == 0 and not frame.empty()) { // if END record, advance to next frame
+                frame_size = frame.size();
+                function(frame);
+                num_frames++;
+                frame.clear();
+                frame.reserve(frame_size); // reserve memory
             }
         }
-        if (traj.back().empty()) // delete empty frame after last "END" record
-            traj.pop_back();
-        if (traj.empty())
+        if (not frame.empty()) { // last frame without "END" record
+            function(frame);
+            num_frames++;
+        }
+        if (num_frames == 0)
             faunus_logger->warn("pqr trajectory {} is empty", filename);
+        return num_frames;
     } else
         throw std::runtime_error("pqr file not found: " + filename);
 }
@@ -412,6 +443,70 @@ bool FormatGRO::load(const std::string &file, ParticleVector &particle_vector) {
     return false;
 }
 
+XTCWriter::XTCWriter(const std::string &filename, size_t capacity) : frames(std::max(capacity, size_t(1))) {
+    xd = xdrfile_open(&filename[0], "w");
+    if (xd == nullptr)
+        throw std::runtime_error("cannot create xtc file " + filename);
+    thread = std::thread(&XTCWriter::writeFrames, this);
+}
+
+XTCWriter::~XTCWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    produced.notify_all();
+    thread.join(); // pending frames are written before the thread exits
+    xdrfile_close(xd);
+    if (not error.empty())
+        faunus_logger->error(error);
+}
+
+void XTCWriter::writeFrames() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        produced.wait(lock, [&] { return pending > 0 or done; });
+        if (pending == 0)
+            break; // done and nothing left to write
+        Frame &frame = frames[(head + frames.size() - pending) % frames.size()];
+        lock.unlock(); // the producer never touches a pending frame
+        int rc = write_xtc(xd, frame.x.size() / 3, frame.step, frame.time, frame.box,
+                           reinterpret_cast<rvec *>(frame.x.data()), precision);
+        lock.lock();
+        if (rc != exdrOK and error.empty())
+            error = "error writing xtc frame " + std::to_string(frame.step);
+        pending--;
+        consumed.notify_all();
+    }
+}
+
+XTCWriter::Frame &XTCWriter::nextFrame() {
+    std::unique_lock<std::mutex> lock(mutex);
+    consumed.wait(lock, [&] { return pending < frames.size(); });
+    if (not error.empty())
+        throw std::runtime_error(error);
+    return frames[head];
+}
+
+void XTCWriter::push() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        frames[head].step = step;
+        frames[head].time = step;
+        step++;
+        head = (head + 1) % frames.size();
+        pending++;
+    }
+    produced.notify_one();
+}
+
+void XTCWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    consumed.wait(lock, [&] { return pending == 0; });
+    if (not error.empty())
+        throw std::runtime_error(error);
+}
+
 std::vector<Particle> fastaToParticles(const std::string &fasta_sequence, double bond_length, const Point &origin) {
     ParticleVector particles; // particle vector
     particles.reserve(fasta_sequence.size());
@@ -503,4 +598,835 @@ std::unique_ptr<std::istream> makeInputStream(const std::string &filename, std::
     return std::make_unique<zstr::ifstream>(filename, mode);
 }
 
+namespace {
+/** Append signed integer as zigzag encoded varint */
+void putVarint(std::vector<unsigned char> &buffer, int64_t value) {
+    uint64_t zigzag = (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+    while (zigzag >= 0x80) {
+        buffer.push_back(static_cast<unsigned char>(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    buffer.push_back(static_cast<unsigned char>(zigzag));
+}
+
+/** Read zigzag encoded varint and advance position */
+int64_t getVarint(const std::vector<unsigned char> &buffer, size_t &pos) {
+    uint64_t zigzag = 0;
+    for (int shift = 0;; shift += 7) {
+        if (pos >= buffer.size() or shift > 63)
+            throw std::runtime_error("unexpected end of data block");
+        auto byte = buffer[pos++];
+        zigzag |= uint64_t(byte & 0x7f) << shift;
+        if (not(byte & 0x80))
+            break;
+    }
+    return int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+}
+
+template <typename T> void putRaw(std::vector<unsigned char> &buffer, const T &value) {
+    auto bytes = reinterpret_cast<const unsigned char *>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T> T getRaw(const std::vector<unsigned char> &buffer, size_t &pos) {
+    if (pos + sizeof(T) > buffer.size())
+        throw std::runtime_error("unexpected end of data block");
+    T value;
+    std::memcpy(&value, buffer.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+}
+
+template <typename T> void writeRaw(std::ostream &stream, const T &value) {
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void readExactly(std::istream &stream, void *destination, size_t n) {
+    if (not stream.read(reinterpret_cast<char *>(destination), n))
+        throw std::runtime_error("unexpected end of file");
+}
+} // namespace
+
+bool FormatSpaceTrajectory::useCompression(const std::string &filename) {
+    std::string suffix = filename.substr(filename.find_last_of(".") + 1);
+    if (suffix == "ztraj")
+        return true;
+    else if (suffix == "traj")
+        return false;
+    else
+        throw std::runtime_error("Trajectory file suffix must be `.traj` or `.ztraj`");
+}
+
+const json &FormatSpaceTrajectory::getTopology() const { return topology; }
+
+size_t FormatSpaceTrajectory::size() const { return offsets.size(); }
+
+void FormatSpaceTrajectory::readBytes(std::istream &stream, void *destination, size_t n) {
+    if (not stream.read(reinterpret_cast<char *>(destination), n))
+        throw std::runtime_error("unexpected end of trajectory file");
+}
+
+/**
+ * Quantized positions are delta encoded with respect to the previous particle
+ * (or group mass center) which for molecular systems, where consecutive particles
+ * are close in space, results in short varints.
+ */
+void FormatSpaceTrajectory::encode(const TrajectoryFrame &frame) {
+    block.clear();
+    putRaw(block, frame.step);
+    for (int d = 0; d < 3; d++)
+        putRaw(block, frame.box[d]);
+    putRaw(block, uint32_t(frame.group_sizes.size()));
+    putRaw(block, uint32_t(frame.positions.size()));
+
+    auto putPositions = [&](const std::vector<Point> &positions) {
+        std::array<int64_t, 3> previous = {0, 0, 0};
+        for (const auto &pos : positions)
+            for (int d = 0; d < 3; d++) {
+                auto quantized = std::llround(pos[d] * precision);
+                putVarint(block, quantized - previous[d]);
+                previous[d] = quantized;
+            }
+    };
+
+    for (size_t i = 0; i < frame.group_sizes.size(); i++) {
+        putVarint(block, frame.group_sizes[i]);
+        putVarint(block, frame.confids[i]);
+    }
+    putPositions(frame.mass_centers);
+    int32_t previous_id = 0;
+    for (auto id : frame.ids) {
+        putVarint(block, id - previous_id);
+        previous_id = id;
+    }
+    for (auto charge : frame.charges)
+        putRaw(block, charge);
+    putPositions(frame.positions);
+
+    std::ostringstream extensions;
+    {
+        cereal::BinaryOutputArchive archive(extensions);
+        archive(frame.extensions);
+    }
+    const std::string &bytes = extensions.str();
+    putRaw(block, uint32_t(bytes.size()));
+    block.insert(block.end(), bytes.begin(), bytes.end());
+}
+
+void FormatSpaceTrajectory::decode(TrajectoryFrame &frame) const {
+    size_t pos = 0;
+    frame.step = getRaw<uint64_t>(block, pos);
+    for (int d = 0; d < 3; d++)
+        frame.box[d] = getRaw<double>(block, pos);
+    auto num_groups = getRaw<uint32_t>(block, pos);
+    auto num_particles = getRaw<uint32_t>(block, pos);
+
+    auto getPositions = [&](std::vector<Point> &positions, size_t n) {
+        positions.resize(n);
+        std::array<int64_t, 3> previous = {0, 0, 0};
+        for (auto &position : positions)
+            for (int d = 0; d < 3; d++) {
+                previous[d] += getVarint(block, pos);
+                position[d] = previous[d] / precision;
+            }
+    };
+
+    frame.group_sizes.resize(num_groups);
+    frame.confids.resize(num_groups);
+    for (size_t i = 0; i < num_groups; i++) {
+        frame.group_sizes[i] = getVarint(block, pos);
+        frame.confids[i] = getVarint(block, pos);
+    }
+    getPositions(frame.mass_centers, num_groups);
+    frame.ids.resize(num_particles);
+    int32_t previous_id = 0;
+    for (auto &id : frame.ids)
+        id = previous_id += getVarint(block, pos);
+    frame.charges.resize(num_particles);
+    for (auto &charge : frame.charges)
+        charge = getRaw<float>(block, pos);
+    getPositions(frame.positions, num_particles);
+
+    auto size = getRaw<uint32_t>(block, pos);
+    if (pos + size > block.size())
+        throw std::runtime_error("unexpected end of data block");
+    std::istringstream extensions(std::string(reinterpret_cast<const char *>(block.data()) + pos, size));
+    cereal::BinaryInputArchive archive(extensions);
+    archive(frame.extensions);
+}
+
+SpaceTrajectoryWriter::SpaceTrajectoryWriter(const std::string &filename, const json &topology, double precision) {
+    this->topology = topology;
+    this->precision = precision;
+    if (precision <= 0)
+        throw std::runtime_error("trajectory precision must be positive");
+    compression = useCompression(filename);
+    stream.open(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (not stream)
+        throw std::runtime_error("error creating " + filename);
+    std::string topology_string = topology.dump();
+    stream.write(header_magic, 8);
+    writeRaw(stream, version);
+    writeRaw(stream, uint32_t(compression ? COMPRESSED : 0));
+    writeRaw(stream, precision);
+    writeRaw(stream, uint64_t(topology_string.size()));
+    stream.write(topology_string.data(), topology_string.size());
+    data_end = stream.tellp();
+}
+
+SpaceTrajectoryWriter::~SpaceTrajectoryWriter() {
+    try {
+        flush();
+    } catch (std::exception &e) {
+        faunus_logger->error("space trajectory: {}", e.what());
+    }
+}
+
+void SpaceTrajectoryWriter::save(const TrajectoryFrame &frame) {
+    encode(frame);
+    const unsigned char *data = block.data();
+    uLongf stored_size = block.size();
+    if (compression) {
+        compressed.resize(compressBound(block.size()));
+        stored_size = compressed.size();
+        if (compress2(compressed.data(), &stored_size, block.data(), block.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+            throw std::runtime_error("trajectory compression failed");
+        data = compressed.data();
+    }
+    stream.seekp(data_end); // overwrite footer from previous flush
+    writeRaw(stream, uint32_t(stored_size));
+    writeRaw(stream, uint32_t(block.size()));
+    stream.write(reinterpret_cast<const char *>(data), stored_size);
+    offsets.push_back(data_end);
+    data_end = stream.tellp();
+    if (data_end < footer_end) { // zero what is left of the old footer
+        std::vector<char> zeros(footer_end - data_end, 0);
+        stream.write(zeros.data(), zeros.size());
+        footer_end = 0;
+    }
+    if (not stream)
+        throw std::runtime_error("error writing trajectory frame");
+}
+
+void SpaceTrajectoryWriter::flush() {
+    if (stream.is_open()) {
+        stream.seekp(data_end);
+        stream.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        writeRaw(stream, uint64_t(offsets.size()));
+        stream.write(footer_magic, 8);
+        footer_end = stream.tellp();
+        stream.flush();
+    }
+}
+
+SpaceTrajectoryReader::SpaceTrajectoryReader(const std::string &filename) {
+    stream.open(filename, std::ios::binary);
+    if (not stream)
+        throw std::runtime_error("cannot open " + filename);
+    char magic[8];
+    uint32_t file_version;
+    uint64_t topology_size;
+    readBytes(stream, magic, 8);
+    if (std::memcmp(magic, header_magic, 8) != 0)
+        throw std::runtime_error(filename + " is not a space trajectory");
+    readBytes(stream, &file_version, sizeof(file_version));
+    if (file_version != version)
+        throw std::runtime_error(filename + ": unsupported trajectory version");
+    readBytes(stream, &flags, sizeof(flags));
+    readBytes(stream, &precision, sizeof(precision));
+    readBytes(stream, &topology_size, sizeof(topology_size));
+    std::string topology_string(topology_size, ' ');
+    readBytes(stream, topology_string.data(), topology_size);
+    topology = json::parse(topology_string);
+    uint64_t first_frame = stream.tellg();
+
+    stream.seekg(0, std::ios::end);
+    uint64_t file_size = stream.tellg();
+    uint64_t num_frames = 0;
+    if (file_size >= first_frame + 16) {
+        stream.seekg(file_size - 16);
+        readBytes(stream, &num_frames, sizeof(num_frames));
+        readBytes(stream, magic, 8);
+        uint64_t index_size = num_frames * sizeof(uint64_t);
+        if (std::memcmp(magic, footer_magic, 8) == 0 and file_size - 16 - first_frame >= index_size) {
+            offsets.resize(num_frames);
+            stream.seekg(file_size - 16 - index_size);
+            readBytes(stream, offsets.data(), index_size);
+            if (validIndex(first_frame, file_size - 16 - index_size))
+                return;
+        }
+    }
+    faunus_logger->warn("{}: no valid frame index found; scanning frames", filename);
+    scanFrames(first_frame, file_size);
+}
+
+/**
+ * Offsets must increase from the first frame, and the last frame must end where the
+ * index starts, which rules out a stale footer left behind by an interrupted write.
+ */
+bool SpaceTrajectoryReader::validIndex(uint64_t first, uint64_t index_start) {
+    if (offsets.empty())
+        return first == index_start;
+    if (offsets.front() != first or not std::is_sorted(offsets.begin(), offsets.end()) or
+        offsets.back() + 2 * sizeof(uint32_t) > index_start)
+        return false;
+    uint32_t stored_size;
+    stream.seekg(offsets.back());
+    readBytes(stream, &stored_size, sizeof(stored_size));
+    return offsets.back() + 2 * sizeof(uint32_t) + stored_size == index_start;
+}
+
+void SpaceTrajectoryReader::scanFrames(uint64_t first, uint64_t file_size) {
+    offsets.clear();
+    stream.clear();
+    uint64_t offset = first;
+    uint32_t sizes[2];
+    while (offset + sizeof(sizes) <= file_size) {
+        stream.seekg(offset);
+        readBytes(stream, sizes, sizeof(sizes));
+        uint64_t next = offset + sizeof(sizes) + sizes[0];
+        if (next > file_size or sizes[1] == 0)
+            break; // truncated frame or zeroed footer
+        offsets.push_back(offset);
+        offset = next;
+    }
+}
+
+void SpaceTrajectoryReader::load(size_t k, TrajectoryFrame &frame) {
+    if (k >= offsets.size())
+        throw std::out_of_range("trajectory frame out of range");
+    uint32_t stored_size, raw_size;
+    stream.clear();
+    stream.seekg(offsets[k]);
+    readBytes(stream, &stored_size, sizeof(stored_size));
+    readBytes(stream, &raw_size, sizeof(raw_size));
+    block.resize(raw_size);
+    if (flags & COMPRESSED) {
+        compressed.resize(stored_size);
+        readBytes(stream, compressed.data(), stored_size);
+        uLongf size = raw_size;
+        if (uncompress(block.data(), &size, compressed.data(), stored_size) != Z_OK or size != raw_size)
+            throw std::runtime_error("trajectory decompression failed");
+    } else
+        readBytes(stream, block.data(), raw_size);
+    decode(frame);
+    current = k + 1;
+}
+
+bool SpaceTrajectoryReader::loadNextFrame(TrajectoryFrame &frame) {
+    if (current >= offsets.size())
+        return false;
+    load(current, frame);
+    return true;
+}
+
+bool FormatConformationLibrary::isLibrary(const std::string &filename) {
+    return filename.substr(filename.find_last_of(".") + 1) == "conflib";
+}
+
+size_t FormatConformationLibrary::size() const { return num_conformations; }
+
+const std::vector<int> &FormatConformationLibrary::atomIds() const { return ids; }
+
+size_t FormatConformationLibrary::stride() const {
+    return ids.size() * 4 * ((flags & DOUBLE) ? sizeof(double) : sizeof(float));
+}
+
+ConformationLibraryWriter::ConformationLibraryWriter(const std::string &filename, bool double_precision) {
+    flags = double_precision ? DOUBLE : 0;
+    if (not isLibrary(filename))
+        throw std::runtime_error("conformation library suffix must be `.conflib`");
+    stream.open(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (not stream)
+        throw std::runtime_error("error creating " + filename);
+}
+
+ConformationLibraryWriter::~ConformationLibraryWriter() {
+    try {
+        close();
+    } catch (std::exception &e) {
+        faunus_logger->error("conformation library: {}", e.what());
+    }
+}
+
+void ConformationLibraryWriter::save(const ParticleVector &particles) {
+    if (data_offset == 0) { // first conformation defines atoms and header size
+        if (particles.empty())
+            throw std::runtime_error("empty conformation");
+        for (const auto &particle : particles)
+            ids.push_back(particle.id);
+        data_offset = 8 + 2 * sizeof(uint32_t) + 3 * sizeof(uint64_t);
+        for (auto id : ids)
+            data_offset += atoms.at(id).name.size() + 1;
+        data_offset += (alignment - data_offset % alignment) % alignment;
+        stream.seekp(data_offset);
+    }
+    if (particles.size() != ids.size())
+        throw std::runtime_error("conformation atom count mismatch");
+    record.resize(stride());
+    auto putValues = [&](auto value) {
+        using T = decltype(value);
+        for (size_t i = 0; i < particles.size(); i++) {
+            if (particles[i].id != ids[i])
+                throw std::runtime_error("conformation atom sequence mismatch");
+            T values[4] = {T(particles[i].pos.x()), T(particles[i].pos.y()), T(particles[i].pos.z()),
+                           T(particles[i].charge)};
+            std::memcpy(record.data() + i * sizeof(values), values, sizeof(values));
+        }
+    };
+    if (flags & DOUBLE)
+        putValues(double());
+    else
+        putValues(float());
+    stream.write(reinterpret_cast<const char *>(record.data()), record.size());
+    if (not stream)
+        throw std::runtime_error("error writing conformation");
+    num_conformations++;
+}
+
+void ConformationLibraryWriter::close() {
+    if (stream.is_open()) {
+        stream.seekp(0);
+        stream.write(magic, 8);
+        writeRaw(stream, version);
+        writeRaw(stream, flags);
+        writeRaw(stream, uint64_t(ids.size()));
+        writeRaw(stream, num_conformations);
+        writeRaw(stream, data_offset);
+        for (auto id : ids)
+            stream.write(atoms.at(id).name.c_str(), atoms.at(id).name.size() + 1);
+        if (not stream)
+            throw std::runtime_error("error writing conformation library header");
+        stream.close();
+    }
+}
+
+ConformationLibraryReader::ConformationLibraryReader(const std::string &filename) {
+    stream.open(filename, std::ios::binary);
+    if (not stream)
+        throw std::runtime_error("cannot open " + filename);
+    char file_magic[8];
+    uint32_t file_version;
+    uint64_t num_atoms;
+    readExactly(stream, file_magic, 8);
+    if (std::memcmp(file_magic, magic, 8) != 0)
+        throw std::runtime_error(filename + " is not a conformation library");
+    readExactly(stream, &file_version, sizeof(file_version));
+    if (file_version != version)
+        throw std::runtime_error(filename + ": unsupported conformation library version");
+    readExactly(stream, &flags, sizeof(flags));
+    readExactly(stream, &num_atoms, sizeof(num_atoms));
+    readExactly(stream, &num_conformations, sizeof(num_conformations));
+    readExactly(stream, &data_offset, sizeof(data_offset));
+    ids.reserve(num_atoms);
+    std::string name;
+    for (uint64_t i = 0; i < num_atoms; i++) {
+        if (not std::getline(stream, name, '\0'))
+            throw std::runtime_error(filename + ": unexpected end of header");
+        auto it = findName(atoms, name);
+        if (it == atoms.end())
+            throw std::runtime_error(filename + ": unknown atom name '" + name + "'");
+        ids.push_back(it->id());
+    }
+    stream.seekg(0, std::ios::end);
+    uint64_t file_size = stream.tellg();
+    if (file_size < data_offset + num_conformations * stride())
+        throw std::runtime_error(filename + ": truncated conformation library");
+#ifdef FAUNUS_MMAP
+    if (int fd = ::open(filename.c_str(), O_RDONLY); fd >= 0) {
+        void *address = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // mapping remains valid
+        if (address != MAP_FAILED) {
+            ::madvise(address, file_size, MADV_RANDOM); // conformations are picked at random
+            mapped = static_cast<const unsigned char *>(address);
+            mapped_size = file_size;
+            stream.close();
+        }
+    }
+#endif
+    if (not mapped)
+        faunus_logger->debug("{}: memory mapping unavailable; reading conformations from stream", filename);
+}
+
+ConformationLibraryReader::~ConformationLibraryReader() {
+#ifdef FAUNUS_MMAP
+    if (mapped)
+        ::munmap(const_cast<unsigned char *>(mapped), mapped_size);
+#endif
+}
+
+bool ConformationLibraryReader::isMapped() const { return mapped != nullptr; }
+
+void ConformationLibraryReader::load(size_t k, ParticleVector &particles) const {
+    if (k >= num_conformations)
+        throw std::out_of_range("conformation index out of range");
+    bool reset = particles.size() != ids.size();
+    particles.resize(ids.size());
+    for (size_t i = 0; i < ids.size(); i++)
+        if (reset or particles[i].id != ids[i])
+            particles[i] = atoms[ids[i]];
+
+    auto getValues = [&](const unsigned char *data, auto value) {
+        using T = decltype(value);
+        T values[4];
+        for (auto &particle : particles) {
+            std::memcpy(values, data, sizeof(values));
+            particle.pos = {values[0], values[1], values[2]};
+            particle.charge = values[3];
+            data += sizeof(values);
+        }
+    };
+    auto getRecord = [&](const unsigned char *data) {
+        if (flags & DOUBLE)
+            getValues(data, double());
+        else
+            getValues(data, float());
+    };
+
+    if (mapped)
+        getRecord(mapped + data_offset + k * stride()); // decode directly from mapped pages
+    else {
+        std::lock_guard<std::mutex> lock(mutex);
+        record.resize(stride());
+        stream.clear();
+        stream.seekg(data_offset + k * stride());
+        readExactly(stream, record.data(), record.size());
+        getRecord(record.data());
+    }
+}
+
+TimeSeriesWriter::TimeSeriesWriter(const std::string &filename, size_t max_rows) : max_rows(std::max<size_t>(1, max_rows)) {
+    auto pos = filename.find_last_of(".");
+    std::string suffix = (pos == std::string::npos) ? std::string() : filename.substr(pos + 1);
+    binary = isBinary(filename);
+    compression = (suffix == "ztseries");
+    if (suffix == "csv")
+        separator = ",";
+    stream.open(filename, binary ? std::ios::binary | std::ios::out | std::ios::trunc : std::ios::out);
+    if (not stream)
+        throw std::runtime_error("cannot open output file " + filename);
+}
+
+TimeSeriesWriter::~TimeSeriesWriter() {
+    try {
+        flush();
+    } catch (std::exception &e) {
+        faunus_logger->error("time series: {}", e.what());
+    }
+}
+
+bool TimeSeriesWriter::isBinary(const std::string &filename) {
+    auto pos = filename.find_last_of(".");
+    if (pos == std::string::npos)
+        return false;
+    std::string suffix = filename.substr(pos + 1);
+    return suffix == "tseries" or suffix == "ztseries";
+}
+
+TimeSeriesWriter &TimeSeriesWriter::addColumn(const std::string &name, Type type) {
+    if (header_written or rows > 0 or not row.empty())
+        throw std::runtime_error("time series columns must be added before any values");
+    columns.push_back({name, type});
+    buffers.resize(columns.size());
+    return *this;
+}
+
+TimeSeriesWriter &TimeSeriesWriter::operator<<(double value) {
+    assert(not columns.empty());
+    row.push_back(value);
+    if (row.size() == columns.size())
+        commitRow();
+    return *this;
+}
+
+void TimeSeriesWriter::commitRow() {
+    for (size_t i = 0; i < columns.size(); i++) {
+        const double value = row[i];
+        if (binary) {
+            switch (columns[i].type) {
+            case Type::INT64:
+                putRaw(buffers[i], int64_t(value));
+                break;
+            case Type::FLOAT32:
+                putRaw(buffers[i], float(value));
+                break;
+            case Type::FLOAT64:
+                putRaw(buffers[i], value);
+                break;
+            }
+        } else {
+            if (i > 0)
+                text += separator;
+            switch (columns[i].type) {
+            case Type::INT64:
+                text += fmt::format("{}", int64_t(value));
+                break;
+            case Type::FLOAT32:
+                text += fmt::format("{}", float(value));
+                break;
+            case Type::FLOAT64:
+                text += fmt::format("{}", value);
+                break;
+            }
+        }
+    }
+    if (not binary)
+        text += "\n";
+    row.clear();
+    if (++rows >= max_rows)
+        flush();
+}
+
+void TimeSeriesWriter::writeHeader() {
+    if (binary) {
+        stream.write(magic, 8);
+        writeRaw(stream, version);
+        writeRaw(stream, uint32_t(compression ? COMPRESSED : 0));
+        writeRaw(stream, uint32_t(columns.size()));
+        for (const auto &column : columns) {
+            writeRaw(stream, column.type);
+            writeRaw(stream, uint32_t(column.name.size()));
+            stream.write(column.name.data(), column.name.size());
+        }
+    } else {
+        std::string header = (separator == ",") ? "" : "# ";
+        for (size_t i = 0; i < columns.size(); i++)
+            header += (i > 0 ? separator : "") + columns[i].name;
+        stream << header << "\n";
+    }
+    header_written = true;
+}
+
+/**
+ * In the binary format, each flush adds a chunk so that frequent flushing of
+ * few rows adds a small overhead.
+ */
+void TimeSeriesWriter::flush() {
+    if (not stream.is_open())
+        return;
+    if (not header_written)
+        writeHeader();
+    if (rows > 0) {
+        if (binary) {
+            block.clear();
+            for (auto &buffer : buffers) {
+                block.insert(block.end(), buffer.begin(), buffer.end());
+                buffer.clear();
+            }
+            const unsigned char *data = block.data();
+            uLongf stored_size = block.size();
+            if (compression) {
+                compressed.resize(compressBound(block.size()));
+                stored_size = compressed.size();
+                if (compress2(compressed.data(), &stored_size, block.data(), block.size(), Z_DEFAULT_COMPRESSION) !=
+                    Z_OK)
+                    throw std::runtime_error("time series compression failed");
+                data = compressed.data();
+            }
+            writeRaw(stream, uint32_t(rows));
+            writeRaw(stream, uint32_t(block.size()));
+            writeRaw(stream, uint32_t(stored_size));
+            stream.write(reinterpret_cast<const char *>(data), stored_size);
+        } else {
+            stream << text;
+            text.clear();
+        }
+        rows = 0;
+    }
+    stream.flush();
+    if (not stream)
+        throw std::runtime_error("error writing time series");
+}
+
+TimeSeriesReader::TimeSeriesReader(const std::string &filename) {
+    std::ifstream stream(filename, std::ios::binary);
+    if (not stream)
+        throw std::runtime_error("cannot open " + filename);
+    char file_magic[8];
+    uint32_t file_version, flags, num_columns;
+    readExactly(stream, file_magic, 8);
+    if (std::memcmp(file_magic, TimeSeriesWriter::magic, 8) != 0)
+        throw std::runtime_error(filename + " is not a binary time series");
+    readExactly(stream, &file_version, sizeof(file_version));
+    if (file_version != TimeSeriesWriter::version)
+        throw std::runtime_error(filename + ": unsupported time series version");
+    readExactly(stream, &flags, sizeof(flags));
+    readExactly(stream, &num_columns, sizeof(num_columns));
+    columns.resize(num_columns);
+    data.resize(num_columns);
+    for (auto &column : columns) {
+        uint32_t length;
+        readExactly(stream, &column.type, sizeof(column.type));
+        readExactly(stream, &length, sizeof(length));
+        column.name.resize(length);
+        readExactly(stream, column.name.data(), length);
+    }
+    std::vector<unsigned char> block, compressed;
+    uint32_t sizes[3]; // rows, raw size, stored size
+    while (stream.read(reinterpret_cast<char *>(sizes), sizeof(sizes))) {
+        block.resize(sizes[1]);
+        if (flags & TimeSeriesWriter::COMPRESSED) {
+            compressed.resize(sizes[2]);
+            readExactly(stream, compressed.data(), sizes[2]);
+            uLongf size = sizes[1];
+            if (uncompress(block.data(), &size, compressed.data(), sizes[2]) != Z_OK or size != sizes[1])
+                throw std::runtime_error(filename + ": time series decompression failed");
+        } else
+            readExactly(stream, block.data(), sizes[1]);
+        size_t pos = 0;
+        for (size_t i = 0; i < columns.size(); i++)
+            for (uint32_t k = 0; k < sizes[0]; k++)
+                switch (columns[i].type) {
+                case TimeSeriesWriter::Type::INT64:
+                    data[i].push_back(getRaw<int64_t>(block, pos));
+                    break;
+                case TimeSeriesWriter::Type::FLOAT32:
+                    data[i].push_back(getRaw<float>(block, pos));
+                    break;
+                case TimeSeriesWriter::Type::FLOAT64:
+                    data[i].push_back(getRaw<double>(block, pos));
+                    break;
+                }
+    }
+}
+
+size_t TimeSeriesReader::size() const { return data.empty() ? 0 : data.front().size(); }
+
+const std::vector<TimeSeriesWriter::Column> &TimeSeriesReader::getColumns() const { return columns; }
+
+const std::vector<double> &TimeSeriesReader::operator[](const std::string &name) const {
+    auto it = std::find_if(columns.begin(), columns.end(), [&](auto &column) { return column.name == name; });
+    if (it == columns.end())
+        throw std::runtime_error("unknown time series column '" + name + "'");
+    return data[it - columns.begin()];
+}
+
+bool FormatQRTrajectory::isBinary(const std::string &filename) {
+    auto pos = filename.find_last_of(".");
+    return pos != std::string::npos and filename.substr(pos + 1) == "qrtraj";
+}
+
+size_t FormatQRTrajectory::size() const { return ids.size(); }
+
+QRTrajectoryWriter::QRTrajectoryWriter(const std::string &filename, double precision) {
+    this->precision = precision;
+    if (precision <= 0)
+        throw std::runtime_error("charge precision must be positive");
+    if (atoms.size() >= inactive)
+        throw std::runtime_error("too many atom types for qr trajectory");
+    stream.open(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (not stream)
+        throw std::runtime_error("error creating " + filename);
+}
+
+void QRTrajectoryWriter::add(const Particle *particle) {
+    uint16_t id = inactive;
+    int32_t charge = 0;
+    if (particle) {
+        id = uint16_t(particle->id);
+        charge = int32_t(std::lround((particle->charge - atoms[particle->id].charge) * precision));
+    }
+    const size_t index = num_particles++;
+    if (not header_written) {
+        ids.push_back(id);
+        charges.push_back(charge);
+    } else if (index >= ids.size())
+        throw std::runtime_error("number of particles in qr trajectory must be constant");
+    else if (ids[index] != id or charges[index] != charge) {
+        ids[index] = id;
+        charges[index] = charge;
+    } else
+        return; // unchanged since last frame
+    putRaw(buffer, uint32_t(index));
+    putRaw(buffer, id);
+    putRaw(buffer, charge);
+}
+
+void QRTrajectoryWriter::writeFrame() {
+    if (num_particles != ids.size())
+        throw std::runtime_error("number of particles in qr trajectory must be constant");
+    if (not header_written) {
+        stream.write(magic, 8);
+        writeRaw(stream, version);
+        writeRaw(stream, uint32_t(0)); // flags
+        writeRaw(stream, precision);
+        writeRaw(stream, uint32_t(ids.size()));
+        writeRaw(stream, uint32_t(atoms.size()));
+        for (const auto &atom : atoms) {
+            stream.write(atom.name.c_str(), atom.name.size() + 1);
+            writeRaw(stream, float(0.5 * atom.sigma));
+            writeRaw(stream, atom.charge);
+        }
+        header_written = true;
+    }
+    writeRaw(stream, uint32_t(buffer.size() / record_size));
+    stream.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+    if (not stream)
+        throw std::runtime_error("error writing qr trajectory");
+    buffer.clear();
+    num_particles = 0;
+}
+
+void QRTrajectoryWriter::flush() { stream.flush(); }
+
+QRTrajectoryReader::QRTrajectoryReader(const std::string &filename) {
+    stream.open(filename, std::ios::binary);
+    if (not stream)
+        throw std::runtime_error("cannot open " + filename);
+    char file_magic[8];
+    uint32_t file_version, flags, num_particles, num_atom_types;
+    readExactly(stream, file_magic, 8);
+    if (std::memcmp(file_magic, magic, 8) != 0)
+        throw std::runtime_error(filename + " is not a qr trajectory");
+    readExactly(stream, &file_version, sizeof(file_version));
+    if (file_version != version)
+        throw std::runtime_error(filename + ": unsupported qr trajectory version");
+    readExactly(stream, &flags, sizeof(flags));
+    readExactly(stream, &precision, sizeof(precision));
+    readExactly(stream, &num_particles, sizeof(num_particles));
+    readExactly(stream, &num_atom_types, sizeof(num_atom_types));
+    atom_types.resize(num_atom_types);
+    for (auto &atom_type : atom_types) {
+        if (not std::getline(stream, atom_type.name, '\0'))
+            throw std::runtime_error("unexpected end of file");
+        readExactly(stream, &atom_type.radius, sizeof(atom_type.radius));
+        readExactly(stream, &atom_type.charge, sizeof(atom_type.charge));
+    }
+    ids.assign(num_particles, inactive);
+    charges.assign(num_particles, 0);
+}
+
+bool QRTrajectoryReader::read() {
+    uint32_t num_records;
+    if (not stream.read(reinterpret_cast<char *>(&num_records), sizeof(num_records)))
+        return false;
+    buffer.resize(size_t(num_records) * record_size);
+    readExactly(stream, buffer.data(), buffer.size());
+    size_t pos = 0;
+    for (uint32_t k = 0; k < num_records; k++) {
+        auto index = getRaw<uint32_t>(buffer, pos);
+        auto id = getRaw<uint16_t>(buffer, pos);
+        auto charge = getRaw<int32_t>(buffer, pos);
+        if (index >= ids.size() or (id != inactive and id >= atom_types.size()))
+            throw std::runtime_error("corrupt qr trajectory frame");
+        ids[index] = id;
+        charges[index] = charge;
+    }
+    return true;
+}
+
+bool QRTrajectoryReader::isActive(size_t i) const { return ids.at(i) != inactive; }
+
+double QRTrajectoryReader::charge(size_t i) const {
+    return isActive(i) ? atom_types[ids[i]].charge + charges[i] / precision : 0.0;
+}
+
+double QRTrajectoryReader::radius(size_t i) const { return isActive(i) ? atom_types[ids[i]].radius : 0.0; }
+
+const std::string &QRTrajectoryReader::name(size_t i) const {
+    if (not isActive(i))
+        throw std::runtime_error("inactive particle has no atom name");
+    return atom_types[ids[i]].name;
+}
+
 } // namespace Faunus
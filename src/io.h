@@ -5,6 +5,10 @@
 #include "spdlog/spdlog.h"
 #include <cereal/archives/binary.hpp>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <range/v3/distance.hpp>
 
 namespace Faunus {
@@ -106,6 +110,7 @@ class FormatPQR {
     static Point load(std::istream &, ParticleVector &, bool);                      //!< Load PQR from stream
     static Point load(const std::string &, ParticleVector &, bool);                 //!< Load PQR from file
     static void loadTrajectory(const std::string &, std::vector<ParticleVector> &); //!< Load trajectory
+    static size_t loadTrajectory(const std::string &, const std::function<void(ParticleVector &)> &); //!< Stream frames
     static bool save(std::ostream &, const ParticleVector &, Point = Point(0, 0, 0), int = 1e9);      //!< Save PQR file
     static bool save(const std::string &, const ParticleVector &, Point = Point(0, 0, 0), int = 1e9); //!< Save PQR file
 };
@@ -182,6 +187,7 @@ class FormatXTC {
     rvec *x_xtc;           //!< vector of particle coordinates
     float time_xtc, prec_xtc = 1000;
     int natoms_xtc, step_xtc;
+    std::vector<float> save_buffer; //!< coordinates (nm) of frame to save
 
   public:
     int getNumAtoms();
@@ -247,7 +253,8 @@ class FormatXTC {
             if (xd == nullptr)
                 xd = xdrfile_open(&file[0], "w");
             if (xd != nullptr) {
-                rvec *x = new rvec[ranges::distance(begin, end)];
+                save_buffer.resize(3 * ranges::distance(begin, end)); // memory is retained between frames
+                auto x = reinterpret_cast<rvec *>(save_buffer.data());
                 size_t N = 0;
                 for (auto j = begin; j != end; ++j) {
                     x[N][0] = j->pos.x() * 0.1 + xdbox[0][0] * 0.5; // AA->nm
@@ -256,7 +263,6 @@ class FormatXTC {
                     N++;
                 }
                 write_xtc(xd, N, step_xtc++, time_xtc++, xdbox, x, prec_xtc);
-                delete[] x;
                 return true;
             }
         }
@@ -276,6 +282,72 @@ class FormatXTC {
     void setLength(const Point &);
 };
 
+/**
+ * @brief Write XTC frames to disk on a background thread
+ *
+ * Positions of selected particles are converted to nanometers and copied into one of a
+ * fixed number of preallocated frame buffers. Compression and disk output
+ * (`write_xtc`) are performed by a separate thread so that the caller only
+ * waits if all buffers are pending. Buffer memory is retained between frames.
+ * Errors from the writer thread are rethrown by the next call to `save()` or `flush()`.
+ */
+class XTCWriter {
+    struct Frame {
+        int step = 0;
+        float time = 0;
+        matrix box;
+        std::vector<float> x; //!< 3N coordinates (nm)
+    };
+    XDRFILE *xd = nullptr;
+    float precision = 1000;
+    int step = 0;
+    std::vector<Frame> frames; //!< ring buffer
+    size_t head = 0;           //!< next frame to fill
+    size_t pending = 0;        //!< frames filled but not yet written
+    bool done = false;
+    std::string error;
+    std::mutex mutex;
+    std::condition_variable produced, consumed;
+    std::thread thread;
+
+    void writeFrames(); //!< Writer thread loop
+    Frame &nextFrame(); //!< Wait for a free frame buffer
+    void push();        //!< Hand filled frame to the writer thread
+
+  public:
+    /**
+     * @param filename Output xtc file (overwritten)
+     * @param capacity Maximum number of frames pending to be written
+     */
+    XTCWriter(const std::string &filename, size_t capacity = 4);
+    ~XTCWriter();
+    XTCWriter(const XTCWriter &) = delete;
+    XTCWriter &operator=(const XTCWriter &) = delete;
+
+    /**
+     * @brief Queue frame for writing
+     * @param box Box side lengths (angstrom)
+     * @param index Index of particles to save
+     * @param particles Particle vector; positions are shifted so that the origin is at the box corner
+     */
+    template <class Tindex, class Tparticles>
+    void save(const Point &box, const Tindex &index, const Tparticles &particles) {
+        Frame &frame = nextFrame();
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                frame.box[i][j] = (i == j) ? 0.1 * box[i] : 0.0; // AA->nm
+        frame.x.resize(3 * index.size());
+        auto x = frame.x.begin();
+        for (auto i : index) {
+            const Point &pos = particles[i].pos;
+            for (int d = 0; d < 3; d++)
+                *x++ = 0.1 * (pos[d] + 0.5 * box[d]); // move inside box and AA->nm
+        }
+        push();
+    }
+    void flush(); //!< Wait until all pending frames are written
+};
+
 std::vector<int> fastaToAtomIds(const std::string &); //!< Convert FASTA sequence to atom id sequence
 
 /**
@@ -309,31 +381,392 @@ std::unique_ptr<std::ostream> makeOutputStream(const std::string &, std::ios_bas
 std::unique_ptr<std::istream> makeInputStream(const std::string &, std::ios_base::openmode);
 
 /**
- * @brief Placeholder for Space Trajectory
+ * @brief Single frame of a space trajectory
+ *
+ * Plain copy of the system state as stored in a `.traj`/`.ztraj` file: box side lengths,
+ * active size, conformation and mass center of each group, as well as id,
+ * charge and position of _all_ particles, including inactive ones. Extended properties
+ * (dipoles etc.) are stored only for particles that have them.
+ * Memory is retained between frames.
+ */
+struct TrajectoryFrame {
+    uint64_t step = 0;                 //!< MC step or frame counter
+    Point box = {0, 0, 0};             //!< Box side lengths
+    std::vector<uint32_t> group_sizes; //!< Active size of each group
+    std::vector<int32_t> confids;      //!< Conformation id of each group
+    std::vector<Point> mass_centers;   //!< Mass center of each group
+    std::vector<int32_t> ids;          //!< Atom id of each particle
+    std::vector<float> charges;        //!< Charge of each particle
+    std::vector<Point> positions;      //!< Position of each particle
+    std::vector<std::pair<uint32_t, Particle::ParticleExtension>> extensions; //!< (particle index, extension)
+
+    template <class Tspace> void copyFrom(const Tspace &spc) {
+        box = spc.geo.getLength();
+        group_sizes.resize(spc.groups.size());
+        confids.resize(spc.groups.size());
+        mass_centers.resize(spc.groups.size());
+        for (size_t i = 0; i < spc.groups.size(); i++) {
+            group_sizes[i] = spc.groups[i].size();
+            confids[i] = spc.groups[i].confid;
+            mass_centers[i] = spc.groups[i].cm;
+        }
+        ids.resize(spc.p.size());
+        charges.resize(spc.p.size());
+        positions.resize(spc.p.size());
+        extensions.clear();
+        for (size_t i = 0; i < spc.p.size(); i++) {
+            ids[i] = spc.p[i].id;
+            charges[i] = spc.p[i].charge;
+            positions[i] = spc.p[i].pos;
+            if (spc.p[i].hasExtension())
+                extensions.emplace_back(uint32_t(i), spc.p[i].getExt());
+        }
+    } //!< Store state of space
+
+    /**
+     * @brief Restore frame into space with identical topology
+     * @param spc Space with the same number of particles and groups as the frame
+     * @param setbox Set box side lengths of the geometry
+     */
+    template <class Tspace> void copyTo(Tspace &spc, bool setbox = true) const {
+        if (spc.p.size() != positions.size() or spc.groups.size() != group_sizes.size())
+            throw std::runtime_error("trajectory frame and space mismatch");
+        if (setbox)
+            spc.geo.setLength(box);
+        for (size_t i = 0; i < spc.p.size(); i++) {
+            spc.p[i].id = ids[i];
+            spc.p[i].charge = charges[i];
+            spc.p[i].pos = positions[i];
+        }
+        for (auto &[i, extension] : extensions)
+            spc.p.at(i).getExt() = extension;
+        for (size_t i = 0; i < spc.groups.size(); i++) {
+            auto &group = spc.groups[i];
+            if (group_sizes[i] > group.capacity())
+                throw std::runtime_error("trajectory frame group size exceeds capacity");
+            group.resize(group_sizes[i]);
+            group.confid = confids[i];
+            group.cm = mass_centers[i];
+        }
+    }
+};
+
+/**
+ * @brief Binary, random-access trajectory of the full space (`.traj`/`.ztraj`)
+ *
+ * File layout (native byte order):
+ *
+ * 1. header: magic, version, flags, precision, and a json string with the topology
+ *    (geometry, atom and molecule names, group capacities);
+ * 2. frames: each stored as an independent block prefixed by its stored and raw size.
+ *    Positions and mass centers are quantized to `1/precision` angstrom and
+ *    delta encoded between consecutive particles as zigzag varints. Particle extensions
+ *    (dipoles etc.) follow as a cereal archive. If compression
+ *    is enabled each block is zlib deflated;
+ * 3. footer: file offset of every frame, the number of frames, and a closing magic.
  *
- * The idea is that the format handles both input and
- * output streams that may of may not be compressed.
+ * The footer is (re)written by `flush()` and overwritten by the next frame so that
+ * the file is valid after each flush; any part of the old footer beyond the new frame
+ * is zeroed. Files without a valid footer, e.g. from an aborted run,
+ * are indexed by scanning the frame blocks.
  */
 class FormatSpaceTrajectory {
+  protected:
+    static constexpr char header_magic[9] = "FAUNTRAJ";
+    static constexpr char footer_magic[9] = "TRAJINDX";
+    static constexpr uint32_t version = 2;
+    enum Flags : uint32_t { COMPRESSED = 1 };
+    double precision = 1000;          //!< Inverse quantization step (1/angstrom)
+    json topology;                    //!< Topology stored in header
+    std::vector<uint64_t> offsets;    //!< File offset of each frame
+    std::vector<unsigned char> block; //!< Raw frame buffer (reused)
+
+    void encode(const TrajectoryFrame &);       //!< Frame --> `block`
+    void decode(TrajectoryFrame &) const;       //!< `block` --> frame
+    static void readBytes(std::istream &, void *, size_t);
+
+  public:
+    static bool useCompression(const std::string &filename); //!< Decide from suffix (.traj/.ztraj)
+    const json &getTopology() const;                         //!< Topology stored in header
+    size_t size() const;                                     //!< Number of frames
+};
+
+/**
+ * @brief Write frames to a space trajectory
+ */
+class SpaceTrajectoryWriter : public FormatSpaceTrajectory {
+    std::ofstream stream;
+    std::vector<unsigned char> compressed; //!< Compression buffer (reused)
+    uint64_t data_end = 0;                 //!< File offset after last frame
+    uint64_t footer_end = 0;               //!< File offset after footer of latest flush
+    bool compression = false;
+
+  public:
+    /**
+     * @param filename Output file; compression is decided from the suffix
+     * @param topology Arbitrary json object stored in the header
+     * @param precision Positions are rounded to `1/precision` angstrom
+     */
+    SpaceTrajectoryWriter(const std::string &filename, const json &topology, double precision = 1000);
+    ~SpaceTrajectoryWriter();
+    void save(const TrajectoryFrame &); //!< Append frame
+    void flush();                       //!< Write frame index and flush stream
+};
+
+/**
+ * @brief Random access to frames of a space trajectory
+ */
+class SpaceTrajectoryReader : public FormatSpaceTrajectory {
+    std::ifstream stream;
+    std::vector<unsigned char> compressed; //!< Compression buffer (reused)
+    uint32_t flags = 0;
+    size_t current = 0;                                    //!< Index of next frame for `loadNextFrame()`
+    void scanFrames(uint64_t first, uint64_t file_size);   //!< Build index by scanning blocks
+    bool validIndex(uint64_t first, uint64_t index_start); //!< Check that `offsets` match the frame blocks
+
+  public:
+    SpaceTrajectoryReader(const std::string &filename);
+    void load(size_t k, TrajectoryFrame &); //!< Load frame `k` (zero-based)
+    bool loadNextFrame(TrajectoryFrame &);  //!< Load next frame; false if no more frames
+};
+
+/**
+ * @brief Binary library of molecular conformations (`.conflib`)
+ *
+ * File layout (native byte order):
+ *
+ * 1. header: magic, version, flags, number of atoms per conformation, number of
+ *    conformations, offset of the first record, and the atom names as
+ *    null-terminated strings;
+ * 2. records: one per conformation, each holding `x y z charge` for all atoms as
+ *    `float` (or `double` if the `DOUBLE` flag is set). Records have a fixed stride and
+ *    start at a 64 byte aligned offset so that conformation `k` can be located directly.
+ *
+ * Atom names, rather than ids, are stored so that libraries are independent of the
+ * order of the atom list.
+ */
+class FormatConformationLibrary {
+  protected:
+    static constexpr char magic[9] = "FAUNCONF";
+    static constexpr uint32_t version = 1;
+    static constexpr uint64_t alignment = 64;
+    enum Flags : uint32_t { DOUBLE = 1 };
+    uint32_t flags = 0;
+    uint64_t num_conformations = 0;
+    uint64_t data_offset = 0;   //!< File offset of first record
+    std::vector<int> ids;       //!< Atom id of each particle in a conformation
+    size_t stride() const;      //!< Record size in bytes
+
+  public:
+    static bool isLibrary(const std::string &filename); //!< True if suffix is `.conflib`
+    size_t size() const;                                //!< Number of conformations
+    const std::vector<int> &atomIds() const;            //!< Atom id of each particle in a conformation
+};
+
+/**
+ * @brief Write conformations to a conformation library
+ *
+ * The first saved conformation defines the atom sequence which must be
+ * matched by all following conformations. The number of conformations is
+ * written to the header when the library is closed.
+ */
+class ConformationLibraryWriter : public FormatConformationLibrary {
+    std::ofstream stream;
+    std::vector<unsigned char> record; //!< Record buffer (reused)
+
+  public:
+    ConformationLibraryWriter(const std::string &filename, bool double_precision = false);
+    ~ConformationLibraryWriter();
+    void save(const ParticleVector &); //!< Append conformation
+    void close();                      //!< Write header and close file
+};
+
+/**
+ * @brief Random access to a conformation library
+ *
+ * Where available, the file is memory mapped and records are decoded directly from
+ * the mapped pages such that only the accessed conformations occupy memory, shared by
+ * all processes and threads reading the same library. Otherwise
+ * records are read on demand from a file stream. Loading is thread safe.
+ */
+class ConformationLibraryReader : public FormatConformationLibrary {
+    const unsigned char *mapped = nullptr;    //!< Memory mapped file; nullptr if not mapped
+    size_t mapped_size = 0;                   //!< Size of mapped region (bytes)
+    mutable std::ifstream stream;             //!< Fallback if mapping is unavailable
+    mutable std::vector<unsigned char> record; //!< Fallback record buffer
+    mutable std::mutex mutex;                 //!< Protects fallback stream and buffer
+
+  public:
+    ConformationLibraryReader(const std::string &filename);
+    ~ConformationLibraryReader();
+    ConformationLibraryReader(const ConformationLibraryReader &) = delete;
+    ConformationLibraryReader &operator=(const ConformationLibraryReader &) = delete;
+    bool isMapped() const; //!< True if the file is memory mapped
+
+    /**
+     * @brief Copy conformation into particle vector
+     * @param k Conformation index (zero-based)
+     * @param particles Destination; resized if needed. Particles with a mismatching
+     *        id are reset from the atom list before positions and charges are set
+     */
+    void load(size_t k, ParticleVector &particles) const;
+};
+
+/**
+ * @brief Buffered writer for time series of typed columns
+ *
+ * Columns are registered with `addColumn()` whereafter rows are given value by value
+ * using `operator<<`. Complete rows are buffered in memory and written by `flush()`,
+ * or when `max_rows` rows are pending. The format is decided from the filename suffix:
+ *
+ * - `.tseries` and `.ztseries` (compressed): chunked, binary columnar format.
+ *   The header contains magic, version, flags, and the name and type of each
+ *   column. Each flush writes a chunk with the number of rows, the raw and stored
+ *   size, followed by the values of each column in turn (native byte order);
+ *   for `.ztseries` the chunk data is zlib compressed.
+ * - `.csv`: comma separated text with column names on the first line;
+ * - anything else: space separated text with a commented header line.
+ */
+class TimeSeriesWriter {
+  public:
+    enum class Type : uint8_t { INT64 = 0, FLOAT32 = 1, FLOAT64 = 2 }; //!< Storage type of a column
+    struct Column {
+        std::string name;
+        Type type = Type::FLOAT64;
+    };
+
   private:
-    std::unique_ptr<cereal::BinaryOutputArchive> output_archive;
-    std::unique_ptr<cereal::BinaryInputArchive> input_archive;
+    static constexpr char magic[9] = "FAUNTSER";
+    static constexpr uint32_t version = 1;
+    enum Flags : uint32_t { COMPRESSED = 1 };
+    std::ofstream stream;
+    std::vector<Column> columns;
+    std::vector<double> row;                         //!< Values of the current, incomplete row
+    std::vector<std::vector<unsigned char>> buffers; //!< Pending binary values; one buffer per column
+    std::vector<unsigned char> block, compressed;    //!< Chunk buffers (reused)
+    std::string text;                                //!< Pending text rows
+    std::string separator = " ";
+    size_t rows = 0;        //!< Number of pending rows
+    size_t max_rows;        //!< Flush when this many rows are pending
+    bool binary = false;
+    bool compression = false;
+    bool header_written = false;
+    void writeHeader();
+    void commitRow(); //!< Move `row` to pending buffers
 
   public:
-    FormatSpaceTrajectory(std::ostream &ostream) {
-        if (ostream)
-            output_archive = std::make_unique<cereal::BinaryOutputArchive>(ostream);
-    }
-    FormatSpaceTrajectory(std::istream &istream) {
-        if (istream)
-            input_archive = std::make_unique<cereal::BinaryInputArchive>(istream);
+    TimeSeriesWriter(const std::string &filename, size_t max_rows = 10000);
+    ~TimeSeriesWriter();
+    TimeSeriesWriter &addColumn(const std::string &name, Type type = Type::FLOAT64); //!< Add column before any values
+    TimeSeriesWriter &operator<<(double value); //!< Next value in current row
+    void flush();                               //!< Write pending rows to disk
+    static bool isBinary(const std::string &filename); //!< True if suffix is `.tseries` or `.ztseries`
+
+    friend class TimeSeriesReader;
+};
+
+/**
+ * @brief Load columns from a binary time series (`.tseries`/`.ztseries`)
+ */
+class TimeSeriesReader {
+    std::vector<TimeSeriesWriter::Column> columns;
+    std::vector<std::vector<double>> data; //!< Values of each column
+
+  public:
+    TimeSeriesReader(const std::string &filename);
+    size_t size() const;                                            //!< Number of rows
+    const std::vector<TimeSeriesWriter::Column> &getColumns() const; //!< Names and types of columns
+    const std::vector<double> &operator[](const std::string &name) const; //!< Values of named column
+};
+
+/**
+ * @brief Binary trajectory of charges and radii (`.qrtraj`)
+ *
+ * Compact alternative to the charge-radius text trajectory. File layout (native byte order):
+ *
+ * 1. header: magic, version, flags, inverse charge quantization step, number of particles,
+ *    and the number of atom types followed by the null-terminated name, radius (`float`) and
+ *    charge (`double`) of each atom type;
+ * 2. frames: number of records followed by the records, each with particle index (`uint32`),
+ *    atom id (`uint16`; `0xffff` for inactive particles), and the deviation of the charge
+ *    from that of the atom type, quantized as `int32`.
+ *
+ * Only particles that changed since the previous frame are recorded; the first frame
+ * records all particles. Radii are therefore looked up from the header, and particle
+ * charges that equal those of the atom type (e.g. after titration) take no space
+ * beyond the atom id.
+ */
+class FormatQRTrajectory {
+  protected:
+    static constexpr char magic[9] = "FAUNQRTJ";
+    static constexpr uint32_t version = 1;
+    static constexpr uint16_t inactive = 0xffff;
+    static constexpr size_t record_size = sizeof(uint32_t) + sizeof(uint16_t) + sizeof(int32_t);
+    double precision = 10000;          //!< Inverse charge quantization step (1/e)
+    std::vector<uint16_t> ids;         //!< Atom id of each particle in current frame
+    std::vector<int32_t> charges;      //!< Quantized charge deviation of each particle in current frame
+
+  public:
+    static bool isBinary(const std::string &filename); //!< True if suffix is `.qrtraj`
+    size_t size() const;                               //!< Number of particles, active and inactive
+};
+
+/**
+ * @brief Write charge-radius frames to a `.qrtraj` file
+ *
+ * The header is written with the first frame which also sets the number of particles.
+ */
+class QRTrajectoryWriter : public FormatQRTrajectory {
+    std::ofstream stream;
+    std::vector<unsigned char> buffer; //!< Frame buffer (reused)
+    size_t num_particles = 0;          //!< Number of particles seen in the current frame
+    bool header_written = false;
+    void add(const Particle *particle); //!< Add next particle to frame; nullptr if inactive
+    void writeFrame();                  //!< Write changes and start new frame
+
+  public:
+    /**
+     * @param filename Output file (overwritten)
+     * @param precision Inverse charge quantization step (1/e)
+     */
+    QRTrajectoryWriter(const std::string &filename, double precision = 10000);
+
+    /**
+     * @brief Write frame with all particles in the given groups
+     *
+     * Particles between `end()` and `trueend()` of each group are inactive.
+     */
+    template <class Tgroups> void save(const Tgroups &groups) {
+        for (const auto &group : groups)
+            for (auto it = group.begin(); it != group.trueend(); ++it)
+                add(it < group.end() ? &(*it) : nullptr);
+        writeFrame();
     }
-    template <class Tspace> void load(Tspace &) {
-      assert(input_archive != nullptr);
-    } //!< Load single frame from stream
-    template <class Tspace> void save(const Tspace &) {
-      assert(output_archive != nullptr);
-    } //!< Save single frame from stream
+    void flush(); //!< Flush file stream
+};
+
+/**
+ * @brief Sequential reader for `.qrtraj` files
+ *
+ * Inactive particles have zero charge and radius, as in the text format.
+ */
+class QRTrajectoryReader : public FormatQRTrajectory {
+    struct AtomType {
+        std::string name;
+        float radius;
+        double charge;
+    };
+    std::ifstream stream;
+    std::vector<AtomType> atom_types;
+    std::vector<unsigned char> buffer; //!< Frame buffer (reused)
+
+  public:
+    QRTrajectoryReader(const std::string &filename);
+    bool read();                       //!< Advance to next frame; false if no more frames
+    bool isActive(size_t i) const;     //!< True if particle is active in current frame
+    double charge(size_t i) const;     //!< Charge of particle in current frame (e)
+    double radius(size_t i) const;     //!< Radius of particle in current frame (Å)
+    const std::string &name(size_t i) const; //!< Atom name of active particle in current frame
 };
 
 } // namespace Faunus
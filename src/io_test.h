@@ -50,5 +50,199 @@ TEST_CASE("[Faunus] FormatPQR") {
     }
 }
 
+TEST_CASE("[Faunus] SpaceTrajectory") {
+    using doctest::Approx;
+    Space spc;
+    SpaceFactory::makeNaCl(spc, 2, R"( {"type": "cuboid", "length": [20,30,40]} )"_json);
+    const std::string filename = "spacetrajectory_test.ztraj";
+    spc.p[1].getExt().mu = {0, 0, 1};
+    spc.p[1].getExt().mulen = 2.5;
+    {
+        SpaceTrajectoryWriter writer(filename, {{"test", 1}}, 100);
+        TrajectoryFrame frame;
+        for (int k = 0; k < 3; k++) {
+            for (size_t i = 0; i < spc.p.size(); i++)
+                spc.p[i].pos = {double(k), -0.5 * i, 0.123 * i};
+            frame.copyFrom(spc);
+            frame.step = k * 10;
+            writer.save(frame);
+        }
+    } // destructor writes index
+
+    Space spc2;
+    SpaceFactory::makeNaCl(spc2, 2, R"( {"type": "cuboid", "length": [10,10,10]} )"_json);
+    SpaceTrajectoryReader reader(filename);
+    CHECK(reader.size() == 3);
+    CHECK(reader.getTopology().at("test") == 1);
+    TrajectoryFrame frame;
+    reader.load(1, frame);
+    CHECK(frame.step == 10);
+    frame.copyTo(spc2);
+    CHECK(spc2.geo.getLength().z() == Approx(40));
+    CHECK(spc2.p[3].pos.x() == Approx(1));
+    CHECK(spc2.p[3].pos.y() == Approx(-1.5));
+    CHECK(spc2.p[3].pos.z() == Approx(0.37)); // rounded to 0.01
+    CHECK(spc2.p[3].charge == Approx(spc.p[3].charge));
+    CHECK(spc2.p[3].id == spc.p[3].id);
+    CHECK(spc2.p[1].hasExtension());
+    CHECK(spc2.p[1].getExt().mulen == Approx(2.5));
+    CHECK(not spc2.p[0].hasExtension());
+    CHECK(reader.loadNextFrame(frame));
+    CHECK(frame.step == 20);
+    CHECK(not reader.loadNextFrame(frame));
+    std::remove(filename.c_str());
+}
+
+TEST_CASE("[Faunus] SpaceTrajectory stale index") {
+    Space spc;
+    SpaceFactory::makeNaCl(spc, 2, R"( {"type": "cuboid", "length": [20,30,40]} )"_json);
+    auto write = [&](const std::string &filename, int num_frames) {
+        SpaceTrajectoryWriter writer(filename, json::object());
+        TrajectoryFrame frame;
+        frame.copyFrom(spc);
+        for (int k = 0; k < num_frames; k++)
+            writer.save(frame);
+        writer.flush();
+        std::ifstream f(filename, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(f), {});
+    };
+    auto two = write("stale_test.traj", 2);   // index: 2 x 8 + 16 bytes
+    auto three = write("stale_test.traj", 3); // index: 3 x 8 + 16 bytes
+    {
+        std::ofstream f("stale_test.traj", std::ios::binary | std::ios::trunc);
+        f << two.substr(0, two.size() - 32) << three.substr(three.size() - 40); // frames 1-2 w. index of 3 frames
+    }
+    SpaceTrajectoryReader reader("stale_test.traj");
+    CHECK(reader.size() == 2); // index rejected; frames are scanned
+    std::remove("stale_test.traj");
+}
+
+TEST_CASE("[Faunus] ConformationLibrary") {
+    using doctest::Approx;
+    Space spc;
+    SpaceFactory::makeNaCl(spc, 2, R"( {"type": "cuboid", "length": [20,30,40]} )"_json);
+    const std::string filename = "conformations_test.conflib";
+    CHECK_THROWS(ConformationLibraryWriter("conformations_test.pqr"));
+    {
+        ConformationLibraryWriter writer(filename);
+        for (int k = 0; k < 3; k++) {
+            for (size_t i = 0; i < spc.p.size(); i++)
+                spc.p[i].pos = {double(k), -0.5 * i, 0.123 * i};
+            writer.save(spc.p);
+        }
+        CHECK_THROWS(writer.save(ParticleVector(1, spc.p[0])));
+    } // destructor writes header
+
+    ConformationLibraryReader reader(filename);
+    CHECK(reader.size() == 3);
+    CHECK(reader.atomIds().size() == spc.p.size());
+    ParticleVector particles;
+    reader.load(1, particles);
+    CHECK(particles.size() == spc.p.size());
+    CHECK(particles[3].id == spc.p[3].id);
+    CHECK(particles[3].charge == Approx(spc.p[3].charge));
+    CHECK(particles[3].pos.x() == Approx(1));
+    CHECK(particles[3].pos.z() == Approx(0.369));
+    CHECK_THROWS(reader.load(3, particles));
+    std::remove(filename.c_str());
+}
+
+TEST_CASE("[Faunus] QRTrajectory") {
+    using doctest::Approx;
+    Space spc;
+    SpaceFactory::makeNaCl(spc, 2, R"( {"type": "cuboid", "length": [20,30,40]} )"_json);
+    const std::string filename = "qrtraj_test.qrtraj";
+    CHECK(QRTrajectoryWriter::isBinary(filename));
+    CHECK(not QRTrajectoryWriter::isBinary("qrtraj.dat"));
+    CHECK(not QRTrajectoryWriter::isBinary("qrtraj")); // no suffix
+    auto &group = spc.groups.front();
+    const size_t last = group.size() - 1;
+    {
+        QRTrajectoryWriter writer(filename);
+        writer.save(spc.groups);
+        group.resize(group.size() - 1); // deactivate last particle
+        spc.p[0].charge = 0.5;
+        writer.save(spc.groups);
+    }
+    QRTrajectoryReader reader(filename);
+    CHECK(reader.size() == spc.p.size());
+    CHECK(reader.read());
+    CHECK(reader.isActive(last));
+    CHECK(reader.charge(0) == Approx(atoms[spc.p[0].id].charge));
+    CHECK(reader.radius(0) == Approx(0.5 * atoms[spc.p[0].id].sigma));
+    CHECK(reader.name(0) == atoms[spc.p[0].id].name);
+    CHECK(reader.read());
+    CHECK(not reader.isActive(last));
+    CHECK(reader.charge(last) == 0);
+    CHECK(reader.radius(last) == 0);
+    CHECK(reader.charge(0) == Approx(0.5));
+    CHECK_THROWS(reader.name(last));
+    CHECK(not reader.read());
+    std::remove(filename.c_str());
+}
+
+TEST_CASE("[Faunus] TimeSeries") {
+    using doctest::Approx;
+    const std::string filename = "timeseries_test.ztseries";
+    CHECK(TimeSeriesWriter::isBinary(filename));
+    CHECK(TimeSeriesWriter::isBinary("timeseries.tseries"));
+    CHECK(not TimeSeriesWriter::isBinary("timeseries.dat"));
+    CHECK(not TimeSeriesWriter::isBinary("tseries")); // no suffix
+    CHECK(not TimeSeriesWriter::isBinary("ztseries"));
+    {
+        TimeSeriesWriter writer(filename, 3);
+        writer.addColumn("step", TimeSeriesWriter::Type::INT64).addColumn("energy");
+        for (int i = 0; i < 10; i++)
+            writer << 10 * i << 0.1 * i;
+        CHECK_THROWS(writer.addColumn("too late"));
+    } // destructor flushes
+    TimeSeriesReader reader(filename);
+    CHECK(reader.size() == 10);
+    CHECK(reader.getColumns().size() == 2);
+    CHECK(reader["step"].at(9) == 90);
+    CHECK(reader["energy"].at(3) == Approx(0.3));
+    CHECK_THROWS(reader["missing"]);
+    std::remove(filename.c_str());
+}
+
+TEST_CASE("[Faunus] XTCWriter") {
+    const std::string filename = "xtcwriter_test.xtc";
+    const Point box(20, 30, 40);
+    const std::vector<int> index = {0, 2, 3}; // subset of particles
+    Geometry::Chameleon geo;
+    geo = R"( {"type": "cuboid", "length": [20, 30, 40]} )"_json;
+    Random random;
+    ParticleVector particles(5);
+    std::vector<ParticleVector> saved;
+    {
+        XTCWriter writer(filename, 2);
+        for (int frame = 0; frame < 5; frame++) { // more frames than buffers
+            for (auto &particle : particles) {
+                geo.randompos(particle.pos, random);
+                particle.pos *= 0.9; // well inside box
+            }
+            writer.save(box, index, particles);
+            saved.push_back(particles);
+        }
+    } // destructor writes pending frames and joins the writer thread
+
+    Space spc;
+    spc.geo = geo;
+    spc.p.resize(index.size());
+    FormatXTC xtc(10);
+    REQUIRE(xtc.open(filename));
+    CHECK(xtc.getNumAtoms() == int(index.size()));
+    size_t num_frames = 0;
+    while (xtc.loadNextFrame(spc)) {
+        REQUIRE(num_frames < saved.size());
+        CHECK(spc.geo.getLength().isApprox(box));
+        for (size_t i = 0; i < index.size(); i++) // xtc precision is 0.001 nm
+            CHECK((spc.p[i].pos - saved[num_frames][index[i]].pos).norm() < 0.02);
+        num_frames++;
+    }
+    CHECK(num_frames == saved.size());
+    std::remove(filename.c_str());
+}
+
 #endif
 } // namespace Faunus
@@ -47,6 +47,24 @@ void MoleculeData::loadConformation(const std::string &file, bool keep_positions
         throw std::runtime_error("Structure " + file + " not loaded. Filetype must be .aam/.pqr/.xyz");
 }
 
+size_t MoleculeData::numConformations() const { return library ? library->size() : conformations.size(); }
+
+/**
+ * Conformations in a library are read on demand and are never stored in memory
+ * other than in the given particle vector.
+ */
+size_t MoleculeData::sampleConformation(ParticleVector &particles) {
+    if (library) {
+        size_t index = library_index.get();
+        library->load(index, particles);
+        if (center_library)
+            Geometry::cm2origo(particles.begin(), particles.end());
+        return index;
+    }
+    particles = conformations.get(); // get random, weighted conformation
+    return conformations.getLastIndex();
+}
+
 void MoleculeData::setInserter(std::shared_ptr<MoleculeInserter> ins) { inserter = ins; }
 
 MoleculeData::MoleculeData() { setInserter(std::make_shared<RandomInserter>()); }
@@ -80,45 +98,63 @@ void MoleculeData::createMolecularConformations(const json &j) {
     assert(j.is_object());
 
     if (auto trajfile = j.value("traj", ""s); not trajfile.empty()) {
-        conformations.clear();                                  // remove all previous conformations
-        FormatPQR::loadTrajectory(trajfile, conformations.vec); // read traj. from disk
-        if (not conformations.empty()) {
-            faunus_logger->debug("{} conformations loaded from {}", conformations.size(), trajfile);
-
-            // create atom list
-            atoms.clear();
-            atoms.reserve(conformations.vec.front().size());
-            for (auto &p : conformations.vec.front()) // add atoms to atomlist
-                atoms.push_back(p.id);
-
-            // center mass center for each frame to origo assuming whole molecules
-            if (j.value("trajcenter", false)) {
-                faunus_logger->debug("Centering conformations from {}", trajfile);
-                for (auto &p : conformations.vec) // loop over conformations
-                    Geometry::cm2origo(p.begin(), p.end());
+        conformations.clear(); // remove all previous conformations
+        size_t num_conformations = 0;
+        if (ConformationLibraryReader::isLibrary(trajfile)) {
+            library = std::make_shared<ConformationLibraryReader>(trajfile); // conformations stay on disk
+            num_conformations = library->size();
+            atoms = library->atomIds();
+            library_index.clear();
+            for (size_t k = 0; k < num_conformations; k++)
+                library_index.vec.push_back(k);
+            center_library = j.value("trajcenter", false);
+            faunus_logger->debug("{} conformations in library {} ({})", num_conformations, trajfile,
+                                 library->isMapped() ? "memory mapped" : "streamed");
+        } else {
+            library = nullptr;
+            FormatPQR::loadTrajectory(trajfile, conformations.vec); // read traj. from disk
+            num_conformations = conformations.size();
+            if (not conformations.empty()) {
+                faunus_logger->debug("{} conformations loaded from {}", conformations.size(), trajfile);
+
+                // create atom list
+                atoms.clear();
+                atoms.reserve(conformations.vec.front().size());
+                for (auto &p : conformations.vec.front()) // add atoms to atomlist
+                    atoms.push_back(p.id);
+
+                // center mass center for each frame to origo assuming whole molecules
+                if (j.value("trajcenter", false)) {
+                    faunus_logger->debug("Centering conformations from {}", trajfile);
+                    for (auto &p : conformations.vec) // loop over conformations
+                        Geometry::cm2origo(p.begin(), p.end());
+                }
             }
+        }
+        if (num_conformations == 0)
+            throw std::runtime_error(trajfile + " not loaded or empty.");
 
-            std::vector<float> weights(conformations.size(), 1.0); // default uniform weight
+        std::vector<float> weights(num_conformations, 1.0); // default uniform weight
+
+        // look for weight file
+        if (auto weightfile = j.value("trajweight", ""s); not weightfile.empty()) {
+            if (std::ifstream f(weightfile); bool(f)) {
+                weights.clear();
+                weights.reserve(num_conformations);
+                float _val;
+                while (f >> _val)
+                    weights.push_back(_val);
+                if (weights.size() == num_conformations)
+                    faunus_logger->debug("{} weights loaded from {}", num_conformations, weightfile);
+                else
+                    throw std::runtime_error("Number of weights does not match conformations.");
+            } else
+                throw std::runtime_error(weightfile + " not found.");
+        }
+        if (library)
+            library_index.setWeight(weights);
+        else
             conformations.setWeight(weights);
-
-            // look for weight file
-            if (auto weightfile = j.value("trajweight", ""s); not weightfile.empty()) {
-                if (std::ifstream f(weightfile); bool(f)) {
-                    weights.clear();
-                    weights.reserve(conformations.size());
-                    float _val;
-                    while (f >> _val)
-                        weights.push_back(_val);
-                    if (weights.size() == conformations.size()) {
-                        faunus_logger->debug("{} weights loaded from {}", conformations.size(), weightfile);
-                        conformations.setWeight(weights);
-                    } else
-                        throw std::runtime_error("Number of weights does not match conformations.");
-                } else
-                    throw std::runtime_error(weightfile + " not found.");
-            }
-        } else
-            throw std::runtime_error(trajfile + " not loaded or empty.");
     }
 } // done handling conformations
 
@@ -519,8 +555,8 @@ ParticleVector RandomInserter::operator()(Geometry::GeometryBase &geo, const Par
     if (std::fabs(geo.getVolume()) < 1e-20)
         throw std::runtime_error("geometry has zero volume");
 
-    ParticleVector v = mol.conformations.get(); // get random, weighted conformation
-    conformation_ndx = mol.conformations.getLastIndex(); // latest index
+    ParticleVector v;
+    conformation_ndx = mol.sampleConformation(v); // random, weighted conformation
 
     do {
         if (cnt++ > max_trials)
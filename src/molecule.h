@@ -18,6 +18,7 @@ struct GeometryBase;
 }
 
 class MoleculeData;
+class ConformationLibraryReader;
 
 /**
  * @brief Random position and orientation - typical for rigid bodies
@@ -196,6 +197,9 @@ class MoleculeData {
     std::vector<int> atoms;                    //!< Sequence of atoms in molecule (atom id's)
     BasePointerVector<Potential::BondData> bonds;
     WeightedDistribution<ParticleVector, float> conformations; //!< Conformations of molecule
+    std::shared_ptr<ConformationLibraryReader> library;       //!< Conformations read on demand (replaces `conformations`)
+    WeightedDistribution<size_t, float> library_index;        //!< Weighted conformation index into `library`
+    bool center_library = false;                              //!< Move mass center of library conformations to origin
 
     MoleculeData();
     MoleculeData(const std::string &name, ParticleVector particles,
@@ -225,6 +229,15 @@ class MoleculeData {
 
     void loadConformation(const std::string &file, bool keep_positions, bool keep_charges);
 
+    size_t numConformations() const; //!< Number of conformations, either in memory or in `library`
+
+    /**
+     * @brief Copy random, weighted conformation into particle vector
+     * @param particles Destination; memory is retained between calls
+     * @return Index of the conformation
+     */
+    size_t sampleConformation(ParticleVector &particles);
+
     friend class MoleculeBuilder;
     friend void to_json(json &j, const MoleculeData &a);
     friend void from_json(const json &j, MoleculeData &a);
@@ -1,6 +1,16 @@
 #include "montecarlo.h"
 #include "speciation.h"
+#include "analysis.h"
+#include "aux/eigensupport.h"
 #include "spdlog/spdlog.h"
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/memory.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/utility.hpp>
+#include <cereal/types/vector.hpp>
+#include <cstdio>
+#include <sstream>
 
 namespace Faunus {
 
@@ -25,6 +35,9 @@ void MCSimulation::init() {
     state1.pot.init();
     double u1 = state1.pot.energy(c);
     uinit = u1;
+    uinit_terms = state1.pot.latestEnergies();
+    dusum_terms.assign(uinit_terms.size(), 0.0);
+    state1.pot.recomputeRunningEnergies();
 
     state2.sync(state1, c); // copy all information from state1 into state2
     state2.pot.init();
@@ -45,10 +58,35 @@ void MCSimulation::init() {
     }
 }
 
+/**
+ * The energy change of a move from or to an infinite (or NaN) energy, e.g. when leaving
+ * an overlap, cannot be summed. Instead, the initial energies are shifted so that the
+ * current energy, minus the sum of changes, is the initial energy.
+ */
+void MCSimulation::resyncDrift(const std::vector<size_t> &terms) {
+    Change c;
+    c.all = true;
+    double u = state1.pot.energy(c);
+    const auto &u_terms = state1.pot.latestEnergies();
+    uinit = u - dusum;
+    for (auto n : terms)
+        uinit_terms[n] = u_terms[n] - dusum_terms[n];
+}
+
+/**
+ * Also compares the energy of each term with its initial energy plus the changes
+ * from all accepted moves; see `driftTerms()`. These sums are kept apart from the
+ * running energies of the Hamiltonian which may be reset by analysis, e.g. `systemenergy`.
+ */
 double MCSimulation::drift() {
     Change c;
     c.all = true;
     double ufinal = state1.pot.energy(c);
+    const auto &u_terms = state1.pot.latestEnergies();
+    drift_terms.clear();
+    if (uinit_terms.size() == u_terms.size() and dusum_terms.size() == u_terms.size())
+        for (size_t n = 0; n < u_terms.size(); n++)
+            drift_terms.push_back(u_terms[n] - (uinit_terms[n] + dusum_terms[n]));
     double du = ufinal - uinit;
     if (std::isfinite(du)) {
         if (std::fabs(du) < 1e-10)
@@ -62,19 +100,22 @@ double MCSimulation::drift() {
 }
 
 /*
- * We need to construct two identical State objects and to avoid duplicate logs, we
- * temporarily disable the logger for the second object by the arcane _comma operator_
+ * The trial state is a clone of the accepted state so that the space is built only
+ * once. To avoid duplicate logs from the second Hamiltonian, we
+ * temporarily disable the logger by the arcane _comma operator_
  */
-MCSimulation::MCSimulation(const json &j, MPI::MPIController &mpi)
-    : log_level(faunus_logger->level()), state1(j), state2((faunus_logger->set_level(spdlog::level::off), j)),
+MCSimulation::MCSimulation(const json &j, MPI::MPIController &mpi, Space *initial_space)
+    : log_level(faunus_logger->level()), state1(j, initial_space),
+      state2((faunus_logger->set_level(spdlog::level::off), j), &state1.spc),
       moves((faunus_logger->set_level(log_level), j), state2.spc, mpi) {
     init();
 }
 
+const std::vector<double> &MCSimulation::driftTerms() const { return drift_terms; }
+
 void MCSimulation::restore(const json &j) {
     try {
-        state1.spc = j; // old/accepted state
-        state2.spc = j; // trial state
+        from_json(j, state1.spc); // old/accepted state; copied to the trial state by `init()`
         if (j.count("random-move") == 1)
             Move::Movebase::slump = j["random-move"]; // restore move random number generator
         if (j.count("random-global") == 1)
@@ -129,12 +170,29 @@ void MCSimulation::move() {
 
                 double bias = (**mv).bias(change, uold, unew);
                 double ideal = IdealTerm(state2.spc, state1.spc, change);
-                if (std::isnan(du + bias))
+                // an infinite bias decides alone, e.g. replica exchange where partners must agree,
+                // so that an infinite energy change cannot give infinity minus infinity
+                double du_total = std::isinf(bias) ? bias : du + bias + ideal;
+                if (std::isnan(du_total))
                     faunus_logger->error("Infinite du + bias in " + lastMoveName + " move.");
 
-                if (metropolis(du + bias + ideal)) { // accept move
+                if (metropolis(du_total)) { // accept move
+                    const auto &u_new = state2.pot.latestEnergies();
+                    const auto &u_old = state1.pot.latestEnergies();
+                    std::vector<size_t> unsynced_terms; // terms with a non-finite energy change
+                    for (size_t n = 0; n < dusum_terms.size(); n++) {
+                        if (double du_term = u_new[n] - u_old[n]; std::isfinite(du_term))
+                            dusum_terms[n] += du_term;
+                        else
+                            unsynced_terms.push_back(n);
+                    }
+                    state1.pot.updateRunningEnergies(state2.pot);
                     state1.sync(state2, change);
-                    (**mv).accept(change);
+                    (**mv).accept(change, du);
+                    if (not std::isfinite(du) or not unsynced_terms.empty()) {
+                        resyncDrift(unsynced_terms);
+                        du = 0;
+                    }
                 } else { // reject move
                     state2.sync(state1, change);
                     (**mv).reject(change);
@@ -144,6 +202,11 @@ void MCSimulation::move() {
             }
         }
     }
+    const auto &u_terms = state1.pot.runningEnergies();
+    average_terms.resize(u_terms.size());
+    for (size_t n = 0; n < u_terms.size(); n++)
+        if (std::isfinite(u_terms[n]))
+            average_terms[n] += u_terms[n];
 }
 
 void MCSimulation::to_json(json &j) {
@@ -152,9 +215,28 @@ void MCSimulation::to_json(json &j) {
     j["moves"] = moves;
     j["energy"].push_back(state1.pot);
     j["last move"] = lastMoveName;
+    for (size_t n = 0; n < state1.pot.size(); n++) { // per-term breakdown
+        const auto &term_name = state1.pot.vec[n]->name;
+        if (n < average_terms.size() and not average_terms[n].empty())
+            j["energy averages"][term_name] = average_terms[n].avg();
+        if (n < drift_terms.size())
+            j["energy drift"][term_name] = drift_terms[n];
+    }
 }
 
-MCSimulation::State::State(const json &j) : spc(j), pot(spc, j.at("energy")) {}
+namespace {
+Space &initializeSpace(Space &spc, const json &j, Space *other) {
+    if (other) {
+        Change change;
+        change.all = true;
+        spc.sync(*other, change); // deep copy
+    } else
+        from_json(j, spc);
+    return spc;
+}
+} // namespace
+
+MCSimulation::State::State(const json &j, Space *other) : pot(initializeSpace(spc, j, other), j.at("energy")) {}
 
 void MCSimulation::State::sync(MCSimulation::State &other, Change &change) {
     spc.sync(other.spc, change);
@@ -163,6 +245,253 @@ void MCSimulation::State::sync(MCSimulation::State &other, Change &change) {
 
 void to_json(json &j, MCSimulation &mc) { mc.to_json(j); }
 
+namespace {
+constexpr char checkpoint_magic[] = "FAUNUSCP";
+constexpr uint32_t checkpoint_version = 2;
+constexpr char image_magic[] = "FAUNUSIM";
+constexpr uint32_t image_version = 2;
+
+uint64_t fnv1a(const std::string &text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+} // stable across platforms and compilers, unlike `std::hash`
+
+uint64_t fileHash(const std::string &filename) {
+    std::ifstream stream(filename, std::ios::binary);
+    return fnv1a(std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()));
+} // hash of file contents; missing files are treated as empty
+
+/**
+ * External files read while setting up the system: atom lists, molecular
+ * structures and conformations, and positions of inserted molecules.
+ */
+std::vector<std::string> referencedFiles(const json &input) {
+    std::vector<std::string> files;
+    auto add = [&](const json &properties, const std::string &key) {
+        if (properties.is_object())
+            if (auto it = properties.find(key); it != properties.end() and it->is_string())
+                files.push_back(*it);
+    };
+    for (auto &atom : input.value("atomlist", json::array()))
+        if (atom.is_string())
+            files.push_back(atom);
+    for (auto &molecule : input.value("moleculelist", json::array()))
+        for (auto &item : molecule.items()) {
+            add(item.value(), "structure");
+            add(item.value(), "traj");
+        }
+    for (auto &insert : input.value("insertmolecules", json::array()))
+        for (auto &item : insert.items())
+            add(item.value(), "positions");
+    return files;
+}
+
+std::string engineState(const Random &random) {
+    std::ostringstream o;
+    o << random.engine;
+    return o.str();
+}
+
+void setEngineState(Random &random, const std::string &state) {
+    std::istringstream i(state);
+    i >> random.engine;
+}
+} // namespace
+
+/**
+ * The particle vector is stored in full, whereas only the properties of the groups
+ * are stored, as the layout of groups is given by the topology.
+ * Energy terms are stored in a nested archive which is loaded into both the accepted
+ * and the trial Hamiltonian. Caches of energy terms, e.g. Ewald structure
+ * factors, are recalculated by `init()`.
+ */
+void MCSimulation::saveCheckpoint(cereal::BinaryOutputArchive &archive) const {
+    const auto &spc = state1.spc;
+    archive(std::string(checkpoint_magic), checkpoint_version);
+    archive(json(spc.geo).dump(), spc.getImplicitReservoir(), spc.p.size(), spc.p);
+    archive(spc.groups.size());
+    for (const auto &group : spc.groups)
+        archive(group.id, group.confid, group.cm, group.size(), group.capacity());
+    archive(engineState(Move::Movebase::slump), engineState(Faunus::random));
+
+    std::ostringstream pot_stream;
+    {
+        cereal::BinaryOutputArchive pot_archive(pot_stream);
+        state1.pot.saveCheckpoint(pot_archive);
+    }
+    archive(pot_stream.str());
+    moves.saveCheckpoint(archive);
+    archive(uinit, dusum, uavg, average_terms, uinit_terms, dusum_terms);
+}
+
+void MCSimulation::loadCheckpoint(cereal::BinaryInputArchive &archive) {
+    auto &spc = state1.spc;
+    std::string magic, geometry, slump_state, random_state, pot_state;
+    uint32_t version;
+    size_t num_particles, num_groups;
+    archive(magic, version);
+    if (magic != checkpoint_magic or version != checkpoint_version)
+        throw std::runtime_error("unknown checkpoint format");
+    archive(geometry, spc.getImplicitReservoir(), num_particles);
+    if (num_particles != spc.p.size())
+        throw std::runtime_error("checkpoint mismatch: number of particles");
+    archive(spc.p); // same size so group iterators stay valid
+    spc.geo = json::parse(geometry);
+    archive(num_groups);
+    if (num_groups != spc.groups.size())
+        throw std::runtime_error("checkpoint mismatch: number of groups");
+    for (auto &group : spc.groups) {
+        size_t size, capacity;
+        archive(group.id, group.confid, group.cm, size, capacity);
+        if (capacity != group.capacity())
+            throw std::runtime_error("checkpoint mismatch: group capacity");
+        group.resize(size);
+    }
+    archive(slump_state, random_state);
+    setEngineState(Move::Movebase::slump, slump_state);
+    setEngineState(Faunus::random, random_state);
+
+    archive(pot_state);
+    for (auto pot : {&state1.pot, &state2.pot}) {
+        std::istringstream pot_stream(pot_state);
+        cereal::BinaryInputArchive pot_archive(pot_stream);
+        pot->loadCheckpoint(pot_archive);
+    }
+    moves.loadCheckpoint(archive);
+
+    double saved_uinit, saved_dusum;
+    std::vector<double> saved_uinit_terms, saved_dusum_terms;
+    archive(saved_uinit, saved_dusum, uavg, average_terms, saved_uinit_terms, saved_dusum_terms);
+    init(); // copy to trial state and refresh energy caches
+    uinit = saved_uinit;
+    dusum = saved_dusum;
+    uinit_terms = saved_uinit_terms;
+    dusum_terms = saved_dusum_terms;
+}
+
+void saveCheckpoint(const std::string &filename, const MCSimulation &simulation, const LoopPosition &position,
+                    Analysis::CombinedAnalysis &analysis) {
+    const std::string tmpfile = filename + ".tmp";
+    {
+        std::ofstream stream(tmpfile, std::ios::binary);
+        if (not stream)
+            throw std::runtime_error("cannot create checkpoint " + tmpfile);
+        cereal::BinaryOutputArchive archive(stream);
+        simulation.saveCheckpoint(archive);
+        archive(position);
+        analysis.saveCheckpoint(archive);
+        stream.flush();
+        if (not stream)
+            throw std::runtime_error("error writing checkpoint " + tmpfile);
+    }
+    if (std::rename(tmpfile.c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("cannot rename checkpoint to " + filename);
+    faunus_logger->debug("checkpoint saved to {}", filename);
+}
+
+void loadCheckpoint(const std::string &filename, MCSimulation &simulation, LoopPosition &position,
+                    Analysis::CombinedAnalysis &analysis) {
+    std::ifstream stream(filename, std::ios::binary);
+    if (not stream)
+        throw std::runtime_error("cannot open checkpoint " + filename);
+    try {
+        cereal::BinaryInputArchive archive(stream);
+        simulation.loadCheckpoint(archive);
+        archive(position);
+        analysis.loadCheckpoint(archive);
+    } catch (std::exception &e) {
+        throw std::runtime_error(filename + ": " + e.what());
+    }
+    faunus_logger->info("restored checkpoint {}", filename);
+}
+
+/**
+ * Unlike checkpoints, the group layout is stored as the image is loaded
+ * into an empty space. Besides the input text, the contents of referenced
+ * files are hashed to detect if the image is outdated.
+ */
+void saveSystemImage(const std::string &filename, const std::string &source, const json &input, const Space &spc) {
+    const std::string tmpfile = filename + ".tmp";
+    {
+        std::ofstream stream(tmpfile, std::ios::binary);
+        if (not stream)
+            throw std::runtime_error("cannot create system image " + tmpfile);
+        cereal::BinaryOutputArchive archive(stream);
+        std::vector<std::pair<std::string, uint64_t>> files;
+        for (auto &file : referencedFiles(input))
+            files.emplace_back(file, fileHash(file));
+        archive(std::string(image_magic), image_version, fnv1a(source), files, json::to_cbor(input));
+        archive(json(spc.geo).dump(), spc.getImplicitReservoir(), spc.p);
+        archive(spc.groups.size());
+        for (const auto &group : spc.groups)
+            archive(group.id, group.confid, group.cm, group.compressible, group.atomic, group.size(),
+                    group.capacity());
+        stream.flush();
+        if (not stream)
+            throw std::runtime_error("error writing system image " + tmpfile);
+    }
+    if (std::rename(tmpfile.c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("cannot rename system image to " + filename);
+    faunus_logger->info("system image saved to {}", filename);
+}
+
+bool loadSystemImage(const std::string &filename, const std::string &source, json &input, Space &spc) {
+    std::ifstream stream(filename, std::ios::binary);
+    if (not stream)
+        return false;
+    try {
+        cereal::BinaryInputArchive archive(stream);
+        std::string magic, geometry;
+        uint32_t version;
+        uint64_t hash;
+        std::vector<std::pair<std::string, uint64_t>> files;
+        std::vector<std::uint8_t> cbor;
+        archive(magic, version);
+        if (magic != image_magic or version != image_version)
+            throw std::runtime_error("unknown system image format");
+        archive(hash, files);
+        if (hash != fnv1a(source)) {
+            faunus_logger->info("system image {} does not match input; rebuilding", filename);
+            return false;
+        }
+        for (auto &[file, file_hash] : files)
+            if (fileHash(file) != file_hash) {
+                faunus_logger->info("system image {} does not match {}; rebuilding", filename, file);
+                return false;
+            }
+        archive(cbor);
+        input = json::from_cbor(cbor);
+        loadTopology(input);
+        spc.clear();
+        archive(geometry, spc.getImplicitReservoir(), spc.p);
+        spc.geo = json::parse(geometry);
+        size_t num_groups;
+        archive(num_groups);
+        auto begin = spc.p.begin();
+        for (size_t i = 0; i < num_groups; i++) {
+            size_t size, capacity;
+            Space::Tgroup group(begin, begin);
+            archive(group.id, group.confid, group.cm, group.compressible, group.atomic, size, capacity);
+            if (size > capacity or capacity > size_t(spc.p.end() - begin))
+                throw std::runtime_error("group layout mismatch");
+            group.trueend() = begin + capacity;
+            group.resize(size);
+            spc.groups.push_back(group);
+            begin = group.trueend();
+        }
+        if (begin != spc.p.end())
+            throw std::runtime_error("group layout mismatch");
+    } catch (std::exception &e) {
+        throw std::runtime_error(filename + ": " + e.what());
+    }
+    faunus_logger->info("system loaded from image {}", filename);
+    return true;
+}
+
 double IdealTerm(Space &spc_new, Space &spc_old, const Change &change) {
     double NoverO = 0.0;
     if (change.dN) {
@@ -6,6 +6,11 @@
 #include "move.h"
 
 namespace Faunus {
+
+namespace Analysis {
+struct CombinedAnalysis;
+}
+
 class MCSimulation {
   private:
     typedef typename Space::Tpvec Tpvec;
@@ -19,7 +24,7 @@ class MCSimulation {
     struct State {
         Space spc;
         Energy::Hamiltonian pot;
-        State(const json &j);
+        State(const json &j, Space *other = nullptr); //!< Space is cloned from `other` if given; otherwise from json
 
         void sync(State &other, Change &change);
     }; //!< Contains everything to describe a state
@@ -28,8 +33,12 @@ class MCSimulation {
         state2;   // new state (trial)
     double uinit = 0, dusum = 0;
     Average<double> uavg;
+    std::vector<double> uinit_terms, dusum_terms;  //!< Initial energy and sum of accepted changes of each term (kT)
+    std::vector<double> drift_terms;               //!< Absolute drift of each energy term (kT)
+    std::vector<Average<double>> average_terms;    //!< Average energy of each term after each `move()`
 
     void init();
+    void resyncDrift(const std::vector<size_t> &terms); //!< Reset initial energies after a non-finite change
 
   public:
     Move::Propagator moves;
@@ -40,9 +49,17 @@ class MCSimulation {
     const auto &space() const { return state1.spc; }
     const auto &geometry() const { return state1.spc.geo; }
     const auto &particles() const { return state1.spc.p; }
-
-    MCSimulation(const json &, MPI::MPIController &);
+    auto &trialPot() { return state2.pot; }     //!< Trial Hamiltonian; identical to `pot()` between steps
+    auto &trialSpace() { return state2.spc; }   //!< Trial space; identical to `space()` between steps
+
+    /**
+     * @param j Input
+     * @param mpi MPI controller
+     * @param initial_space Space to start from, e.g. from a system image; if `nullptr` built from input
+     */
+    MCSimulation(const json &j, MPI::MPIController &mpi, Space *initial_space = nullptr);
     double drift(); //!< Calculates the relative energy drift from initial configuration
+    const std::vector<double> &driftTerms() const; //!< Absolute drift of each energy term from latest `drift()`
 
     /* currently unused -- see Analysis::SaveState.
                     void store(json &j) const {
@@ -52,12 +69,62 @@ class MCSimulation {
                     } // store system to json object
     */
     void restore(const json &j); //!< restore system from previously store json object
+    void saveCheckpoint(cereal::BinaryOutputArchive &) const; //!< Save state, random engines, moves, and energy terms
+    void loadCheckpoint(cereal::BinaryInputArchive &); //!< Load checkpoint; the topology must match the input
     void move();
     void to_json(json &j);
 };
 
 void to_json(json &j, MCSimulation &mc);
 
+/**
+ * @brief Position in the MC loop from where a restarted simulation continues
+ */
+struct LoopPosition {
+    bool equilibrated = false; //!< True if equilibration (and tuning) is completed
+    int macro = 0;             //!< Number of completed macro steps
+    int micro = 0;             //!< Number of completed micro steps in the current macro step
+    template <class Archive> void serialize(Archive &archive) { archive(equilibrated, macro, micro); }
+};
+
+/**
+ * @brief Save binary checkpoint of simulation, loop position, and analysis
+ *
+ * The checkpoint is written to a temporary file which is then renamed so
+ * that an existing checkpoint is never left incomplete.
+ */
+void saveCheckpoint(const std::string &filename, const MCSimulation &, const LoopPosition &,
+                    Analysis::CombinedAnalysis &);
+
+/**
+ * @brief Restore simulation, loop position, and analysis from binary checkpoint
+ *
+ * Simulation and analysis must be constructed from the same input as when the checkpoint was saved.
+ */
+void loadCheckpoint(const std::string &filename, MCSimulation &, LoopPosition &, Analysis::CombinedAnalysis &);
+
+/**
+ * @brief Save binary system image with parsed input and initial space
+ * @param filename Output file
+ * @param source Raw input text used to detect if the image is outdated
+ * @param input Parsed input; files referenced herein are also used to detect if the image is outdated
+ * @param spc Initial space, e.g. after inserting molecules
+ *
+ * Starting from an image skips parsing of the input and insertion of molecules.
+ * As for checkpoints, the image is written to a temporary file which is then renamed.
+ */
+void saveSystemImage(const std::string &filename, const std::string &source, const json &input, const Space &spc);
+
+/**
+ * @brief Load binary system image
+ * @param filename Image file
+ * @param source Raw input text that must match the text used to create the image
+ * @param input Destination for parsed input
+ * @param spc Destination for initial space; topology is loaded if not already present
+ * @return False if the image does not exist or is outdated, i.e. if input text or referenced files differ
+ */
+bool loadSystemImage(const std::string &filename, const std::string &source, json &input, Space &spc);
+
 /**
  * @brief Ideal energy contribution of a speciation move
  *
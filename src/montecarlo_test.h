@@ -0,0 +1,201 @@
+#include <doctest/doctest.h>
+#include "montecarlo.h"
+#include "analysis.h"
+#include "penalty.h"
+#include <cereal/archives/binary.hpp>
+#include <fstream>
+#include <sstream>
+
+namespace Faunus {
+
+#ifdef DOCTEST_LIBRARY_INCLUDED
+
+TEST_SUITE_BEGIN("MonteCarlo");
+
+/**
+ * Input for a small salt system. The topology is global and loaded only if
+ * empty, so it is cleared here and should be restored by the caller.
+ */
+inline json saltInput() {
+    atoms.clear();
+    molecules.clear();
+    return R"({
+        "temperature": 300,
+        "geometry": {"type": "cuboid", "length": 50},
+        "atomlist": [{"Na": {"q": 1.0, "eps": 0.15, "sigma": 4.0, "dp": 10}},
+                     {"Cl": {"q": -1.0, "eps": 0.20, "sigma": 4.0, "dp": 10}}],
+        "moleculelist": [{"salt": {"atoms": ["Na", "Cl"], "atomic": true}}],
+        "insertmolecules": [{"salt": {"N": 5}}],
+        "energy": [{"nonbonded": {"default": [{"lennardjones": {"mixing": "LB"}},
+                                              {"coulomb": {"type": "plain", "epsr": 80}}]}}],
+        "moves": [{"transrot": {"molecule": "salt"}}],
+        "random": {"seed": "fixed"}
+    })"_json;
+}
+
+TEST_CASE("[Faunus] MCSimulation drift after leaving an overlap") {
+    auto atoms_backup = atoms;
+    auto molecules_backup = molecules;
+    json j = saltInput();
+    MCSimulation sim(j, MPI::mpi);
+
+    json state;
+    to_json(state, sim.space());
+    state["particles"][1]["pos"] = state["particles"][0]["pos"]; // overlap gives non-finite energy
+    sim.restore(state);
+    Change change;
+    change.all = true;
+    REQUIRE(not std::isfinite(sim.pot().energy(change)));
+
+    for (int i = 0; i < 200; i++) // moving either particle out of the overlap is accepted
+        sim.move();
+    REQUIRE(std::isfinite(sim.pot().energy(change)));
+    CHECK(sim.drift() == doctest::Approx(0.0));
+    REQUIRE(sim.driftTerms().size() == 1);
+    CHECK(sim.driftTerms().front() == doctest::Approx(0.0));
+
+    json out; // per-term drift in output is a number, not null from NaN
+    sim.to_json(out);
+    REQUIRE(out.at("energy drift").size() == 1);
+    for (auto &item : out["energy drift"].items())
+        CHECK(item.value().is_number());
+
+    atoms = atoms_backup;
+    molecules = molecules_backup;
+}
+
+/** Binary checkpoint of an object as a string, used for comparison */
+template <class T> std::string checkpointBytes(const T &object) {
+    std::ostringstream stream;
+    {
+        cereal::BinaryOutputArchive archive(stream);
+        object.saveCheckpoint(archive);
+    }
+    return stream.str();
+}
+
+TEST_CASE("[Faunus] Checkpoint round trip") {
+    auto atoms_backup = atoms;
+    auto molecules_backup = molecules;
+    json j = saltInput();
+    j["energy"].push_back(R"({"penalty": {
+        "f0": 0.5, "scale": 0.9, "update": 10, "overwrite": false,
+        "file": "checkpoint_test_penalty.dat", "histogram": "checkpoint_test_histogram.dat",
+        "coords": [{"atom": {"index": 0, "property": "x", "range": [-25, 25], "resolution": 1}}]}})"_json);
+    const std::string filename = "checkpoint_test.state";
+    {
+        MCSimulation sim1(j, MPI::mpi);
+        Analysis::CombinedAnalysis analysis1(json::array(), sim1.space(), sim1.pot());
+        for (int i = 0; i < 100; i++)
+            sim1.move();
+        LoopPosition position1;
+        position1.equilibrated = true;
+        position1.macro = 2;
+        position1.micro = 7;
+        saveCheckpoint(filename, sim1, position1, analysis1);
+
+        const auto particles = sim1.particles();
+        const auto slump_engine = Move::Movebase::slump.engine;
+        const auto random_engine = Faunus::random.engine;
+        const auto moves = checkpointBytes(sim1.moves);
+        REQUIRE(sim1.pot().find<Energy::Penalty>().size() == 1);
+        const auto penalty = checkpointBytes(*sim1.pot().find<Energy::Penalty>().front());
+
+        for (int i = 0; i < 50; i++) // continuation to compare with
+            sim1.move();
+
+        MCSimulation sim2(j, MPI::mpi); // fresh simulation from the same input
+        Analysis::CombinedAnalysis analysis2(json::array(), sim2.space(), sim2.pot());
+        CHECK(sim2.particles().front().pos != particles.front().pos);
+        LoopPosition position2;
+        loadCheckpoint(filename, sim2, position2, analysis2);
+
+        CHECK(position2.equilibrated == true);
+        CHECK(position2.macro == 2);
+        CHECK(position2.micro == 7);
+        REQUIRE(sim2.particles().size() == particles.size());
+        for (size_t i = 0; i < particles.size(); i++) {
+            CHECK(sim2.particles()[i].id == particles[i].id);
+            CHECK(sim2.particles()[i].pos == particles[i].pos);
+        }
+        CHECK(Move::Movebase::slump.engine == slump_engine);
+        CHECK(Faunus::random.engine == random_engine);
+        CHECK(checkpointBytes(sim2.moves) == moves); // acceptance, step counters, and weights
+        CHECK(checkpointBytes(*sim2.pot().find<Energy::Penalty>().front()) == penalty);
+
+        for (int i = 0; i < 50; i++) // restored simulation continues as the original
+            sim2.move();
+        for (size_t i = 0; i < particles.size(); i++)
+            CHECK(sim2.particles()[i].pos == sim1.particles()[i].pos);
+
+        std::fstream stream(filename, std::ios::binary | std::ios::in | std::ios::out);
+        stream.seekp(sizeof(uint64_t) + 8); // skip length and characters of magic string
+        const uint32_t wrong_version = 1;
+        stream.write(reinterpret_cast<const char *>(&wrong_version), sizeof(wrong_version));
+        stream.close();
+        CHECK_THROWS(loadCheckpoint(filename, sim2, position2, analysis2));
+    }
+    for (std::string file : {filename.c_str(), "checkpoint_test_histogram.dat", "checkpoint_test_penalty.dat"})
+        std::remove(file.c_str());
+    atoms = atoms_backup;
+    molecules = molecules_backup;
+}
+
+TEST_CASE("[Faunus] System image") {
+    auto atoms_backup = atoms;
+    auto molecules_backup = molecules;
+    json j = saltInput();
+    const std::string atomfile = "image_test_atoms.json", filename = "image_test.image";
+    auto writeAtoms = [&](double dp) { // atomlist in external file
+        std::ofstream(atomfile) << json({{"atomlist", {{{"Na", {{"q", 1.0}, {"sigma", 4.0}, {"dp", dp}}}},
+                                                       {{"Cl", {{"q", -1.0}, {"sigma", 4.0}, {"dp", dp}}}}}}});
+    };
+    writeAtoms(10);
+    j["atomlist"] = {atomfile};
+    const std::string source = j.dump();
+
+    Space spc1;
+    from_json(j, spc1);
+    REQUIRE(spc1.groups.size() == 1);
+    spc1.groups[0].resize(8); // deactivate some atoms
+    spc1.groups[0].cm = {1, 2, 3};
+    spc1.getImplicitReservoir()[0] = 4;
+    saveSystemImage(filename, source, j, spc1);
+
+    Space spc2; // empty
+    json input;
+    REQUIRE(loadSystemImage(filename, source, input, spc2));
+    CHECK(input == j);
+    REQUIRE(spc2.p.size() == spc1.p.size());
+    for (size_t i = 0; i < spc1.p.size(); i++) {
+        CHECK(spc2.p[i].id == spc1.p[i].id);
+        CHECK(spc2.p[i].pos == spc1.p[i].pos);
+        CHECK(spc2.p[i].charge == doctest::Approx(spc1.p[i].charge));
+    }
+    REQUIRE(spc2.groups.size() == 1);
+    CHECK(spc2.groups[0].id == spc1.groups[0].id);
+    CHECK(spc2.groups[0].size() == 8);
+    CHECK(spc2.groups[0].capacity() == 10);
+    CHECK(spc2.groups[0].cm == Point(1, 2, 3));
+    CHECK(spc2.groups[0].begin() == spc2.p.begin());
+    CHECK(spc2.geo.getLength() == spc1.geo.getLength());
+    CHECK(spc2.getImplicitReservoir() == spc1.getImplicitReservoir());
+
+    Space spc3;
+    CHECK_FALSE(loadSystemImage("image_test.missing", source, input, spc3));
+    CHECK_FALSE(loadSystemImage(filename, source + " ", input, spc3)); // input text changed
+    writeAtoms(5);
+    CHECK_FALSE(loadSystemImage(filename, source, input, spc3)); // referenced file changed
+    CHECK(spc3.p.empty());
+
+    for (auto &file : {atomfile, filename})
+        std::remove(file.c_str());
+    atoms = atoms_backup;
+    molecules = molecules_backup;
+}
+
+TEST_SUITE_END();
+
+#endif
+
+} // namespace Faunus
@@ -3,14 +3,19 @@
 #include "speciation.h"
 #include "clustermove.h"
 #include "chainmove.h"
+#include "eventchain.h"
+#include "energy.h"
 #include "aux/iteratorsupport.h"
 #include "aux/eigensupport.h"
 #include "spdlog/spdlog.h"
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
 
 namespace Faunus {
 namespace Move {
 
-Random Movebase::slump; // static instance of Random (shared for all moves)
+thread_local Random Movebase::slump; // static instance of Random (shared for all moves in a thread)
 
 void Movebase::from_json(const json &j) {
     auto it = j.find("repeat");
@@ -37,6 +42,9 @@ void Movebase::to_json(json &j) const {
     j["moves"] = cnt;
     if (!cite.empty())
         j["cite"] = cite;
+    for (auto &[key, tuner] : tuners)
+        if (tuner.updates > 0)
+            j["tuned"][json::json_pointer("/" + key)] = tuner.value(); // can be copied to input for subsequent runs
     _roundjson(j, 3);
 }
 
@@ -46,21 +54,104 @@ void Movebase::move(Change &change) {
     cnt++;
     change.clear();
     _move(change);
-    if (change.empty())
+    if (change.empty()) {
         timer.stop();
+        updateTuners();
+    }
     timer_move.stop();
 }
 
-void Movebase::accept(Change &c) {
+void Movebase::accept(Change &c, double du) {
     accepted++;
+    if (std::isfinite(du))
+        du_squared_sum += du * du;
     _accept(c);
     timer.stop();
+    updateTuners();
 }
 
 void Movebase::reject(Change &c) {
     rejected++;
     _reject(c);
     timer.stop();
+    updateTuners();
+}
+
+double Movebase::runtime() const { return timer.seconds(); }
+
+double Movebase::squaredEnergyChange() const { return du_squared_sum; }
+
+/**
+ * Tuned parameters are matched by their json key, and the number of
+ * tunable parameters must be the same as when saved.
+ */
+void Movebase::saveCheckpoint(cereal::BinaryOutputArchive &archive) const {
+    archive(name, cnt, accepted, rejected, du_squared_sum, tuners.size());
+    for (auto &[key, tuner] : tuners)
+        archive(key, const_cast<StepTuner &>(tuner)); // serialize() is non-const
+}
+
+void Movebase::loadCheckpoint(cereal::BinaryInputArchive &archive) {
+    std::string saved_name;
+    size_t num_tuners;
+    archive(saved_name, cnt, accepted, rejected, du_squared_sum, num_tuners);
+    if (saved_name != name or num_tuners != tuners.size())
+        throw std::runtime_error("checkpoint mismatch for move " + name);
+    for (size_t i = 0; i < num_tuners; i++) {
+        std::string key;
+        archive(key);
+        auto it = tuners.find(key);
+        if (it == tuners.end())
+            throw std::runtime_error("checkpoint mismatch for move " + name + ": " + key);
+        archive(it->second);
+    }
+}
+
+StepTuner &Movebase::addTunable(const std::string &key, double &parameter, double maximum) {
+    tuners.erase(key);
+    return tuners.emplace(key, StepTuner(parameter, maximum)).first->second;
+}
+
+void Movebase::tune(bool enable) {
+    tuning = enable and not tuners.empty();
+    tune_cnt = 0;
+    tune_seconds = timer.seconds();
+    for (auto &[key, tuner] : tuners)
+        tuner.reset();
+}
+
+/**
+ * At the end of each block, the tuners are updated one at a time, so that the
+ * efficiency change can be attributed to a single parameter.
+ */
+void Movebase::updateTuners() {
+    if (tuning and ++tune_cnt >= tune_block) {
+        double seconds = timer.seconds();
+        auto it = std::next(tuners.begin(), tune_turn++ % tuners.size());
+        it->second.update(seconds - tune_seconds);
+        for (auto &[key, tuner] : tuners)
+            tuner.reset();
+        tune_cnt = 0;
+        tune_seconds = seconds;
+    }
+}
+
+StepTuner::StepTuner(double &parameter, double maximum) : parameter(parameter), maximum(maximum) {}
+
+void StepTuner::update(double seconds) {
+    if (seconds > 0 and parameter > 0) {
+        double efficiency = sqd_sum / seconds;
+        if (efficiency <= 0) // nothing accepted; take smaller steps
+            direction = -1;
+        else if (efficiency < last_efficiency) {
+            direction = -direction;
+            factor = std::max(min_factor, std::sqrt(factor));
+        }
+        last_efficiency = efficiency;
+        parameter = std::min(maximum, parameter * std::pow(factor, direction));
+        updates++;
+    }
+    reset();
 }
 
 double Movebase::bias(Change &, double, double) {
@@ -83,18 +174,49 @@ void AtomicTranslateRotate::_to_json(json &j) const {
          {"molid", molid},
          {u8::rootof + u8::bracket("r" + u8::squared), std::sqrt(msqd.avg())},
          {"molecule", molname}};
+    for (auto &[id, parameters] : atom_parameters) {
+        j["dp"][atoms.at(id).name] = parameters.dp;
+        j["dprot"][atoms.at(id).name] = parameters.dprot;
+    }
     _roundjson(j, 3);
 }
+
+namespace {
+/**
+ * Displacement parameter for a given atom type, given either as a number
+ * for all atom types, or as an object with atom names as keys.
+ */
+double atomParameter(const json &j, const std::string &key, const AtomData &atom, double fallback) {
+    if (auto it = j.find(key); it != j.end()) {
+        if (it->is_object())
+            return it->value(atom.name, fallback);
+        return it->get<double>();
+    }
+    return fallback;
+}
+} // namespace
+
 void AtomicTranslateRotate::_from_json(const json &j) {
     assert(!molecules.empty());
     try {
-        assertKeys(j, {"molecule", "dir", "repeat"});
+        assertKeys(j, {"molecule", "dir", "repeat", "dp", "dprot"});
         molname = j.at("molecule");
         auto it = findName(molecules, molname);
         if (it == molecules.end())
             throw std::runtime_error("unknown molecule '" + molname + "'");
         molid = it->id();
         dir = j.value("dir", Point(1, 1, 1));
+        atom_parameters.clear();
+        for (int id : it->atoms) { // atomic displacement parameters are tuned per atom type
+            if (atom_parameters.count(id) == 0) {
+                auto &atom = atoms.at(id);
+                auto &parameters = atom_parameters[id]; // map elements are never relocated
+                parameters.dp = atomParameter(j, "dp", atom, atom.dp);
+                parameters.dprot = atomParameter(j, "dprot", atom, atom.dprot);
+                parameters.dp_tuner = &addTunable("dp/" + atom.name, parameters.dp);
+                parameters.dprot_tuner = &addTunable("dprot/" + atom.name, parameters.dprot, 2 * pc::pi);
+            }
+        }
         if (repeat < 0) {
             auto v = spc.findMolecules(molid, Space::ALL);
             repeat = std::distance(v.begin(), v.end()); // repeat for each molecule...
@@ -126,17 +248,24 @@ void AtomicTranslateRotate::translateParticle(Space::Tpvec::iterator p, double d
     }
 }
 void AtomicTranslateRotate::_move(Change &change) {
+    _sqd = 0;
+    _angle = 0;
     auto p = randomAtom();
     if (p not_eq spc.p.end()) {
-        double dp = atoms.at(p->id).dp;
+        double dp = atoms.at(p->id).dp; // atom types not in the molecule (e.g. after a swap) use the topology
         double dprot = atoms.at(p->id).dprot;
+        if (auto it = atom_parameters.find(p->id); it != atom_parameters.end()) {
+            dp = it->second.dp;
+            dprot = it->second.dprot;
+        }
+        _atomid = p->id;
 
         if (dp > 0) // translate
             translateParticle(p, dp);
 
         if (dprot > 0) { // rotate
             Point u = ranunit(slump);
-            double angle = dprot * (slump() - 0.5);
+            double angle = _angle = dprot * (slump() - 0.5);
             Eigen::Quaterniond Q(Eigen::AngleAxisd(angle, u));
             p->rotate(Q, Q.toRotationMatrix());
         }
@@ -145,7 +274,13 @@ void AtomicTranslateRotate::_move(Change &change) {
             change.groups.push_back(cdata); // add to list of moved groups
     }
 }
-void AtomicTranslateRotate::_accept(Change &) { msqd += _sqd; }
+void AtomicTranslateRotate::_accept(Change &) {
+    msqd += _sqd;
+    if (auto it = atom_parameters.find(_atomid); it != atom_parameters.end()) {
+        it->second.dp_tuner->sample(_sqd);
+        it->second.dprot_tuner->sample(_angle * _angle);
+    }
+}
 void AtomicTranslateRotate::_reject(Change &) { msqd += 0; }
 AtomicTranslateRotate::AtomicTranslateRotate(Space &spc) : spc(spc) {
     name = "transrot";
@@ -167,10 +302,7 @@ std::vector<Particle>::iterator AtomicTranslateRotate::randomAtom() {
     }
     return spc.p.end();
 }
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-Propagator::Propagator(const json &j, Space &spc, MPI::MPIController &mpi) {
-#pragma GCC diagnostic pop
+Propagator::Propagator(const json &j, Space &spc, MPI::MPIController &mpi) : mpi(&mpi) {
 
     if (j.count("random") == 1) {
         Movebase::slump = j["random"]; // slump is static --> shared for all moves
@@ -205,12 +337,11 @@ Propagator::Propagator(const json &j, Space &spc, MPI::MPIController &mpi) {
                     _moves.emplace_back<Move::QuadrantJump>(spc);
                 else if (it.key() == "cluster")
                     _moves.emplace_back<Move::Cluster>(spc);
-                    // new moves go here...
-#ifdef ENABLE_MPI
+                else if (it.key() == "eventchain")
+                    _moves.emplace_back<Move::EventChain>(spc);
                 else if (it.key() == "temper")
-                    _moves.emplace_back<Move::ParallelTempering>(spc, mpi);
-                    // new moves requiring MPI go here...
-#endif
+                    _moves.emplace_back<Move::ParallelTempering>(spc, mpi, j);
+                    // new moves go here...
                 if (_moves.size() == oldsize + 1) {
                     _moves.back()->from_json(it.value());
                     addWeight(_moves.back()->repeat);
@@ -229,12 +360,99 @@ void Propagator::addWeight(double weight) {
     _repeat = int(std::accumulate(_weights.begin(), _weights.end(), 0.0));
 }
 
+void Propagator::tune(bool enable, bool adapt_weights) {
+    for (auto &move : _moves)
+        move->tune(enable);
+    if (reweight and not enable)
+        updateWeights(); // final weights are kept for production
+    if (adapt_weights and mpi and mpi->nproc() > 1) {
+        faunus_logger->warn("move reweighting disabled as replicas must stay in sync");
+        adapt_weights = false;
+    }
+    reweight = enable and adapt_weights;
+    if (reweight) {
+        _offsets.clear();
+        for (auto &move : _moves)
+            _offsets.emplace_back(move->runtime(), move->squaredEnergyChange());
+    }
+}
+
+/**
+ * The efficiency of each move is measured as the squared energy change per wall-clock second
+ * since tuning started. This is a unit-less measure of how fast a move decorrelates
+ * the system, and is also available for moves without a spatial displacement.
+ */
+void Propagator::updateWeights() {
+    reweight_cnt = 0;
+    std::vector<double> efficiency;
+    for (size_t i = 0; i < _moves.size(); i++) {
+        double seconds = _moves.at(i)->runtime() - _offsets.at(i).first;
+        double du2 = _moves.at(i)->squaredEnergyChange() - _offsets.at(i).second;
+        efficiency.push_back(seconds > 0 ? du2 / seconds : 0);
+    }
+    if (auto weights = adaptWeights(_weights, efficiency); not weights.empty()) {
+        _adapted_weights = weights;
+        distribution = std::discrete_distribution<>(_adapted_weights.begin(), _adapted_weights.end());
+    }
+}
+
+/**
+ * Each original weight is scaled by the efficiency relative to the geometric mean of all moves
+ * with a positive efficiency, limited to `max_weight_ratio`, so that no move is ever switched off.
+ * The total number of moves per sweep is unchanged.
+ */
+std::vector<double> Propagator::adaptWeights(const std::vector<double> &weights,
+                                             const std::vector<double> &efficiency) {
+    assert(weights.size() == efficiency.size());
+    double log_mean = 0;
+    int num_positive = 0;
+    for (auto value : efficiency)
+        if (value > 0) {
+            log_mean += std::log(value);
+            num_positive++;
+        }
+    if (num_positive == 0)
+        return {};
+    log_mean /= num_positive;
+    std::vector<double> adapted(weights.size());
+    for (size_t i = 0; i < weights.size(); i++) {
+        double ratio = (efficiency[i] > 0) ? std::exp(std::log(efficiency[i]) - log_mean) : 0;
+        adapted[i] = weights[i] * std::clamp(ratio, 1 / max_weight_ratio, max_weight_ratio);
+    }
+    double scale = std::accumulate(weights.begin(), weights.end(), 0.0) /
+                   std::accumulate(adapted.begin(), adapted.end(), 0.0);
+    for (auto &weight : adapted)
+        weight *= scale;
+    return adapted;
+}
+
+void Propagator::saveCheckpoint(cereal::BinaryOutputArchive &archive) const {
+    archive(_moves.size(), _weights, _adapted_weights, reweight_cnt);
+    for (auto &move : _moves)
+        move->saveCheckpoint(archive);
+}
+
+void Propagator::loadCheckpoint(cereal::BinaryInputArchive &archive) {
+    size_t num_moves;
+    archive(num_moves);
+    if (num_moves != _moves.size())
+        throw std::runtime_error("checkpoint mismatch: number of moves");
+    archive(_weights, _adapted_weights, reweight_cnt);
+    if (_adapted_weights.empty())
+        distribution = std::discrete_distribution<>(_weights.begin(), _weights.end());
+    else
+        distribution = std::discrete_distribution<>(_adapted_weights.begin(), _adapted_weights.end());
+    for (auto &move : _moves)
+        move->loadCheckpoint(archive);
+}
+
 void to_json(json &j, const Propagator &propagator) {
     j = propagator._moves;
+    for (size_t i = 0; i < propagator._adapted_weights.size(); i++)
+        for (auto &move : j.at(i)) // j[i] = {name: {...}}
+            move["tuned"]["repeat"] = _round(propagator._adapted_weights[i], 3);
 }
 
-#ifdef ENABLE_MPI
-
 void ParallelTempering::findPartner() {
     int dr = 0;
     partner = mpi.rank();
@@ -250,59 +468,181 @@ bool ParallelTempering::goodPartner() {
     return false;
 }
 void ParallelTempering::_to_json(json &j) const {
-    j = {{"replicas", mpi.nproc()}, {"datasize", pt.getFormat()}};
+    j = {{"replicas", mpi.nproc()},
+         {"walker", int(walker.id)},
+         {"method", method == Method::CROSSENERGY ? "crossenergy" : "coordinates"}};
+    if (mpi.shared)
+        j["threads"] = true;
+    else
+        j["datasize"] = format;
     json &_j = j["exchange"];
     _j = json::object();
     for (auto &m : accmap)
         _j[m.first] = {{"attempts", m.second.cnt}, {"acceptance", m.second.avg()}};
+    if (not round_trips.empty()) {
+        json &_j = j["round trips"];
+        for (auto &[id, trip] : round_trips)
+            _j[std::to_string(id)] = {
+                {"count", trip.attempts.cnt}, {"attempts", trip.attempts.avg()}, {"seconds", trip.seconds.avg()}};
+        _roundjson(_j, 3);
+    }
+}
+/**
+ * Sequence numbers must increase for each exchange between two partners. As the
+ * exchange count is the same on all replicas, this is ensured by combining it with
+ * the number of exchanges made during the current attempt.
+ */
+size_t ParallelTempering::nextSequence() {
+    assert(exchange_calls < 4);
+    return 4 * exchange_cnt + exchange_calls++;
+}
+/**
+ * With threads, the partner move is read directly while the partner
+ * waits; each partner copies into its own buffer so that both may afterwards
+ * modify their `Space`.
+ */
+void ParallelTempering::exchangeConfiguration() {
+    send_extra = {spc.geo.getVolume(), walker.id, walker.direction, walker.departure, walker.departure_time};
+    for (auto &g : spc.groups) // store group sizes
+        send_extra.push_back(g.size());
+    partner_particles.resize(spc.p.size()); // no reallocation after first call
+    if (mpi.shared) {
+        mpi.shared->swap(mpi.rank(), partner, nextSequence(), *this, [&](const ParallelTempering &other) {
+            if (other.spc.p.size() != spc.p.size() or other.spc.groups.size() != spc.groups.size())
+                throw std::runtime_error(name + ": replicas must have the same number of particles and groups");
+            std::copy(other.spc.p.begin(), other.spc.p.end(), partner_particles.begin());
+            recv_extra = other.send_extra;
+        });
+        return;
+    }
+#ifdef ENABLE_MPI
+    pt.sendExtra = send_extra;
+    pt.recv(mpi, partner, partner_particles); // receive particles
+    pt.send(mpi, spc.p, partner);             // send everything
+    pt.waitrecv();
+    pt.waitsend();
+    recv_extra = pt.recvExtra;
+    if (recv_extra[VOLUME] < 1e-9 || spc.p.size() != partner_particles.size())
+        MPI_Abort(mpi.comm, 1);
+#endif
+}
+void ParallelTempering::applyConfiguration(Change &change) {
+    change.all = true;
+    double Vnew = recv_extra[VOLUME];
+    if (std::fabs(Vnew - spc.geo.getVolume()) > 1e-9)
+        change.dV = true;
+
+    partner_walker = {recv_extra[WALKER_ID], recv_extra[WALKER_DIRECTION], recv_extra[WALKER_DEPARTURE],
+                      recv_extra[WALKER_DEPARTURE_TIME]};
+
+    std::copy(partner_particles.begin(), partner_particles.end(), spc.p.begin()); // keeps group iterators valid
+    spc.geo.setVolume(Vnew);
+
+    size_t i = GROUP_SIZES;
+    for (auto &g : spc.groups) {
+        // assign correct sizes to the groups
+        g.resize((int)recv_extra[i++]);
+        if (g.atomic == false) {
+            // update mass center of molecular groups
+            g.cm = Geometry::massCenter(g.begin(), g.end(), spc.geo.getBoundaryFunc(), -g.begin()->pos);
+        }
+    }
+}
+std::string ParallelTempering::exchangeString(const std::string &mine) {
+    std::string theirs;
+    if (mpi.shared) {
+        mpi.shared->swap(mpi.rank(), partner, nextSequence(), mine, [&](const std::string &s) { theirs = s; });
+        return theirs;
+    }
+#ifdef ENABLE_MPI
+    int size = mine.size(), partner_size = 0;
+    MPI_Sendrecv(&size, 1, MPI_INT, partner, 0, &partner_size, 1, MPI_INT, partner, 0, mpi.comm, MPI_STATUS_IGNORE);
+    theirs.resize(partner_size);
+    MPI_Sendrecv(mine.data(), size, MPI_CHAR, partner, 0, theirs.data(), partner_size, MPI_CHAR, partner, 0, mpi.comm,
+                 MPI_STATUS_IGNORE);
+#endif
+    return theirs;
+}
+/**
+ * Both Hamiltonians act on the current configuration and are fully evaluated
+ * as if all particles had been updated.
+ * On first contact with a partner, the energy sections and temperatures are exchanged
+ * and the partner Hamiltonian is constructed at the partner's temperature.
+ */
+double ParallelTempering::crossEnergy() {
+    auto &hamiltonian = hamiltonians[partner];
+    if (not hamiltonian) {
+        json partner_json = json::parse(exchangeString(hamiltonian_json.dump()));
+        double temperature = pc::temperature;
+        try {
+            pc::temperature = partner_json.at("temperature").get<double>() * 1.0_K;
+            hamiltonian = std::make_shared<Energy::Hamiltonian>(spc, partner_json.at("energy"));
+        } catch (std::exception &e) {
+            pc::temperature = temperature;
+            throw std::runtime_error(name + ": partner hamiltonian: "s + e.what());
+        }
+        pc::temperature = temperature;
+        hamiltonian->init();
+        if (not own_hamiltonian) {
+            own_hamiltonian = std::make_shared<Energy::Hamiltonian>(spc, hamiltonian_json.at("energy"));
+            own_hamiltonian->init();
+        }
+    }
+    Change change;
+    change.all = true;
+    hamiltonian->key = own_hamiltonian->key = Energy::Energybase::NEW; // update k-space etc. for current config.
+    return hamiltonian->energy(change) - own_hamiltonian->energy(change);
+}
+bool ParallelTempering::decide(double du_total) const {
+    return not std::isnan(du_total) and (du_total <= 0 or exchange_random < std::exp(-du_total));
 }
 void ParallelTempering::_move(Change &change) {
-    double Vold = spc.geo.getVolume();
+    exchange_cnt++;
+    exchange_calls = 0;
     findPartner();
-    Tpvec p; // temperary storage
-    p.resize(spc.p.size());
+    exchange_random = mpi.random(); // drawn by all replicas to keep the generators in sync
     if (goodPartner()) {
-        change.all = true;
-        pt.sendExtra[VOLUME] = Vold;  // copy current volume for sending
-        // store group sizes
-        for (auto &g : spc.groups) {
-    	    pt.sendExtra.push_back((float)g.size());
-        }
-        pt.recv(mpi, partner, p);     // receive particles
-        pt.send(mpi, spc.p, partner); // send everything
-        pt.waitrecv();
-        pt.waitsend();
-
-        double Vnew = pt.recvExtra[VOLUME];
-        if (Vnew < 1e-9 || spc.p.size() != p.size())
-            MPI_Abort(mpi.comm, 1);
-
-        if (std::fabs(Vnew - Vold) > 1e-9)
-            change.dV = true;
-
-        spc.p = p;
-        spc.geo.setVolume(Vnew);
-
-        size_t i = 0;
-        for (auto &g : spc.groups) {
-            // assign correct sizes to the groups
-            g.resize((int)pt.recvExtra[i+1]);
-            if (g.atomic == false) {
-                // update mass center of molecular groups
-                g.cm = Geometry::massCenter(g.begin(), g.end(), spc.geo.getBoundaryFunc(), -g.begin()->pos);
+        if (method == Method::COORDINATES) {
+            exchangeConfiguration();
+            applyConfiguration(change);
+        } else {
+            double du = crossEnergy();
+            exchange_accepted = decide(du + exchangeEnergy(du));
+            accmap[id()] += exchange_accepted ? 1 : 0;
+            if (exchange_accepted) { // only now are configurations sent
+                exchangeConfiguration();
+                applyConfiguration(change);
             }
-            ++i;
         }
     }
 }
 double ParallelTempering::exchangeEnergy(double mydu) {
+    if (mpi.shared) {
+        double du_partner = 0;
+        mpi.shared->swap(mpi.rank(), partner, nextSequence(), mydu, [&](double du) { du_partner = du; });
+        return du_partner;
+    }
+#ifdef ENABLE_MPI
     std::vector<MPI::FloatTransmitter::floatp> duSelf(1), duPartner;
     duSelf[0] = mydu;
     duPartner = ft.swapf(mpi, duSelf, partner);
     return duPartner.at(0); // return partner energy change
+#else
+    return 0;
+#endif
 }
+/**
+ * Both partners evaluate the same total energy change and the same, shared random
+ * number so that the exchange is either accepted or rejected by both. The returned
+ * bias forces the Metropolis criterion to follow this decision.
+ * With `crossenergy`, the decision has already been made and only accepted
+ * exchanges reach this point.
+ */
 double ParallelTempering::bias(Change &, double uold, double unew) {
-    return exchangeEnergy(unew - uold); // Exchange dU with partner (MPI)
+    if (method == Method::CROSSENERGY)
+        return exchange_accepted ? -pc::infty : pc::infty;
+    double du = unew - uold;
+    return decide(du + exchangeEnergy(du)) ? -pc::infty : pc::infty; // Exchange dU with partner (MPI)
 }
 std::string ParallelTempering::id() {
     std::ostringstream o;
@@ -312,22 +652,65 @@ std::string ParallelTempering::id() {
         o << partner << " <-> " << mpi.rank();
     return o.str();
 }
+static double wallTime() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+} //!< Seconds since an arbitrary, but fixed, point in time
+
+/**
+ * A round trip is completed when a walker that has visited the highest replica
+ * arrives at the lowest replica. Times are measured by the lowest replica only.
+ */
+void ParallelTempering::updateWalker() {
+    if (mpi.rank() == 0) {
+        if (walker.direction < 0) {
+            auto &trip = round_trips[int(walker.id)];
+            trip.attempts += exchange_cnt - walker.departure;
+            trip.seconds += wallTime() - walker.departure_time;
+        }
+        walker.direction = 1;
+        walker.departure = exchange_cnt;
+        walker.departure_time = wallTime();
+    } else if (mpi.rank() == mpi.nproc() - 1 and walker.direction > 0)
+        walker.direction = -1;
+}
 void ParallelTempering::_accept(Change &) {
-    if (goodPartner())
-        accmap[id()] += 1;
+    if (goodPartner()) {
+        if (method == Method::COORDINATES)
+            accmap[id()] += 1;
+        walker = partner_walker;
+        updateWalker();
+    }
 }
 void ParallelTempering::_reject(Change &) {
-    if (goodPartner())
+    if (goodPartner() and method == Method::COORDINATES)
         accmap[id()] += 0;
 }
-void ParallelTempering::_from_json(const json &j) { pt.setFormat(j.value("format", std::string("XYZQI"))); }
-ParallelTempering::ParallelTempering(Space &spc, MPI::MPIController &mpi) : spc(spc), mpi(mpi) {
+void ParallelTempering::_from_json(const json &j) {
+    format = j.value("format", format);
+    auto method_name = j.value("method", "coordinates"s);
+    if (method_name == "crossenergy") {
+        method = Method::CROSSENERGY;
+        if (hamiltonian_json.empty())
+            throw std::runtime_error(name + ": 'crossenergy' requires an energy section");
+    } else if (method_name != "coordinates")
+        throw std::runtime_error(name + ": unknown method '" + method_name + "'");
+#ifdef ENABLE_MPI
+    pt.setFormat(format);
+#endif
+}
+/**
+ * @param spc Space to operate on
+ * @param mpi Controller of this replica
+ * @param input Complete input; the energy section is used by the `crossenergy` method
+ */
+ParallelTempering::ParallelTempering(Space &spc, MPI::MPIController &mpi, const json &input) : spc(spc), mpi(mpi) {
+    if (input.count("energy") == 1)
+        hamiltonian_json = {{"temperature", pc::temperature / 1.0_K}, {"energy", input.at("energy")}};
     name = "temper";
     partner = -1;
-    pt.recvExtra.resize(1);
-    pt.sendExtra.resize(1);
+    walker.id = mpi.rank();
+    updateWalker();
 }
-#endif
 
 void VolumeMove::_to_json(json &j) const {
     using namespace u8;
@@ -346,6 +729,7 @@ void VolumeMove::_from_json(const json &j) {
         if (method == methods.end())
             std::runtime_error("unknown volume change method");
         dV = j.at("dV");
+        dV_tuner = &addTunable("dV", dV);
     } catch (std::exception &e) {
         throw std::runtime_error(e.what());
     }
@@ -363,6 +747,7 @@ void VolumeMove::_move(Change &change) {
 }
 void VolumeMove::_accept(Change &) {
     msqd += deltaV * deltaV;
+    dV_tuner->sample(deltaV * deltaV);
     Vavg += spc.geo.getVolume();
 }
 VolumeMove::VolumeMove(Space &spc) : spc(spc) {
@@ -384,6 +769,7 @@ void ChargeMove::_to_json(json &j) const {
 }
 void ChargeMove::_from_json(const json &j) {
     dq = j.at("dq").get<double>();
+    dq_tuner = &addTunable("dq", dq);
     atomIndex = j.at("index").get<int>();
     auto git = spc.findGroupContaining(spc.p[atomIndex]);                    // group containing atomIndex
     cdata.index = std::distance(spc.groups.begin(), git);                    // integer *index* of moved group
@@ -399,7 +785,10 @@ void ChargeMove::_move(Change &change) {
     } else
         deltaq = 0;
 }
-void ChargeMove::_accept(Change &) { msqd += deltaq * deltaq; }
+void ChargeMove::_accept(Change &) {
+    msqd += deltaq * deltaq;
+    dq_tuner->sample(deltaq * deltaq);
+}
 void ChargeMove::_reject(Change &) { msqd += 0; }
 ChargeMove::ChargeMove(Space &spc) : spc(spc) {
     name = "charge";
@@ -787,6 +1176,8 @@ void TranslateRotate::_from_json(const json &j) {
         dprot = j.at("dprot");
         dirrot = j.value("dirrot", Point(0, 0, 0)); // predefined axis of rotation
         dptrans = j.at("dp");
+        dp_tuner = &addTunable("dp", dptrans);
+        dprot_tuner = &addTunable("dprot", dprot, 2 * pc::pi);
         if (repeat < 0) {
             auto v = spc.findMolecules(molid);
             repeat = std::distance(v.begin(), v.end());
@@ -801,6 +1192,7 @@ void TranslateRotate::_move(Change &change) {
     assert(spc.geo.getVolume() > 0);
 
     _sqd = 0;
+    _angle = 0;
 
     // pick random group from the system matching molecule type
     // TODO: This can be slow -- implement look-up-table in Space
@@ -822,7 +1214,7 @@ void TranslateRotate::_move(Change &change) {
                 Point u = ranunit(slump);
                 if (dirrot.count() > 0)
                     u = dirrot;
-                double angle = dprot * (slump() - 0.5);
+                double angle = _angle = dprot * (slump() - 0.5);
                 Eigen::Quaterniond Q(Eigen::AngleAxisd(angle, u));
                 it->rotate(Q, spc.geo.getBoundaryFunc());
             }
@@ -852,6 +1244,11 @@ TranslateRotate::TranslateRotate(Space &spc) : spc(spc) {
     name = "moltransrot";
     repeat = -1; // meaning repeat N times
 }
+void TranslateRotate::_accept(Change &) {
+    msqd += _sqd;
+    dp_tuner->sample(_sqd);
+    dprot_tuner->sample(_angle * _angle);
+}
 
 void SmartTranslateRotate::_to_json(json &j) const {
     j = {{"Number of counts inside geometry", cntInner},
@@ -1075,7 +1472,7 @@ void ConformationSwap::_from_json(const json &j) {
         if (it == molecules.end())
             throw std::runtime_error("unknown molecule '" + molname + "'");
         molid = it->id();
-        if (molecules[molid].conformations.size() < 2)
+        if (molecules[molid].numConformations() < 2)
             throw std::runtime_error("minimum two conformations required");
         if (repeat < 0) {
             auto v = spc.findMolecules(molid);
@@ -1101,7 +1498,7 @@ void ConformationSwap::_move(Change &change) {
             if (p.size() not_eq g->size())
                 throw std::runtime_error(name + ": conformation atom count mismatch");
 
-            newconfid = molecules[molid].conformations.getLastIndex();
+            newconfid = inserter.conformation_ndx;
 
             std::copy(p.begin(), p.end(), g->begin()); // override w. new conformation
 #ifndef NDEBUG
@@ -9,8 +9,60 @@
 
 namespace Faunus {
 
+namespace Energy {
+class Hamiltonian;
+}
+
 namespace Move {
 
+/**
+ * @brief Tunes a displacement parameter to maximise the mean squared displacement per second
+ *
+ * Accepted squared displacements are summed over a block of move attempts and divided by
+ * the wall-clock time spent on the block, including energy evaluations. At the end of each block
+ * the parameter is scaled by `factor` in the current direction. If the efficiency dropped compared
+ * with the previous block, the direction is reversed and the factor is reduced, i.e. a simple
+ * stochastic pattern search. A zero parameter is never changed.
+ */
+class StepTuner {
+  private:
+    double &parameter;            // parameter to tune
+    double maximum;               // upper bound for parameter
+    double factor = 1.5;          // current scaling factor
+    int direction = 1;            // +1 = increase, -1 = decrease
+    double sqd_sum = 0;           // sum of accepted squared displacements in current block
+    double last_efficiency = -1;  // efficiency of previous block (negative if none)
+    static constexpr double min_factor = 1.02;
+
+  public:
+    unsigned int updates = 0; //!< Number of times the parameter has been updated
+    StepTuner(double &parameter, double maximum = pc::infty);
+    void sample(double squared_displacement) { sqd_sum += squared_displacement; } //!< Add accepted displacement
+    void reset() { sqd_sum = 0; }                  //!< Discard samples in current block
+    void update(double seconds);                   //!< End block and adjust parameter
+    double value() const { return parameter; }     //!< Current parameter value
+
+    template <class Archive> void serialize(Archive &archive) {
+        archive(parameter, factor, direction, last_efficiency, updates);
+    } //!< Cereal serialisation of parameter and tuning state
+};
+
+#ifdef DOCTEST_LIBRARY_INCLUDED
+TEST_CASE("[Faunus] StepTuner") {
+    double dp = 0.2, dprot = 0;
+    StepTuner tuner(dp), zero(dprot);
+    for (int i = 0; i < 60; i++) {
+        tuner.sample(dp * dp * std::exp(-dp)); // model efficiency with a maximum at dp=2
+        tuner.update(1.0);
+        zero.update(1.0);
+    }
+    CHECK(dp == doctest::Approx(2.0).epsilon(0.05));
+    CHECK(tuner.updates == 60);
+    CHECK(dprot == 0.0); // zero parameters are never tuned
+    CHECK(zero.updates == 0);
+}
+#endif
+
 class Movebase {
   private:
     virtual void _move(Change &) = 0;                          //!< Perform move and modify change object
@@ -20,13 +72,32 @@ class Movebase {
     virtual void _from_json(const json &) = 0;                 //!< Extra info for report if needed
     TimeRelativeOfTotal<std::chrono::microseconds> timer;      //!< Timer for whole move
     TimeRelativeOfTotal<std::chrono::microseconds> timer_move; //!< Timer for _move() only
+
+    std::map<std::string, StepTuner> tuners; //!< Tunable displacement parameters (by json key)
+    bool tuning = false;                     //!< True if parameters are currently tuned
+    unsigned int tune_block = 100;           //!< Number of attempts per tuning block
+    unsigned int tune_cnt = 0;               //!< Number of attempts in current tuning block
+    size_t tune_turn = 0;                    //!< Tuners are updated in turn
+    double tune_seconds = 0;                 //!< Time stamp for start of tuning block
+    void updateTuners();                     //!< Called after each attempted move
+    double du_squared_sum = 0;               //!< Sum of squared energy changes of accepted moves (kT^2)
+
   protected:
     unsigned long cnt = 0;
     unsigned long accepted = 0;
     unsigned long rejected = 0;
 
+    /**
+     * @brief Register a displacement parameter for tuning during equilibration
+     * @param key Json key of parameter, used for output
+     * @param parameter Reference to parameter; must outlive the move
+     * @param maximum Upper bound for parameter
+     * @return Tuner which should be fed with accepted squared displacements
+     */
+    StepTuner &addTunable(const std::string &key, double &parameter, double maximum = pc::infty);
+
   public:
-    static Random slump; //!< Shared for all moves
+    static thread_local Random slump; //!< Shared for all moves (in the same thread)
     std::string name;    //!< Name of move
     std::string cite;    //!< Reference
     int repeat = 1;      //!< How many times the move should be repeated per sweep
@@ -34,10 +105,16 @@ class Movebase {
     void from_json(const json &);
     void to_json(json &) const; //!< JSON report w. statistics, output etc.
     void move(Change &);        //!< Perform move and modify given change object
-    void accept(Change &);
+    void accept(Change &, double du = 0); //!< Call after acceptance with the accepted energy change
     void reject(Change &);
+    void tune(bool);            //!< Start (equilibration) or stop (production) tuning of displacement parameters
+    double runtime() const;     //!< Wall-clock time spent on move including energy evaluation (s)
+    double squaredEnergyChange() const; //!< Sum of squared energy changes of accepted moves (kT^2)
+    void saveCheckpoint(cereal::BinaryOutputArchive &) const; //!< Save statistics and tuned parameters
+    void loadCheckpoint(cereal::BinaryInputArchive &);        //!< Load statistics and tuned parameters
     virtual double bias(Change &, double,
-                        double); //!< adds extra energy change not captured by the Hamiltonian
+                        double); //!< adds extra energy change not captured by the Hamiltonian; if infinite, the
+                                 //!< move is accepted (-inf) or rejected (+inf) regardless of the energy change
     inline virtual ~Movebase() = default;
 };
 
@@ -80,9 +157,19 @@ class AtomicTranslateRotate : public Movebase {
     Point dir = {1, 1, 1};
     Average<double> msqd; // mean squared displacement
     double _sqd;          // squared displament
+    double _angle = 0;    // rotation angle
+    int _atomid = -1;     // atom id of last moved particle
     std::string molname;  // name of molecule to operate on
     Change::data cdata;
 
+    struct AtomParameters {
+        double dp = 0;                    //!< Translational displacement (angstrom)
+        double dprot = 0;                 //!< Rotational displacement (radians)
+        StepTuner *dp_tuner = nullptr;    //!< Tuner of `dp`
+        StepTuner *dprot_tuner = nullptr; //!< Tuner of `dprot`
+    };                                    //!< Displacement parameters of a single atom type
+    std::map<int, AtomParameters> atom_parameters; // for each atom id; initially copied from `atoms`
+
     void _to_json(json &j) const override;
     void _from_json(const json &j) override; //!< Configure via json object
     std::vector<Particle>::iterator randomAtom();
@@ -99,6 +186,28 @@ class AtomicTranslateRotate : public Movebase {
     AtomicTranslateRotate(Space &spc);
 };
 
+#ifdef DOCTEST_LIBRARY_INCLUDED
+TEST_CASE("[Faunus] AtomicTranslateRotate") {
+    auto atoms_backup = atoms;         // restored below as the
+    auto molecules_backup = molecules; // topology is global
+    Space spc;
+    SpaceFactory::makeNaCl(spc, 2, R"( {"type": "cuboid", "length": [20,20,20]} )"_json);
+    atoms.at(findName(atoms, "Cl")->id()).dp = 0.25;
+
+    AtomicTranslateRotate mv(spc);
+    mv.from_json(R"( {"molecule": "salt", "dp": {"Na": 0.5}, "dprot": 0.1} )"_json);
+    json j = json(mv).at(mv.name);
+    CHECK(j.at("dp").at("Na") == 0.5);
+    CHECK(j.at("dp").at("Cl") == 0.25); // from topology
+    CHECK(j.at("dprot").at("Cl") == 0.1);
+    CHECK(findName(atoms, "Na")->dp == 0.0); // topology is untouched
+    CHECK_THROWS(mv.from_json(R"( {"molecule": "salt", "unknown": 0} )"_json));
+
+    atoms = atoms_backup;
+    molecules = molecules_backup;
+}
+#endif
+
 /**
  * @brief Translate and rotate an atom on a 2D hypersphere-surface
  * @todo under construction
@@ -161,12 +270,14 @@ class TranslateRotate : public Movebase {
     Point dir = {1, 1, 1};
     Point dirrot = {0, 0, 0}; // predefined axis of rotation
     double _sqd;          // squared displacement
+    double _angle = 0;    // rotation angle
     Average<double> msqd; // mean squared displacement
+    StepTuner *dp_tuner = nullptr, *dprot_tuner = nullptr;
 
     void _to_json(json &j) const override;
     void _from_json(const json &j) override; //!< Configure via json object
     void _move(Change &change) override;
-    void _accept(Change &) override { msqd += _sqd; }
+    void _accept(Change &) override;
     void _reject(Change &) override { msqd += 0; }
 
   public:
@@ -300,6 +411,7 @@ class VolumeMove : public Movebase {
     Space &spc;
     Average<double> msqd, Vavg; // mean squared displacement
     double dV = 0, deltaV = 0, Vnew = 0, Vold = 0;
+    StepTuner *dV_tuner = nullptr;
 
     void _to_json(json &j) const override;
     void _from_json(const json &j) override;
@@ -322,6 +434,7 @@ class ChargeMove : public Movebase {
     double dq = 0, deltaq = 0;
     int atomIndex;
     Change::data cdata;
+    StepTuner *dq_tuner = nullptr;
 
     void _to_json(json &j) const override;
     void _from_json(const json &j) override;
@@ -396,9 +509,8 @@ class QuadrantJump : public Movebase {
     QuadrantJump(Space &spc);
 };
 
-#ifdef ENABLE_MPI
 /**
- * @brief Class for parallel tempering (aka replica exchange) using MPI
+ * @brief Class for parallel tempering (aka replica exchange) using MPI or threads
  *
  * Although not completely correct, the recommended way of performing a temper move
  * is to do `N` Monte Carlo passes with regular moves and then do a tempering move.
@@ -406,24 +518,83 @@ class QuadrantJump : public Movebase {
  * the random number generator calls are influenced by the Hamiltonian we could
  * end up in a deadlock.
  *
+ * Since each replica constructs its Hamiltonian from its own input, configurations
+ * rather than Hamiltonians are exchanged. Each configuration carries a _walker_ label
+ * which follows it through the replica ladder and is used to measure round-trip
+ * times from the lowest to the highest replica and back. The acceptance is decided
+ * jointly by both partners using the synchronized `MPIController::random`.
+ *
+ * If the controller has a `MPI::SharedExchange`, replicas are threads in the same
+ * process and data is copied directly from the partner without MPI.
+ *
+ * With the `crossenergy` method, each replica instead evaluates the Hamiltonian of
+ * its partner on its own configuration, `H_j(x_i) - H_i(x_i)`. Only this energy is
+ * exchanged and configurations are transferred only if the exchange is accepted.
+ * Partner Hamiltonians are constructed on first contact from the partner's
+ * `energy` section and temperature.
+ *
  * @date Lund 2012, 2018
  */
 class ParallelTempering : public Movebase {
   private:
     typedef typename Tspace::Tpvec Tpvec;
+    typedef std::shared_ptr<Energy::Hamiltonian> Thamiltonian;
 
     Tspace &spc; // Space to operate on
     MPI::MPIController &mpi;
 
-    int partner;                   //!< Exchange replica (partner)
-    enum extradata { VOLUME = 0 }; //!< Structure of extra data to send
+    enum class Method { COORDINATES, CROSSENERGY };
+    Method method = Method::COORDINATES;
+    json hamiltonian_json;                       //!< Temperature and energy section of this replica
+    Thamiltonian own_hamiltonian;                //!< Copy of own Hamiltonian for cross energies
+    std::map<int, Thamiltonian> hamiltonians;    //!< Partner Hamiltonians (by rank) acting on own Space
+    bool exchange_accepted = false;              //!< Decision of current cross energy exchange
+    int exchange_calls = 0;                      //!< Number of data exchanges in current attempt
+
+    int partner;               //!< Exchange replica (partner)
+    double exchange_random;    //!< Random number for acceptance, shared by all replicas
+    size_t exchange_cnt = 0;   //!< Number of exchange attempts (same on all replicas)
+    Tpvec partner_particles;   //!< Buffer for particles received from partner
+    std::vector<double> send_extra, recv_extra; //!< Extra data to exchange (volume, walker, group sizes)
+
+    enum extradata {
+        VOLUME = 0,
+        WALKER_ID,
+        WALKER_DIRECTION,
+        WALKER_DEPARTURE,
+        WALKER_DEPARTURE_TIME,
+        GROUP_SIZES
+    }; //!< Structure of extra data to send
+
+    struct Walker {
+        double id = 0;             //!< Label of configuration; initially the rank it started on
+        double direction = 0;      //!< +1 if last extremum was lowest replica; -1 if highest; 0 if neither
+        double departure = 0;      //!< Exchange count when walker left the lowest replica
+        double departure_time = 0; //!< Wall time (of lowest replica) when walker left
+    };
+    Walker walker, partner_walker;
+
+    struct RoundTrip {
+        Average<double> attempts, seconds;
+    }; //!< Round-trip times of a walker, lowest -> highest -> lowest replica
+    std::map<int, RoundTrip> round_trips; //!< Round trips by walker label (lowest replica only)
     std::map<std::string, Average<double>> accmap;
 
+#ifdef ENABLE_MPI
     MPI::FloatTransmitter ft;           //!< Class for transmitting floats over MPI
     MPI::ParticleTransmitter<Tpvec> pt; //!< Class for transmitting particles over MPI
-
-    void findPartner(); //!< Find replica to exchange with
-    bool goodPartner(); //!< Is partner valid?
+#endif
+    std::string format = "XYZQI"; //!< Particle properties to exchange (MPI only)
+
+    size_t nextSequence();        //!< Sequence number of next data exchange with partner
+    void exchangeConfiguration(); //!< Fill `partner_particles` and `recv_extra` from partner
+    void applyConfiguration(Change &change); //!< Copy received partner configuration into Space
+    std::string exchangeString(const std::string &); //!< Exchange string with partner
+    double crossEnergy();         //!< Energy change of own configuration in partner Hamiltonian
+    bool decide(double du_total) const; //!< Shared decision to accept an exchange
+    void findPartner();  //!< Find replica to exchange with
+    bool goodPartner();  //!< Is partner valid?
+    void updateWalker(); //!< Update walker direction and round trips after arrival
     void _to_json(json &j) const override;
     void _move(Change &change) override;
     double exchangeEnergy(double mydu); //!< Exchange energy with partner
@@ -434,9 +605,8 @@ class ParallelTempering : public Movebase {
     void _from_json(const json &j) override;
 
   public:
-    ParallelTempering(Tspace &spc, MPI::MPIController &mpi);
+    ParallelTempering(Tspace &spc, MPI::MPIController &mpi, const json &input = json());
 };
-#endif
 
 /**
  * @brief Class storing a list of MC moves with their probability weights and
@@ -450,22 +620,36 @@ class Propagator {
     std::vector<double> _weights;       //!< list of weights for each move
     void addWeight(double weight = 1);
 
+    bool reweight = false;                           //!< Adapt weights to efficiency (equilibration only)
+    unsigned long reweight_cnt = 0;                  //!< Number of sampled moves since last reweighting
+    std::vector<double> _adapted_weights;            //!< Weights after reweighting (empty if never)
+    std::vector<std::pair<double, double>> _offsets; //!< Runtime and energy change of moves when tuning started
+    static constexpr double max_weight_ratio = 10;   //!< Max. scaling of original weights
+    MPI::MPIController *mpi = nullptr;               //!< Controller of replica; used to keep replicas in sync
+    void updateWeights();                            //!< Reweight moves by energy decorrelation per time
+
   public:
     Propagator() = default;
     Propagator(const json &j, Space &spc, MPI::MPIController &mpi);
     auto repeat() const -> decltype(_repeat) { return _repeat; }
+    void tune(bool, bool = false); //!< Start/stop tuning of displacement parameters and, optionally, weights
+    static std::vector<double> adaptWeights(const std::vector<double> &weights,
+                                            const std::vector<double> &efficiency); //!< Weights scaled by efficiency
+    void saveCheckpoint(cereal::BinaryOutputArchive &) const; //!< Save move statistics and weights
+    void loadCheckpoint(cereal::BinaryInputArchive &);        //!< Load move statistics and weights
     auto moves() const -> const decltype(_moves) & { return _moves; };
     auto sample() {
         int d;
         if (!_moves.empty()) {
             assert(_weights.size() == _moves.size());
-#ifdef ENABLE_MPI
-            //!< Avoid parallel processes to get out of sync
+            if (reweight and ++reweight_cnt >= 100 * std::max(1, _repeat)) // every 100 sweeps
+                updateWeights();
+            //!< Avoid parallel processes (or threads) to get out of sync
             //!< Needed for replica exchange or parallel tempering
-            d = distribution(MPI::mpi.random.engine);
-#else
-            d = distribution(Move::Movebase::slump.engine);
-#endif
+            if (mpi and mpi->nproc() > 1)
+                d = distribution(mpi->random.engine);
+            else
+                d = distribution(Move::Movebase::slump.engine);
             return _moves.begin() + d;
         }
         return _moves.end();
@@ -477,6 +661,23 @@ class Propagator {
 
 void to_json(json &j, const Propagator &propagator);
 
+#ifdef DOCTEST_LIBRARY_INCLUDED
+TEST_CASE("[Faunus] Propagator::adaptWeights") {
+    // geometric mean of positive efficiencies is 2; ratios 0.5, 2, and 0 (clamped to 0.1)
+    auto weights = Propagator::adaptWeights({1, 2, 1}, {1, 4, 0});
+    CHECK(weights.size() == 3);
+    CHECK(weights[0] == doctest::Approx(0.5 * 4 / 4.6));
+    CHECK(weights[1] == doctest::Approx(4.0 * 4 / 4.6));
+    CHECK(weights[2] == doctest::Approx(0.1 * 4 / 4.6));
+    CHECK(weights[0] + weights[1] + weights[2] == doctest::Approx(4)); // moves per sweep are unchanged
+
+    weights = Propagator::adaptWeights({1, 1}, {1000, 1}); // ratios to the mean are limited to 10 and 0.1
+    CHECK(weights[0] / weights[1] == doctest::Approx(100));
+
+    CHECK(Propagator::adaptWeights({1, 1}, {0, 0}).empty()); // nothing accepted; keep weights
+}
+#endif
+
 } // namespace Move
 
 
@@ -47,6 +47,20 @@ namespace Faunus {
             return std::cout;
         }
 
+        /**
+         * Used when multiple replicas run as threads within the same process. Each
+         * thread has its own controller with a rank, and a file prefix `mpi%r.`
+         * identical to that used with MPI.
+         */
+        void MPIController::initThread(int rank, std::shared_ptr<SharedExchange> exchange) {
+            assert(exchange and rank < exchange->size());
+            shared = exchange;
+            _rank = rank;
+            _nproc = exchange->size();
+            id = std::to_string(_rank);
+            MPI::prefix = "mpi" + id + ".";
+        }
+
         int MPIController::nproc() const { return _nproc; }
         int MPIController::rank() const { return _rank; }
         int MPIController::rankMaster() const { return _master; }
@@ -68,6 +82,12 @@ namespace Faunus {
             return sum;
         }
 
+        double reduceMin(MPIController &mpi, double local) {
+            double min;
+            MPI_Allreduce(&local,&min,1,MPI_DOUBLE,MPI_MIN,mpi.comm);
+            return min;
+        }
+
         FloatTransmitter::FloatTransmitter() {
             tag=0;
         }
@@ -110,7 +130,7 @@ namespace Faunus {
 #endif
 
         // global instances
-        std::string prefix;
+        thread_local std::string prefix;
         MPIController mpi;
 
     } // namespace
@@ -3,10 +3,14 @@
 #include "core.h"
 
 #include <vector>
+#include <map>
 #include <string>
 #include <fstream>
 #include <iostream>
 #include <cstdio>
+#include <atomic>
+#include <thread>
+#include <memory>
 
 #ifdef ENABLE_MPI
 #include <mpi.h>
@@ -30,7 +34,70 @@ namespace Faunus {
      */
     namespace MPI {
 
-        extern std::string prefix;
+        extern thread_local std::string prefix; //!< File prefix for current replica (thread)
+
+        /**
+         * @brief Pairwise, lock-free exchange of data between replicas running as threads
+         *
+         * Replicas in the same process are identified by a rank and exchange data
+         * with a partner by posting a pointer to their own data and waiting until the
+         * partner has done the same. The partner data is then copied by a user provided
+         * function, after which both wait for each other to have completed the copy so that
+         * the posted data can safely be modified.
+         *
+         * Exchanges are identified by a sequence number that must increase monotonically and be
+         * the same for both partners. Replicas not participating in an exchange need not call
+         * anything. If a replica fails, `abort()` releases all waiting replicas.
+         *
+         *     SharedExchange exchange(2);
+         *     // thread 0:                          // thread 1:
+         *     double mine = 1, theirs;              double mine = 2, theirs;
+         *     exchange.swap(0, 1, 1, mine,          exchange.swap(1, 0, 1, mine,
+         *        [&](auto &x) { theirs = x; });        [&](auto &x) { theirs = x; });
+         */
+        class SharedExchange {
+            struct alignas(64) Slot {
+                std::atomic<size_t> posted{0};   //!< Sequence number of currently posted data
+                std::atomic<size_t> consumed{0}; //!< Sequence number of last copied partner data
+                const void *data = nullptr;      //!< Pointer to posted data
+            };
+            std::unique_ptr<Slot[]> slots;
+            int nreplicas;
+            std::atomic<bool> aborted{false};
+
+            template <typename Tcondition> void waitFor(Tcondition condition) const {
+                while (not condition()) {
+                    if (aborted.load(std::memory_order_relaxed))
+                        throw std::runtime_error("replica exchange aborted");
+                    std::this_thread::yield();
+                }
+            }
+
+          public:
+            explicit SharedExchange(int nreplicas) : slots(new Slot[nreplicas]), nreplicas(nreplicas) {}
+            int size() const { return nreplicas; } //!< Number of replicas
+            void abort() { aborted = true; }       //!< Release all waiting replicas with an exception
+
+            /**
+             * @param rank Rank of calling replica
+             * @param partner Rank of partner replica
+             * @param sequence Exchange number; larger than in any previous call
+             * @param mine Data to be read by partner; must not be modified during the call
+             * @param copy Function called with the partner data of same type as `mine`
+             */
+            template <typename T, typename Tfunction>
+            void swap(int rank, int partner, size_t sequence, const T &mine, Tfunction copy) {
+                assert(rank != partner && rank >= 0 && partner >= 0 && rank < nreplicas && partner < nreplicas);
+                auto &self = slots[rank];
+                auto &other = slots[partner];
+                self.data = &mine;
+                self.posted.store(sequence, std::memory_order_release);
+                waitFor([&] { return other.posted.load(std::memory_order_acquire) >= sequence; });
+                copy(*static_cast<const T *>(other.data));
+                self.consumed.store(sequence, std::memory_order_release);
+                waitFor([&] { return other.consumed.load(std::memory_order_acquire) >= sequence; });
+            }
+        };
 
         /**
          * @brief Main controller for MPI calls
@@ -61,8 +128,10 @@ namespace Faunus {
                 int rankMaster() const; //!< Rank number of the master
                 bool isMaster() const;  //!< Test if current process is master
                 std::ostream& cout();
+                void initThread(int rank, std::shared_ptr<SharedExchange> exchange); //!< Initialize as thread replica
                 Random random;          //!< Random number generator for MPI calls
                 std::string id;         //!< Unique name associated with current rank
+                std::shared_ptr<SharedExchange> shared; //!< Set if replicas run as threads in a single process
 #ifdef ENABLE_MPI
                 MPI_Comm comm=MPI_COMM_WORLD;    //!< Communicator (Default: MPI_COMM_WORLD)
 #endif
@@ -103,6 +172,13 @@ namespace Faunus {
          */
         double reduceDouble(MPIController &mpi, double local);
 
+        /**
+         * @brief Reduced minimum
+         *
+         * Minimum of "local" over all ranks, available on all ranks.
+         */
+        double reduceMin(MPIController &mpi, double local);
+
         /*!
          * \brief Class for transmitting floating point arrays over MPI
          * \note If you change the floatp typedef, remember also to change to change to/from
@@ -126,9 +202,17 @@ namespace Faunus {
         /**
          * @brief Class for sending/receiving particle vectors over MPI.
          *
-         * This will take a particle vector and send selected information though MPI. It is
-         * possible to send only coordinates using the dataformat `XYZ` or, if charges should be
-         * send too, `XYZQ`.
+         * Particle properties are packed into typed, structure-of-array buffers (positions,
+         * charges, integer ids, and optionally extended properties such as dipoles, quadrupoles,
+         * and sphero-cylinders) which are described by a single derived MPI datatype using
+         * absolute addresses. A message is thus sent without any further copying and the
+         * buffers and datatype are reused as long as the number of particles and the amount
+         * of extra data are unchanged. Persistent requests are kept for each partner.
+         *
+         * It is possible to send only coordinates using the dataformat `XYZ` or, if charges should be
+         * sent too, `XYZQ`. `XYZQI` includes particle id and `XYZQIE` extended properties.
+         * Instead of all particles, a subset given by particle index may be transmitted, for
+         * example from a `Change` object; the receiver must then use the same number of index.
          *
          * Besides particle data it is possible to send extra floats by adding
          * these to the `sendExtra` vector; received extras will be stored in `recvExtra`. Before
@@ -138,52 +222,141 @@ namespace Faunus {
          *     int dst_rank = 1;
          *     floatp extra1 = 2.34, extra2 = -1.23
          *     Tpvec myparticles(200); // we have 200 particles
-         *    
+         *
          *     Faunus::MPI::MPIController mpi;
          *     Faunus::MPI::ParticleTransmitter pt;
-         *    
+         *
          *     pt.sendExtra.push_back(extra1);
          *     pt.sendExtra.push_back(extra2);
-         *    
+         *
          *     pt.send(mpi, myparticles, dst_rank);
          *     pt.waitsend();
          *
-         * @date Lund 2012
-         *
+         * @date Lund 2012, Malmo 2020
          */
         template<typename Tpvec>
-            class ParticleTransmitter : public FloatTransmitter {
-                private:
-                    typedef typename Tpvec::value_type particle; 
+            class ParticleTransmitter {
                 public:
-                    enum dataformat {XYZ=3, XYZQ=4, XYZQI=5};
+                    typedef double floatp;
+                    enum dataformat {XYZ=3, XYZQ=4, XYZQI=5, XYZQIE=6};
                     std::vector<floatp> sendExtra;                      //!< Put extra data to send here.
                     std::vector<floatp> recvExtra;                      //!< Received extra data will be stored here
                     ParticleTransmitter();
-                    void send(MPIController&, const Tpvec&, int); //!< Send particle vector to another node 
+                    ~ParticleTransmitter();
+                    ParticleTransmitter(const ParticleTransmitter&) = delete;
+                    ParticleTransmitter& operator=(const ParticleTransmitter&) = delete;
+                    void send(MPIController&, const Tpvec&, int); //!< Send particle vector to another node
                     void recv(MPIController&, int, Tpvec&);       //!< Receive particle vector from another node
+                    void send(MPIController&, const Tpvec&, const std::vector<int>&, int); //!< Send subset
+                    void recv(MPIController&, int, Tpvec&, const std::vector<int>&);       //!< Receive subset
+                    void waitsend();
                     void waitrecv();
                     void setFormat(dataformat);
                     void setFormat(const std::string&);
                     dataformat getFormat() const;
 
                 private:
-                    dataformat format;                             //!< Data format to send/receive - default is XYZQ
-                    std::vector<floatp> sendBuf, recvBuf;
-                    Tpvec *dstPtr;  //!< pointer to receiving particle vector
-                    void pvec2buf(const Tpvec&); //!< Copy source particle vector to send buffer
-                    void buf2pvec(Tpvec&);       //!< Copy receive buffer to target particle vector
+                    static constexpr int tag = 1; //!< Message tag (FloatTransmitter uses 0)
+                    static constexpr int extension_size = 18; //!< flag, mu(3), mulen, Q(9), scdir(3), sclen
+
+                    /** @brief Typed buffers with a derived MPI datatype and persistent requests */
+                    struct Buffer {
+                        std::vector<floatp> positions, charges, extensions, extra;
+                        std::vector<int> ids;
+                        MPI_Datatype type = MPI_DATATYPE_NULL;
+                        std::map<int, MPI_Request> requests; //!< Persistent requests for each partner rank
+                        MPI_Request *active = nullptr;       //!< Currently started request, if any
+                        size_t size = 0;                     //!< Number of particles
+
+                        void reset(); //!< Free datatype and persistent requests
+                        void resize(size_t n, size_t n_extra, dataformat format);
+                        MPI_Datatype datatype(); //!< Create (if needed) and return datatype
+                    };
+
+                    dataformat format;                             //!< Data format to send/receive
+                    Buffer sendBuf, recvBuf;
+                    Tpvec *dstPtr = nullptr;                        //!< pointer to receiving particle vector
+                    const std::vector<int> *dstIndex = nullptr;     //!< index of receiving particles (or all)
+
+                    void pack(const Tpvec&, const std::vector<int>*);   //!< Copy source particles to send buffer
+                    void unpack(Tpvec&, const std::vector<int>*);       //!< Copy receive buffer to target particles
+                    void start(MPIController&, Buffer&, int, bool);     //!< Start persistent send/recv
             };
 
+        template<typename Tpvec>
+            void ParticleTransmitter<Tpvec>::Buffer::reset() {
+                for (auto &[rank, request] : requests)
+                    MPI_Request_free(&request);
+                requests.clear();
+                active = nullptr;
+                if (type != MPI_DATATYPE_NULL)
+                    MPI_Type_free(&type);
+            }
+
+        /**
+         * Memory is only reallocated, and the datatype and requests invalidated, if
+         * any of the dimensions change.
+         */
+        template<typename Tpvec>
+            void ParticleTransmitter<Tpvec>::Buffer::resize(size_t n, size_t n_extra, dataformat format) {
+                size_t n_charges = (format >= XYZQ) ? n : 0;
+                size_t n_ids = (format >= XYZQI) ? n : 0;
+                size_t n_extensions = (format >= XYZQIE) ? extension_size * n : 0;
+                if (n != size or positions.size() != 3 * n or charges.size() != n_charges or ids.size() != n_ids or
+                    extensions.size() != n_extensions or extra.size() != n_extra) {
+                    reset();
+                    size = n;
+                    positions.resize(3 * n);
+                    charges.resize(n_charges);
+                    ids.resize(n_ids);
+                    extensions.resize(n_extensions);
+                    extra.resize(n_extra);
+                }
+            }
+
+        template<typename Tpvec>
+            MPI_Datatype ParticleTransmitter<Tpvec>::Buffer::datatype() {
+                if (type == MPI_DATATYPE_NULL) {
+                    std::vector<int> lengths;
+                    std::vector<MPI_Aint> addresses;
+                    std::vector<MPI_Datatype> types;
+                    auto add = [&](auto &vec, MPI_Datatype t) {
+                        if (not vec.empty()) {
+                            MPI_Aint address;
+                            MPI_Get_address(vec.data(), &address);
+                            lengths.push_back(vec.size());
+                            addresses.push_back(address);
+                            types.push_back(t);
+                        }
+                    };
+                    add(positions, MPI_DOUBLE);
+                    add(charges, MPI_DOUBLE);
+                    add(ids, MPI_INT);
+                    add(extensions, MPI_DOUBLE);
+                    add(extra, MPI_DOUBLE);
+                    MPI_Type_create_struct(lengths.size(), lengths.data(), addresses.data(), types.data(), &type);
+                    MPI_Type_commit(&type);
+                }
+                return type;
+            }
+
         template<typename Tpvec>
             ParticleTransmitter<Tpvec>::ParticleTransmitter() { setFormat(XYZQI); }
 
+        template<typename Tpvec>
+            ParticleTransmitter<Tpvec>::~ParticleTransmitter() {
+                sendBuf.reset();
+                recvBuf.reset();
+            }
+
         template<typename Tpvec>
             void ParticleTransmitter<Tpvec>::setFormat(dataformat d) { format = d; }
 
         template<typename Tpvec>
             void ParticleTransmitter<Tpvec>::setFormat(const std::string &s) {
                 setFormat(XYZQI);
+                if (s=="XYZQIE")
+                    setFormat(XYZQIE);
                 if (s=="XYZQ")
                     setFormat(XYZQ);
                 if (s=="XYZ")
@@ -194,6 +367,25 @@ namespace Faunus {
             typename ParticleTransmitter<Tpvec>::dataformat
             ParticleTransmitter<Tpvec>::getFormat() const { return format; }
 
+        /**
+         * A persistent request is created the first time a buffer is exchanged
+         * with a given rank, and then restarted for subsequent messages.
+         */
+        template<typename Tpvec>
+            void ParticleTransmitter<Tpvec>::start(MPIController &mpi, Buffer &buf, int rank, bool sending) {
+                auto it = buf.requests.find(rank);
+                if (it == buf.requests.end()) {
+                    MPI_Request request;
+                    if (sending)
+                        MPI_Send_init(MPI_BOTTOM, 1, buf.datatype(), rank, tag, mpi.comm, &request);
+                    else
+                        MPI_Recv_init(MPI_BOTTOM, 1, buf.datatype(), rank, tag, mpi.comm, &request);
+                    it = buf.requests.emplace(rank, request).first;
+                }
+                buf.active = &it->second;
+                MPI_Start(buf.active);
+            }
+
         /*!
          * \param mpi MPI controller to use
          * \param src Source particle vector
@@ -202,26 +394,48 @@ namespace Faunus {
         template<typename Tpvec>
             void ParticleTransmitter<Tpvec>::send(MPIController &mpi, const Tpvec &src, int dst) {
                 assert(dst>=0 && dst<mpi.nproc() && "Invalid MPI destination");
-                pvec2buf(src);
-                FloatTransmitter::sendf(mpi, sendBuf, dst);
+                pack(src, nullptr);
+                start(mpi, sendBuf, dst, true);
+            }
+
+        /*!
+         * \param mpi MPI controller to use
+         * \param src Source particle vector
+         * \param index Index of particles in `src` to send
+         * \param dst Destination node
+         */
+        template<typename Tpvec>
+            void ParticleTransmitter<Tpvec>::send(MPIController &mpi, const Tpvec &src, const std::vector<int> &index, int dst) {
+                assert(dst>=0 && dst<mpi.nproc() && "Invalid MPI destination");
+                pack(src, &index);
+                start(mpi, sendBuf, dst, true);
             }
 
         template<typename Tpvec>
-            void ParticleTransmitter<Tpvec>::pvec2buf(const Tpvec &src) {
-                sendBuf.clear();
-                for (auto &p : src) {
-                    sendBuf.push_back(p.pos.x());
-                    sendBuf.push_back(p.pos.y());
-                    sendBuf.push_back(p.pos.z());
-                    if (format==XYZQ)
-                        sendBuf.push_back(p.charge);
-                    if (format==XYZQI) {
-                        sendBuf.push_back(p.charge);
-                        sendBuf.push_back( (floatp)p.id );
+            void ParticleTransmitter<Tpvec>::pack(const Tpvec &src, const std::vector<int> *index) {
+                size_t n = index ? index->size() : src.size();
+                sendBuf.resize(n, sendExtra.size(), format);
+                for (size_t k = 0; k < n; k++) {
+                    const auto &p = src[index ? (*index)[k] : k];
+                    std::copy(p.pos.data(), p.pos.data() + 3, sendBuf.positions.begin() + 3 * k);
+                    if (format >= XYZQ)
+                        sendBuf.charges[k] = p.charge;
+                    if (format >= XYZQI)
+                        sendBuf.ids[k] = p.id;
+                    if (format >= XYZQIE) {
+                        auto ext = sendBuf.extensions.begin() + extension_size * k;
+                        *ext++ = p.hasExtension() ? 1.0 : 0.0;
+                        if (p.hasExtension()) {
+                            auto &e = p.getExt();
+                            ext = std::copy(e.mu.data(), e.mu.data() + 3, ext);
+                            *ext++ = e.mulen;
+                            ext = std::copy(e.Q.data(), e.Q.data() + 9, ext);
+                            ext = std::copy(e.scdir.data(), e.scdir.data() + 3, ext);
+                            *ext = e.sclen;
+                        }
                     }
                 }
-                for (auto i : sendExtra)
-                    sendBuf.push_back(i);
+                std::copy(sendExtra.begin(), sendExtra.end(), sendBuf.extra.begin());
             }
 
         /*!
@@ -233,45 +447,67 @@ namespace Faunus {
             void ParticleTransmitter<Tpvec>::recv(MPIController &mpi, int src, Tpvec &dst) {
                 assert(src>=0 && src<mpi.nproc() && "Invalid MPI source");
                 dstPtr=&dst;   // save a pointer to the destination particle vector
-                if (format==XYZ)
-                    recvBuf.resize( 3*dst.size() );
-                if (format==XYZQ)
-                    recvBuf.resize( 4*dst.size() );
-                if (format==XYZQI)
-                    recvBuf.resize( 5*dst.size() );
-
-                // resize to fit extra data (if any)
+                dstIndex=nullptr;
+                recvExtra.resize( sendExtra.size() ); // resize to fit extra data (if any)
+                recvBuf.resize(dst.size(), recvExtra.size(), format);
+                start(mpi, recvBuf, src, false);
+            }
+
+        /*!
+         * \param mpi MPI controller to use
+         * \param src Source node
+         * \param dst Destination particle vector
+         * \param index Index of particles in `dst` to receive; must be valid until `waitrecv()`
+         */
+        template<typename Tpvec>
+            void ParticleTransmitter<Tpvec>::recv(MPIController &mpi, int src, Tpvec &dst, const std::vector<int> &index) {
+                assert(src>=0 && src<mpi.nproc() && "Invalid MPI source");
+                dstPtr=&dst;
+                dstIndex=&index;
                 recvExtra.resize( sendExtra.size() );
-                recvBuf.resize( recvBuf.size() + recvExtra.size() );
+                recvBuf.resize(index.size(), recvExtra.size(), format);
+                start(mpi, recvBuf, src, false);
+            }
 
-                FloatTransmitter::recvf(mpi, src, recvBuf);
+        template<typename Tpvec>
+            void ParticleTransmitter<Tpvec>::waitsend() {
+                if (sendBuf.active)
+                    MPI_Wait(sendBuf.active, MPI_STATUS_IGNORE);
+                sendBuf.active = nullptr;
             }
 
         template<typename Tpvec>
             void ParticleTransmitter<Tpvec>::waitrecv() {
-                FloatTransmitter::waitrecv();
-                buf2pvec(*dstPtr);
+                if (recvBuf.active) {
+                    MPI_Wait(recvBuf.active, MPI_STATUS_IGNORE);
+                    recvBuf.active = nullptr;
+                    unpack(*dstPtr, dstIndex);
+                }
             }
 
         template<typename Tpvec>
-            void ParticleTransmitter<Tpvec>::buf2pvec(Tpvec &dst) {
-                int i=0;
-                for (auto &p : dst) {
-                    p.pos.x()=recvBuf[i++];
-                    p.pos.y()=recvBuf[i++];
-                    p.pos.z()=recvBuf[i++];
-                    if (format==XYZQ)
-                        p.charge=recvBuf[i++];
-                    if (format==XYZQI) {
-                        p.charge=recvBuf[i++];
-                        p.id=(int)recvBuf[i++];
+            void ParticleTransmitter<Tpvec>::unpack(Tpvec &dst, const std::vector<int> *index) {
+                for (size_t k = 0; k < recvBuf.size; k++) {
+                    auto &p = dst[index ? (*index)[k] : k];
+                    std::copy(recvBuf.positions.begin() + 3 * k, recvBuf.positions.begin() + 3 * k + 3, p.pos.data());
+                    if (format >= XYZQ)
+                        p.charge = recvBuf.charges[k];
+                    if (format >= XYZQI)
+                        p.id = recvBuf.ids[k];
+                    if (format >= XYZQIE) {
+                        auto ext = recvBuf.extensions.begin() + extension_size * k;
+                        if (*ext++ > 0.5) {
+                            auto &e = p.getExt(); // creates extension if needed
+                            std::copy(ext, ext + 3, e.mu.data());
+                            e.mulen = ext[3];
+                            std::copy(ext + 4, ext + 13, e.Q.data());
+                            std::copy(ext + 13, ext + 16, e.scdir.data());
+                            e.sclen = ext[16];
+                        } else
+                            p.ext = nullptr;
                     }
                 }
-                for (auto &x : recvExtra)
-                    x=recvBuf[i++];
-                assert( (size_t)i==recvBuf.size() );
-                if ( (size_t)i!=recvBuf.size() )
-                    std::cerr << "Particle transmitter says: !!!!!!!!!!!" << std::endl;
+                std::copy(recvBuf.extra.begin(), recvBuf.extra.end(), recvExtra.begin());
             }
 
         /*
@@ -308,6 +544,27 @@ namespace Faunus {
             }
 #endif
 
+#ifdef DOCTEST_LIBRARY_INCLUDED
+        TEST_CASE("[Faunus] SharedExchange") {
+            SharedExchange exchange(2);
+            std::vector<double> result(2);
+            auto worker = [&](int rank) {
+                for (size_t sequence = 1; sequence <= 100; sequence++) {
+                    double mine = rank + 10.0 * sequence;
+                    exchange.swap(rank, 1 - rank, sequence, mine, [&](const double &x) { result[rank] = x; });
+                }
+            };
+            std::thread thread(worker, 1);
+            worker(0);
+            thread.join();
+            CHECK(result[0] == doctest::Approx(1001));
+            CHECK(result[1] == doctest::Approx(1000));
+
+            exchange.abort(); // partner never arrives
+            double x = 0;
+            CHECK_THROWS(exchange.swap(0, 1, 101, x, [](const double &) {}));
+        }
+#endif
     } //end of mpi namespace
 }//end of faunus namespace
 
@@ -1,6 +1,8 @@
 #include "penalty.h"
 #include "space.h"
 #include "spdlog/spdlog.h"
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/vector.hpp>
 
 namespace Faunus {
 namespace Energy {
@@ -134,75 +136,245 @@ void Penalty::sync(Energybase *basePtr, Change &) {
     assert(udelta == other->udelta);
 }
 
+void Penalty::saveCheckpoint(cereal::BinaryOutputArchive &archive) const {
+    std::vector<int> histo_data(histo.data(), histo.data() + histo.size());
+    std::vector<double> penalty_data(penalty.data(), penalty.data() + penalty.size());
+    archive(cnt, samplings, nconv, udelta, f0, coord, histo_data, penalty_data);
+}
+
+void Penalty::loadCheckpoint(cereal::BinaryInputArchive &archive) {
+    std::vector<int> histo_data;
+    std::vector<double> penalty_data;
+    archive(cnt, samplings, nconv, udelta, f0, coord, histo_data, penalty_data);
+    if (histo_data.size() != size_t(histo.size()) or penalty_data.size() != size_t(penalty.size()))
+        throw std::runtime_error(name + ": checkpoint mismatch of penalty function size");
+    std::copy(histo_data.begin(), histo_data.end(), histo.data());
+    std::copy(penalty_data.begin(), penalty_data.end(), penalty.data());
+}
+
+Eigen::MatrixXd stitchWindows(const std::vector<Eigen::MatrixXd> &tables, const std::vector<std::pair<int, int>> &rows) {
+    assert(tables.size() == rows.size() and not tables.empty());
+    Eigen::MatrixXd sum = Eigen::MatrixXd::Zero(tables.front().rows(), tables.front().cols());
+    Eigen::VectorXd visits = Eigen::VectorXd::Zero(sum.rows()); // number of windows covering each row
+    for (size_t w = 0; w < tables.size(); w++) {
+        auto [begin, end] = rows[w];
+        double offset = 0;
+        int overlapping = 0;
+        for (int row = begin; row < end; row++)
+            if (visits[row] > 0) {
+                offset += (sum.row(row) / visits[row] - tables[w].row(row)).mean();
+                overlapping++;
+            }
+        if (w > 0 and overlapping == 0)
+            throw std::runtime_error("penalty windows do not overlap");
+        if (overlapping > 0)
+            offset /= overlapping;
+        for (int row = begin; row < end; row++) {
+            sum.row(row).array() += tables[w].row(row).array() + offset;
+            visits[row] += 1;
+        }
+    }
+    for (int row = 0; row < sum.rows(); row++)
+        if (visits[row] > 0)
+            sum.row(row) /= visits[row];
+    return sum.array() - sum.minCoeff();
+}
+
 #ifdef ENABLE_MPI
 
+/**
+ * Window `w` covers an equal share of the rows of the first coordinate,
+ * extended on both sides by half the `overlap`, but by at least one row.
+ */
 PenaltyMPI::PenaltyMPI(const json &j, Space &spc) : Penalty(j, spc) {
-    weights.resize(MPI::mpi.nproc());
-    buffer.resize(penalty.size() * MPI::mpi.nproc()); // recieve buffer for penalty func
+    using namespace Faunus::MPI;
+    windows = j.value("windows", 1);
+    overlap = j.value("overlap", overlap);
+    if (windows < 1 or mpi.nproc() % windows != 0)
+        throw std::runtime_error("number of processes must be divisible by `windows`");
+    if (overlap < 0 or overlap >= 1)
+        throw std::runtime_error("`overlap` must be in the interval [0:1)");
+    int window = mpi.rank() / (mpi.nproc() / windows);
+    double width = double(penalty.rows()) / windows;
+    int extend = (windows > 1) ? std::max(1, int(std::round(0.5 * overlap * width))) : 0;
+    row_begin = std::max(0, int(std::floor(window * width)) - extend);
+    row_end = std::min(int(penalty.rows()), int(std::floor((window + 1) * width)) + extend);
+    if (row_end - row_begin < 2)
+        throw std::runtime_error("too many penalty windows for the given resolution");
+
+    int rows = row_end - row_begin;
+    penalty_delta.setZero(rows, penalty.cols());
+    histo_delta.setZero(rows, penalty.cols());
+    window_histo.setZero(rows, penalty.cols());
+    sendbuf.resize(2 * penalty_delta.size());
+    recvbuf.resize(sendbuf.size());
 }
 
-void PenaltyMPI::update(const std::vector<double> &c) {
-    using namespace Faunus::MPI;
-    double uold = penalty[c];
-    if (++cnt % this->nupdate == 0 and f0 > 0) {
-
-        int min = histo.minCoeff(); // if min>0 --> all RC's visited
-        MPI_Allgather(&min, 1, MPI_INT, weights.data(), 1, MPI_INT, mpi.comm);
-
-        // if at least one walker has sampled full RC space at least `samplings` times
-        if (weights.maxCoeff() > samplings) { // change to minCoeff()?
-            // master collects penalty from all slaves
-            MPI_Gather(penalty.data(), penalty.size(), MPI_DOUBLE, buffer.data(), penalty.size(), MPI_DOUBLE, 0,
-                       mpi.comm);
-
-            // master performs the average
-            if (mpi.isMaster()) {
-                penalty.setZero();
-                for (int i = 0; i < mpi.nproc(); i++)
-                    penalty +=
-                        Eigen::Map<Eigen::MatrixXd>(buffer.data() + i * penalty.size(), penalty.rows(), penalty.cols());
-                penalty = (penalty.array() - penalty.minCoeff()) / double(mpi.nproc());
-            }
+/**
+ * Trial configurations outside the window are rejected unless they are closer to
+ * the window than the accepted configuration, so that a walker starting outside
+ * its window can only approach it. The accepted configuration itself always has
+ * a finite energy to avoid an undefined energy change (infinity minus infinity).
+ */
+double PenaltyMPI::energy(Change &change) {
+    double previous_row = coord.empty() ? 0 : coord[0]; // accepted coordinate, set by `sync()`
+    double u = Penalty::energy(change);
+    if (change and key == NEW and windowDistance(coord[0]) > 0 and
+        windowDistance(coord[0]) > windowDistance(previous_row))
+        return pc::infty; // moving away from window
+    return u;
+}
 
-            // master sends the averaged penalty function to all slaves
-            MPI_Bcast(penalty.data(), penalty.size(), MPI_DOUBLE, 0, mpi.comm);
-            nconv += 1;
-
-            // at this point, *all* penalty functions shall be identical
-
-            /* save penalty function to disk
-            if (mpi.isMaster()) {
-                std::ofstream f(file + ".walkersync" + std::to_string(nconv));
-                if (f) {
-                    f.precision(16);
-                    f << "# " << f0 << " " << samplings << " " << nconv << "\n" << penalty.array() << endl;
-                }
-            }*/
-
-            /* save histogram to disk
-            std::ofstream f(MPI::prefix + hisfile + ".walkersync" + std::to_string(nconv));
-            if (f) {
-                f << histo << endl;
-                f.close();
-            }*/
-
-            // print information to console
-            if (min > 0 and not quiet) {
-                std::cout << "Barriers/kT: penalty = " << penalty.maxCoeff()
-                     << " histogram = " << std::log(double(histo.maxCoeff()) / histo.minCoeff()) << std::endl;
-            }
+int PenaltyMPI::windowDistance(double row) const {
+    return std::max({0, row_begin - int(row), int(row) - (row_end - 1)});
+}
 
-            histo.setZero();
-            f0 = f0 * scale; // reduce penalty energy
-            samplings = std::ceil(samplings / scale);
-        }
+void PenaltyMPI::to_json(json &j) const {
+    Penalty::to_json(j);
+    if (windows > 1) {
+        j["windows"] = windows;
+        j["overlap"] = overlap;
+        j["window"] = {row_begin, row_end - 1};
+    }
+}
+
+/**
+ * The window communicator is created upon the first exchange so that
+ * instances never updated (e.g. copies used for energy evaluation only)
+ * do not take part in collective calls.
+ */
+void PenaltyMPI::exchange() {
+    if (window_comm == MPI_COMM_NULL) {
+        int window = MPI::mpi.rank() / (MPI::mpi.nproc() / windows);
+        MPI_Comm_split(MPI::mpi.comm, window, MPI::mpi.rank(), &window_comm);
     }
+    auto n = penalty_delta.size();
+    Eigen::Map<Eigen::MatrixXd>(sendbuf.data(), penalty_delta.rows(), penalty_delta.cols()) = penalty_delta;
+    Eigen::Map<Eigen::MatrixXd>(sendbuf.data() + n, histo_delta.rows(), histo_delta.cols()) = histo_delta;
+    penalty_delta.setZero();
+    histo_delta.setZero();
+    MPI_Iallreduce(sendbuf.data(), recvbuf.data(), sendbuf.size(), MPI_DOUBLE, MPI_SUM, window_comm, &request);
+}
+
+/**
+ * Own increments are already in `penalty`, so only the difference between
+ * the reduced and sent increments is added. All walkers in a window receive
+ * the same sums and hence make the same decision to reduce `f0`.
+ */
+void PenaltyMPI::applyExchange() {
+    if (request == MPI_REQUEST_NULL)
+        return;
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    auto n = penalty_delta.size();
+    auto rows = penalty_delta.rows(), cols = penalty_delta.cols();
+    auto block = penalty.block(row_begin, 0, rows, cols);
+    block += Eigen::Map<Eigen::MatrixXd>(recvbuf.data(), rows, cols) -
+             Eigen::Map<Eigen::MatrixXd>(sendbuf.data(), rows, cols);
+    window_histo += Eigen::Map<Eigen::MatrixXd>(recvbuf.data() + n, rows, cols);
+
+    if (window_histo.minCoeff() >= samplings) {
+        double min = block.minCoeff();
+        block.array() -= min;
+        if (not quiet)
+            faunus_logger->info("Barriers/kT: penalty = {} histogram = {}", block.maxCoeff(),
+                                std::log(window_histo.maxCoeff() / window_histo.minCoeff()));
+        window_histo.setZero();
+        histo.setZero();
+        f0 = f0 * scale; // reduce penalty energy
+        samplings = std::ceil(samplings / scale);
+        nconv += 1;
+    }
+}
+
+void PenaltyMPI::update(const std::vector<double> &c) {
+    if (++cnt % nupdate == 0 and f0 > 0) {
+        applyExchange(); // complete previous exchange...
+        exchange();      // ...and start the next
+    }
+    increment(c);
+    if (int row = int(coord[0]) - row_begin; row >= 0 and row < penalty_delta.rows()) { // initially maybe outside
+        penalty_delta(row, int(coord[1])) += f0;
+        histo_delta(row, int(coord[1])) += 1;
+    }
+}
+
+void PenaltyMPI::increment(const std::vector<double> &c) {
+    double uold = penalty[c];
     coord = c;
     histo[coord]++;
     penalty[coord] += f0;
     udelta += penalty[coord] - uold;
 }
 
+/**
+ * The accepted (`OLD`) instance updates the penalty function and exchanges increments
+ * with the other walkers, whereas the trial instance only adds its own increment. After
+ * an exchange, the trial instance instead copies the accepted penalty function.
+ */
+void PenaltyMPI::sync(Energybase *basePtr, Change &) {
+    auto other = dynamic_cast<PenaltyMPI *>(basePtr);
+    assert(other);
+    auto accepted = (key == OLD) ? this : other;
+    auto trial = (accepted == this) ? other : this;
+    const auto c = other->coord;
+    accepted->update(c);
+    if (accepted->cnt % nupdate == 0) {
+        trial->penalty = accepted->penalty;
+        trial->histo = accepted->histo;
+        trial->f0 = accepted->f0;
+        trial->samplings = accepted->samplings;
+        trial->nconv = accepted->nconv;
+        trial->udelta = accepted->udelta;
+        trial->coord = accepted->coord;
+        trial->cnt = accepted->cnt;
+    } else {
+        trial->cnt++;
+        trial->increment(c);
+    }
+    assert(trial->cnt == accepted->cnt and trial->udelta == accepted->udelta);
+}
+
+/**
+ * Must be called by all walkers after the last step, as exchange and stitching are
+ * collective calls. Unlike a destructor, this is never called while unwinding from an
+ * exception on a single process, which would leave the other processes waiting.
+ */
+void PenaltyMPI::finalize() {
+    if (window_comm != MPI_COMM_NULL) { // only the accepted instance takes part
+        applyExchange();
+        if (windows > 1 and overwrite_penalty)
+            stitch();
+        MPI_Comm_free(&window_comm);
+    }
+}
+
+/**
+ * The first walker in each window contributes its penalty function and the
+ * stitched function is saved by the master without the MPI prefix.
+ */
+void PenaltyMPI::stitch() {
+    using namespace Faunus::MPI;
+    int walkers = mpi.nproc() / windows;
+    Eigen::MatrixXd all(penalty.rows(), penalty.cols() * mpi.nproc());
+    std::vector<int> ranges(2 * mpi.nproc());
+    int range[2] = {row_begin, row_end};
+    MPI_Gather(penalty.data(), penalty.size(), MPI_DOUBLE, all.data(), penalty.size(), MPI_DOUBLE, 0, mpi.comm);
+    MPI_Gather(range, 2, MPI_INT, ranges.data(), 2, MPI_INT, 0, mpi.comm);
+    if (mpi.isMaster()) {
+        std::vector<Eigen::MatrixXd> tables;
+        std::vector<std::pair<int, int>> rows;
+        for (int rank = 0; rank < mpi.nproc(); rank += walkers) {
+            tables.push_back(all.middleCols(rank * penalty.cols(), penalty.cols()));
+            rows.emplace_back(ranges[2 * rank], ranges[2 * rank + 1]);
+        }
+        std::ofstream f(file);
+        if (f) {
+            f.precision(16);
+            f << "# " << f0 << " " << samplings << " " << nconv << "\n" << stitchWindows(tables, rows) << "\n";
+        }
+    }
+}
+
 #endif
 } // namespace Energy
 } // namespace Faunus
@@ -50,15 +50,68 @@ class Penalty : public Energybase {
     virtual void update(const std::vector<double> &c);
 
     void sync(Energybase *basePtr, Change &) override; // @todo: this doubles the MPI communication
+    void saveCheckpoint(cereal::BinaryOutputArchive &) const override; //!< Save histogram and penalty function
+    void loadCheckpoint(cereal::BinaryInputArchive &) override;        //!< Load histogram and penalty function
 };
 
+/**
+ * @brief Stitch penalty functions from overlapping windows along the first coordinate
+ * @param tables Penalty function of each window (full table size)
+ * @param rows Range of rows, `[begin,end)`, covered by each window
+ * @return Penalty function over all rows, shifted to a minimum of zero
+ *
+ * Each window is shifted by the mean difference to the already stitched
+ * windows in the overlapping rows, whereafter overlapping rows are averaged.
+ */
+Eigen::MatrixXd stitchWindows(const std::vector<Eigen::MatrixXd> &tables, const std::vector<std::pair<int, int>> &rows);
+
+#ifdef DOCTEST_LIBRARY_INCLUDED
+TEST_CASE("[Faunus] stitchWindows") {
+    Eigen::MatrixXd a(6, 1), b(6, 1);
+    a << 0, 1, 2, 3, 0, 0;  // rows [0,4)
+    b << 0, 0, 12, 13, 14, 15; // rows [2,6), offset by 10
+    auto f = stitchWindows({a, b}, {{0, 4}, {2, 6}});
+    CHECK(f.rows() == 6);
+    for (int i = 0; i < 6; i++)
+        CHECK(f(i, 0) == doctest::Approx(i));
+}
+#endif
+
 #ifdef ENABLE_MPI
+/**
+ * @brief Multiple-walker penalty function with windows along the first coordinate
+ *
+ * Processes are divided into `windows` groups, each restricted to an
+ * interval of rows of the first reaction coordinate; neighboring intervals overlap.
+ * Walkers in the same window build a common penalty function by summing their
+ * penalty and histogram increments since the last exchange. Only the rows of the
+ * window are reduced, and the reduction is non-blocking so that it overlaps with
+ * the following `update` steps. At the end, windows are stitched into a single
+ * function using the overlapping rows.
+ */
 struct PenaltyMPI : public Penalty {
-    Eigen::VectorXi weights; // array w. mininum histogram counts
-    Eigen::VectorXd buffer;  // receive buffer for penalty functions
+    int windows = 1;                       //!< Number of windows along the first coordinate
+    int row_begin = 0, row_end = 0;        //!< Rows of first coordinate covered by this walker
+    double overlap = 0.2;                  //!< Overlap between neighboring windows (fraction of window)
+    MPI_Comm window_comm = MPI_COMM_NULL;  //!< Walkers sharing the same window
+    MPI_Request request = MPI_REQUEST_NULL; //!< Pending reduction of increments
+    Eigen::MatrixXd penalty_delta;         //!< Penalty increments in window since last exchange
+    Eigen::MatrixXd histo_delta;           //!< Histogram increments in window since last exchange
+    Eigen::MatrixXd window_histo;          //!< Histogram from all walkers in window
+    Eigen::VectorXd sendbuf, recvbuf;      //!< Packed increments (penalty, then histogram)
+
+    void exchange();     //!< Start non-blocking reduction of increments
+    void applyExchange(); //!< Wait for and apply reduced increments from other walkers
+    void stitch();       //!< Collect windows on master and save stitched penalty function
+    void increment(const std::vector<double> &c); //!< Add penalty and histogram count at coordinate
+    int windowDistance(double row) const; //!< Number of rows from `row` to the window (zero if inside)
 
     PenaltyMPI(const json &j, Space &spc);
-    void update(const std::vector<double> &c) override; //!< Average penalty function across all nodes
+    double energy(Change &change) override;
+    void to_json(json &j) const override;
+    void update(const std::vector<double> &c) override; //!< Share penalty increments within window
+    void sync(Energybase *basePtr, Change &change) override; //!< Only the accepted instance communicates
+    void finalize(); //!< Complete pending exchange and stitch windows; collective call on all walkers
 };    //!< Penalty function with MPI exchange
 #endif
 
@@ -289,6 +289,7 @@ PYBIND11_MODULE(pyfaunus, m)
         .def("to_dict",
              [](Analysis::CombinedAnalysis &self) {
                  json j;
+                 self.flush(); // wait for asynchronous analyses
                  Faunus::to_json(j, self);
                  return json2dict(j);
              })
@@ -44,5 +44,5 @@ namespace Faunus {
         return d(engine);
     }
 
-    Random random; // Global instance
+    thread_local Random random; // Global instance (one per thread)
 }
@@ -43,7 +43,7 @@ namespace Faunus {
     void to_json(nlohmann::json&, const Random&);   //!< Random to json conversion
     void from_json(const nlohmann::json&, Random&); //!< json to Random conversion
 
-    extern Random random; // global instance of Random
+    extern thread_local Random random; // global instance of Random (one per thread)
 
 #ifdef DOCTEST_LIBRARY_INCLUDED
     TEST_CASE("[Faunus] Random")
@@ -1,8 +1,15 @@
 #pragma once
 
+#include "celllist.h"
+#include <unsupported/Eigen/FFT>
+#include <complex>
 #include <fstream>
 #include <algorithm>
 #include <cmath>
+#include <map>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace Faunus {
 
@@ -49,11 +56,18 @@ template <class T = float> struct FormFactorUnity {
  * It is important to note that distances should be calculated without periodicity and if molecules cross
  * periodic boundaries, these must be made whole before performing the analysis.
  *
+ * Rather than evaluating sin(qr)/(qr) for every pair and mesh point, pair distances are binned
+ * into fine histograms, one for each pair of form factor classes. Points belong to the same class if their
+ * form factors are identical on the whole q mesh. Intensities are obtained only when requested, as the product of the
+ * averaged histograms and a cached matrix of sin(qr)/(qr) evaluated at the bin centers, and
+ * the cost of a sample is thus independent of the number of mesh points.
+ *
  * The JSON object is scanned for the following keywords:
  *
  * - `qmin` minimum q value (1/angstrom)
  * - `qmax` maximum q value (1/angstrom)
  * - `dq` q mesh spacing (1/angstrom)
+ * - `dr` distance resolution of pair histograms (angstrom)
  * - `cutoff` cutoff distance (angstrom); *Experimental!*
  *
  * @see http://dx.doi.org/10.1016/S0022-2860(96)09302-7
@@ -61,15 +75,13 @@ template <class T = float> struct FormFactorUnity {
 template <class Tformfactor, class T = float> class DebyeFormula {
     static constexpr T r_cutoff_infty = 1e9; //<! a cutoff distance in angstrom considered to be infinity
     T q_mesh_min, q_mesh_max, q_mesh_step; //<! q_mesh parameters in inverse angstrom; used for inline lambda-functions
+    int mesh_size = 0;                     //<! number of mesh points
 
     /**
      * @param m mesh point index
      * @return the scattering vector magnitude q at the mesh point m
      */
-    #pragma omp declare simd uniform(this) linear(m:1)
-    inline T q_mesh(int m) {
-        return q_mesh_min + m * q_mesh_step;
-    }
+    inline T q_mesh(int m) const { return q_mesh_min + m * q_mesh_step; }
 
     /**
      * @brief Initialize mesh for intensity and sampling.
@@ -87,28 +99,155 @@ template <class Tformfactor, class T = float> class DebyeFormula {
         q_mesh_step = q_step;
         try {
             // resolution of the 1D mesh approximation of the scattering vector magnitude q
-            const int q_resolution = numeric_cast<int>(1 + std::floor((q_max - q_min) / q_step));
-            intensity.resize(q_resolution, 0.0);
-            sampling.resize(q_resolution, 0.0);
+            mesh_size = numeric_cast<int>(1 + std::floor((q_max - q_min) / q_step));
         } catch (std::overflow_error &e) {
             throw std::range_error("DebyeFormula: Too many samples");
         }
     }
 
-    Geometry::Sphere geo = Geometry::Sphere(r_cutoff_infty / 2); //!< geometry to use for distance calculations
+    typedef std::vector<double> Thistogram;
     T r_cutoff;                   //!< cut-off distance for scattering contributions (angstrom)
+    T dr;                         //!< distance resolution of pair histograms (angstrom)
     Tformfactor form_factor;      //!< scattering from a single particle
-    std::vector<T> intensity;     //!< sampled average I(q)
-    std::vector<T> sampling;      //!< weighted number of samplings
+    std::vector<std::vector<T>> form_factors;   //!< form factor of each class on the q mesh
+    std::map<std::pair<int, int>, int> pair_classes; //!< histogram index of each pair of classes (a<=b)
+    std::vector<Thistogram> histograms;        //!< weighted sum of pair counts, 2*w/N, of each class pair
+    std::vector<std::vector<Thistogram>> thread_histograms; //!< pair counts of current sample for each thread
+    std::vector<double> self;                  //!< weighted sum of fraction of points in each class
+    std::vector<int> classes;                  //!< class of each point in current sample
+    std::vector<T> sinc;                       //!< cached sin(qr)/(qr) for each bin (row) and mesh point (column)
+    size_t sinc_bins = 0;                      //!< number of bins in `sinc`
+    double sum_weights = 0;                    //!< sum of all sample weights
+    double sum_density = 0;                    //!< weighted sum of number densities used for cut-off correction
+    PeriodicCellList cells;                    //!< used to find pairs within cut-off
+
+    /** @brief Find form factor class of each point; new classes are added as needed */
+    template <class Tpvec> void classify(const Tpvec &p) {
+        std::vector<T> row(mesh_size);
+        classes.resize(p.size());
+        for (size_t i = 0; i < p.size(); i++) {
+            for (int m = 0; m < mesh_size; ++m)
+                row[m] = form_factor(q_mesh(m), p[i]);
+            auto it = std::find(form_factors.begin(), form_factors.end(), row);
+            classes[i] = it - form_factors.begin();
+            if (it == form_factors.end()) {
+                form_factors.push_back(row);
+                self.push_back(0);
+            }
+        }
+    }
+
+    /** @brief Histogram index of all class pairs, K x K */
+    std::vector<int> pairIndex() {
+        const int K = form_factors.size();
+        std::vector<int> index(K * K);
+        for (int a = 0; a < K; a++)
+            for (int b = a; b < K; b++) {
+                auto it = pair_classes.emplace(std::make_pair(a, b), int(pair_classes.size())).first;
+                index[a * K + b] = index[b * K + a] = it->second;
+            }
+        histograms.resize(pair_classes.size());
+        return index;
+    }
+
+    /**
+     * @brief Bin all pair distances into thread-private histograms
+     *
+     * With a cut-off, candidate pairs are found with a cell list spanning
+     * the bounding box of all points; periodicity of the cell list only adds
+     * candidates that are rejected by the distance check.
+     */
+    template <class Tpvec> void countPairs(const Tpvec &p, const std::vector<int> &pair_index) {
+        const int N = (int)p.size();
+        const int K = form_factors.size();
+        int num_threads = 1;
+#ifdef _OPENMP
+        num_threads = omp_get_max_threads();
+#endif
+        thread_histograms.resize(num_threads);
+        for (auto &thread_histogram : thread_histograms) {
+            thread_histogram.resize(histograms.size());
+            for (auto &bins : thread_histogram)
+                std::fill(bins.begin(), bins.end(), 0.0);
+        }
+
+        const bool use_cells = r_cutoff < r_cutoff_infty;
+        Point center = Point::Zero();
+        if (use_cells) {
+            Point lo = p[0], hi = p[0];
+            for (auto &point : p) {
+                lo = lo.cwiseMin(point);
+                hi = hi.cwiseMax(point);
+            }
+            center = 0.5 * (lo + hi);
+            Point box = (hi - lo).array() + double(r_cutoff);
+            double cellsize = std::max(double(r_cutoff), std::cbrt(box.prod() / N)); // limit number of empty cells
+            cells.resize(box, cellsize);
+            for (int i = 0; i < N; i++)
+                cells.insert(i, p[i] - center);
+        }
+        const double r_cutoff_squared = double(r_cutoff) * r_cutoff;
+        const double dr_inv = 1.0 / dr;
+
+#pragma omp parallel
+        {
+            int thread = 0;
+#ifdef _OPENMP
+            thread = omp_get_thread_num();
+#endif
+            auto &thread_histogram = thread_histograms[thread];
+            auto add = [&](int i, int j) {
+                double r2 = (p[i] - p[j]).squaredNorm();
+                if (r2 < r_cutoff_squared) {
+                    auto &bins = thread_histogram[pair_index[classes[i] * K + classes[j]]];
+                    size_t bin = std::sqrt(r2) * dr_inv;
+                    if (bin >= bins.size())
+                        bins.resize(bin + 1, 0.0);
+                    bins[bin] += 1;
+                }
+            };
+#pragma omp for schedule(dynamic, 64)
+            for (int i = 0; i < N - 1; ++i) {
+                if (use_cells)
+                    cells.forEachNeighbor(cells.p2c(p[i] - center), [&](size_t j) {
+                        if (int(j) > i)
+                            add(i, j);
+                    });
+                else
+                    for (int j = i + 1; j < N; ++j)
+                        add(i, j);
+            }
+        }
+    }
+
+    /** @brief Extend cached sin(qr)/(qr) matrix to cover given number of bins */
+    void updateSinc(size_t bins) {
+        if (bins > sinc_bins) {
+            sinc.resize(bins * mesh_size);
+#pragma omp parallel for
+            for (int bin = int(sinc_bins); bin < int(bins); bin++) {
+                const T r = (bin + 0.5) * dr;
+                for (int m = 0; m < mesh_size; ++m) {
+                    const T qr = q_mesh(m) * r;
+                    sinc[bin * mesh_size + m] = std::sin(qr) / qr;
+                }
+            }
+            sinc_bins = bins;
+        }
+    }
 
   public:
-    DebyeFormula(T q_min, T q_max, T q_step, T r_cutoff) : r_cutoff(r_cutoff) { init_mesh(q_min, q_max, q_step); };
+    DebyeFormula(T q_min, T q_max, T q_step, T r_cutoff, T dr = 0.05) : r_cutoff(r_cutoff), dr(dr) {
+        if (dr <= 0 || r_cutoff <= 0)
+            throw std::range_error("DebyeFormula: Invalid distance resolution or cut-off");
+        init_mesh(q_min, q_max, q_step);
+    };
 
-    DebyeFormula(T q_min, T q_max, T q_step) : DebyeFormula(r_cutoff_infty, q_min, q_max, q_step) {};
+    DebyeFormula(T q_min, T q_max, T q_step) : DebyeFormula(q_min, q_max, q_step, r_cutoff_infty) {};
 
     explicit DebyeFormula(const json &j)
         : DebyeFormula(j.at("qmin").get<double>(), j.at("qmax").get<double>(), j.at("dq").get<double>(),
-                       j.value("cutoff", r_cutoff_infty)){};
+                       j.value("cutoff", r_cutoff_infty), j.value("dr", 0.05)){};
 
     /**
      * @brief Sample I(q) and add to average.
@@ -119,65 +258,32 @@ template <class Tformfactor, class T = float> class DebyeFormula {
      * An isotropic correction is added beyond a given cut-off distance. For physics details see for example
      * @see https://debyer.readthedocs.org/en/latest/.
      *
-     * O(N^2) * O(M) complexity where N is the number of particles and M the number of mesh points. The quadratic
-     * complexity in N comes from the fact that the radial distribution function has to be computed.
-     * The current implementation supports OpenMP parallelization. Roughly half of the execution time is spend
-     * on computing sin values, e.g., in sinf_avx2.
+     * O(N^2) complexity where N is the number of particles; with a cut-off, the complexity
+     * is O(N) using cell lists. Pair counting supports OpenMP parallelization.
      */
     template <class Tpvec> void sample(const Tpvec &p, const T weight = 1, const T volume = -1) {
-        const int N = (int) p.size(); // number of particles
-        const int M = (int) intensity.size(); // number of mesh points
-        std::vector<T> intensity_sum(M, 0.0);
-
-        // Allow parallelization with a hand written reduction of intensity_sum at the end.
-        // https://gcc.gnu.org/gcc-9/porting_to.html#ompdatasharing
-        // #pragma omp parallel default(none) shared(N, M) shared(geo, r_cutoff, p) shared(intensity_sum)
-        #pragma omp parallel default(shared) shared(intensity_sum)
-        {
-            std::vector<T> intensity_sum_private(M, 0.0); // a temporal private intensity_sum
-            #pragma omp for schedule(dynamic)
-            for (int i = 0; i < N - 1; ++i) {
-                for (int j = i + 1; j < N; ++j) {
-                    T r = geo.sqdist(p[i], p[j]); // the square root follows
-                    if (r < r_cutoff * r_cutoff) {
-                        r = std::sqrt(r);
-                        // Black magic: The q_mesh function must be inlineable otherwise the loop cannot be unrolled
-                        // using advanced SIMD instructions leading to a huge performance penalty (a factor of 4).
-                        // The unrolled loop uses a different sin implementation, which may be spotted when profiling.
-                        // TODO: Optimize also for other compilers than GCC by using a vector math library, e.g.,
-                        // TODO: https://github.com/vectorclass/version2
-                        // #pragma GCC unroll 16 // for diagnostics, GCC issues warning when cannot unroll
-                        for (int m = 0; m < M; ++m) {
-                            const T q = q_mesh(m);
-                            intensity_sum_private[m] +=
-                                form_factor(q, p[i]) * form_factor(q, p[j]) * std::sin(q * r) / (q * r);
-                        }
-                    }
-                }
-            }
-            // reduce intensity_sum_private into intensity_sum
-            #pragma omp critical
-            std::transform(intensity_sum.begin(), intensity_sum.end(), intensity_sum_private.begin(),
-                           intensity_sum.begin(), std::plus<T>());
-        }
-
-        // https://gcc.gnu.org/gcc-9/porting_to.html#ompdatasharing
-        // #pragma omp parallel for default(none) shared(N, M, weight, volume) shared(p, r_cutoff, intensity_sum) shared(sampling, intensity)
-        #pragma omp parallel for shared(sampling, intensity)
-        for (int m = 0; m < M; ++m) {
-            const T q = q_mesh(m);
-            T intensity_self_sum = 0;
-            for (int i = 0; i < N; ++i) {
-                intensity_self_sum += std::pow(form_factor(q, p[i]), 2);
-            }
-            T intensity_corr = 0;
-            if (r_cutoff < r_cutoff_infty && volume > 0) {
-                intensity_corr = 4 * pc::pi * N / (volume * std::pow(q, 3)) *
-                         (q * r_cutoff * std::cos(q * r_cutoff) - std::sin(q * r_cutoff));
+        const int N = (int)p.size(); // number of particles
+        if (N == 0)
+            return;
+        classify(p);
+        auto pair_index = pairIndex();
+        countPairs(p, pair_index);
+
+        // add pair counts, 2 * weight / N, from all threads to the average
+        for (auto &thread_histogram : thread_histograms)
+            for (size_t h = 0; h < thread_histogram.size(); h++) {
+                auto &bins = thread_histogram[h];
+                auto &histogram = histograms[h];
+                if (histogram.size() < bins.size())
+                    histogram.resize(bins.size(), 0.0);
+                for (size_t bin = 0; bin < bins.size(); bin++)
+                    histogram[bin] += 2.0 * weight * bins[bin] / N;
             }
-            sampling[m] += weight;
-            intensity[m] += ((2 * intensity_sum[m] + intensity_self_sum) / N + intensity_corr) * weight;
-        }
+        for (auto k : classes)
+            self[k] += double(weight) / N;
+        if (r_cutoff < r_cutoff_infty && volume > 0)
+            sum_density += weight * N / volume;
+        sum_weights += weight;
     }
 
     /**
@@ -191,10 +297,31 @@ template <class Tformfactor, class T = float> class DebyeFormula {
      * @return a map containing q (key) and average intensity (value)
      */
     auto getIntensity() {
+        size_t bins = 0;
+        for (auto &histogram : histograms)
+            bins = std::max(bins, histogram.size());
+        updateSinc(bins);
+        std::vector<double> intensity(mesh_size, 0.0);
+        for (auto [classpair, h] : pair_classes) {
+            auto &F1 = form_factors[classpair.first];
+            auto &F2 = form_factors[classpair.second];
+            auto &histogram = histograms[h];
+            for (size_t bin = 0; bin < histogram.size(); bin++)
+                if (histogram[bin] > 0) {
+                    const T *sinc_row = sinc.data() + bin * mesh_size;
+                    for (int m = 0; m < mesh_size; ++m)
+                        intensity[m] += histogram[bin] * F1[m] * F2[m] * sinc_row[m];
+                }
+        }
         std::map<T, T> averaged_intensity;
-        for (size_t m = 0; m < intensity.size(); ++m) {
-            const T average = intensity[m] / (sampling[m] != 0.0 ? sampling[m] : 1.0);
-            averaged_intensity.emplace(q_mesh(m), average);
+        for (int m = 0; m < mesh_size; ++m) {
+            const T q = q_mesh(m);
+            for (size_t k = 0; k < self.size(); k++)
+                intensity[m] += self[k] * std::pow(form_factors[k][m], 2);
+            if (r_cutoff < r_cutoff_infty)
+                intensity[m] += 4 * pc::pi * sum_density / std::pow(q, 3) *
+                                (q * r_cutoff * std::cos(q * r_cutoff) - std::sin(q * r_cutoff));
+            averaged_intensity.emplace(q, intensity[m] / (sum_weights != 0.0 ? sum_weights : 1.0));
         }
         return averaged_intensity;
     }
@@ -374,5 +501,134 @@ template <typename T = float, typename TSamplingPolicy = SamplingPolicy<T>> clas
     using TSamplingPolicy::getSampling;
 };
 
+/**
+ * @brief Calculate structure factor for all lattice vectors of a periodic cuboid using FFT
+ *
+ * Particles, optionally weighted by e.g. their charge, are assigned to a regular grid of `grid`^3 points
+ * using cloud-in-cell interpolation, and the Fourier transform of the density,
+ * @f$ \rho(\mathbf{q}) = \sum_j w_j \exp(-i\mathbf{qr}_j) @f$, is obtained for all lattice vectors
+ * @f$ \mathbf{q} = 2\pi(h/L_x, k/L_y, l/L_z) @f$ by 3D FFT. Aliasing is reduced by interlacing, i.e.
+ * averaging with a second grid shifted by half a grid spacing, and the interpolation is corrected
+ * for by dividing with the Fourier transform of the assignment function, whereafter
+ *
+ * @f[ S(\mathbf{q}) = \frac{1}{N} \left | \rho(\mathbf{q}) \right |^2 @f]
+ *
+ * is radially averaged for all vectors with @f$ |h|,|k|,|l| \leq p_{max} @f$. The complexity is
+ * O(N + G log G) where G is the number of grid points. Errors decrease with the ratio
+ * of `grid` and @f$ p_{max} @f$ which is four by default.
+ *
+ * @see http://doi.org/10.1093/mnras/stw2229 (interlacing)
+ */
+template <typename T = double, typename TSamplingPolicy = SamplingPolicy<T>>
+class StructureFactorFFT : private TSamplingPolicy {
+    typedef std::complex<T> Tcomplex;
+    const int p_max;                     //!< maximum Miller index to be sampled
+    const int grid;                      //!< number of grid points in each direction
+    std::array<std::vector<Tcomplex>, 2> meshes; //!< density on grid, then its Fourier transform (row-major)
+    std::vector<T> window;               //!< Fourier transform of assignment function along an axis
+    using TSamplingPolicy::addSampling;
+
+    inline size_t index(int i, int j, int k) const { return (size_t(i) * grid + j) * grid + k; }
+
+    /** @brief Cloud-in-cell assignment with positions shifted by given number of grid spacings */
+    template <class Tpositions>
+    void assign(std::vector<Tcomplex> &mesh, const Tpositions &positions, const Point &box,
+                const std::vector<T> &weights, T shift) {
+        std::fill(mesh.begin(), mesh.end(), Tcomplex(0));
+        for (size_t n = 0; n < positions.size(); n++) {
+            const T w = weights.empty() ? 1 : weights[n];
+            std::array<int, 3> i0, i1;
+            std::array<T, 3> f;
+            for (int d = 0; d < 3; d++) {
+                T u = (positions[n][d] / box[d] + 0.5) * grid + shift;
+                T floor = std::floor(u);
+                f[d] = u - floor;
+                i0[d] = ((int(floor) % grid) + grid) % grid;
+                i1[d] = (i0[d] + 1) % grid;
+            }
+            for (int a = 0; a < 2; a++)
+                for (int b = 0; b < 2; b++)
+                    for (int c = 0; c < 2; c++)
+                        mesh[index(a ? i1[0] : i0[0], b ? i1[1] : i0[1], c ? i1[2] : i0[2])] +=
+                            w * (a ? f[0] : 1 - f[0]) * (b ? f[1] : 1 - f[1]) * (c ? f[2] : 1 - f[2]);
+        }
+    }
+
+    /** @brief In-place 3D Fourier transform as 1D transforms along all lines in each direction */
+    void transform(std::vector<Tcomplex> &mesh) {
+        for (int direction = 0; direction < 3; direction++) {
+            const size_t stride = (direction == 0) ? size_t(grid) * grid : (direction == 1) ? grid : 1;
+#pragma omp parallel
+            {
+                Eigen::FFT<T> fft; // plans are not shared between threads
+                std::vector<Tcomplex> in(grid), out(grid);
+#pragma omp for
+                for (int line = 0; line < grid * grid; line++) {
+                    int a = line / grid, b = line % grid; // the two other grid indices
+                    size_t start =
+                        (direction == 0) ? index(0, a, b) : (direction == 1) ? index(a, 0, b) : index(a, b, 0);
+                    for (int n = 0; n < grid; n++)
+                        in[n] = mesh[start + n * stride];
+                    fft.fwd(out, in);
+                    for (int n = 0; n < grid; n++)
+                        mesh[start + n * stride] = out[n];
+                }
+            }
+        }
+    }
+
+  public:
+    /**
+     * @param q_multiplier Maximum Miller index, p_max
+     * @param grid_size Number of grid points in each direction; default is 4*p_max
+     */
+    StructureFactorFFT(int q_multiplier, int grid_size = 0)
+        : p_max(q_multiplier), grid(grid_size > 0 ? grid_size : 4 * q_multiplier) {
+        if (p_max < 1 || grid <= 2 * p_max)
+            throw std::range_error("StructureFactorFFT: grid must be larger than twice the maximum index");
+        for (auto &mesh : meshes)
+            mesh.resize(size_t(grid) * grid * grid);
+        window.resize(grid);
+        for (int m = 0; m < grid; m++) {
+            int h = (m <= grid / 2) ? m : m - grid;
+            T x = pc::pi * h / grid;
+            window[m] = (h == 0) ? 1 : std::pow(std::sin(x) / x, 2); // cloud-in-cell
+        }
+    }
+
+    /**
+     * @param positions Positions in a cuboid centered at the origin
+     * @param box Side lengths of the cuboid
+     * @param weights Optional weight, e.g. charge, of each position; unity if empty
+     */
+    template <class Tpositions>
+    void sample(const Tpositions &positions, const Point &box, const std::vector<T> &weights = {}) {
+        assert(weights.empty() || weights.size() == positions.size());
+        if (positions.empty())
+            return;
+        for (int n = 0; n < 2; n++) {
+            assign(meshes[n], positions, box, weights, 0.5 * n);
+            transform(meshes[n]);
+        }
+        const T N = positions.size();
+        for (int h = -p_max; h <= p_max; h++)
+            for (int k = -p_max; k <= p_max; k++)
+                for (int l = -p_max; l <= p_max; l++)
+                    if (h != 0 || k != 0 || l != 0) {
+                        size_t i = index((h + grid) % grid, (k + grid) % grid, (l + grid) % grid);
+                        Tcomplex phase = std::polar(T(1), T(pc::pi * (h + k + l) / grid)); // undo half-spacing shift
+                        Tcomplex rho = T(0.5) * (meshes[0][i] + meshes[1][i] * phase);
+                        T w = window[(h + grid) % grid] * window[(k + grid) % grid] * window[(l + grid) % grid];
+                        const Point q = 2 * pc::pi * Point(h / box.x(), k / box.y(), l / box.z());
+                        addSampling(q.norm(), std::norm(rho) / (w * w * N), 1.0);
+                    }
+    }
+
+    int getQMultiplier() { return p_max; }
+    int getGridSize() { return grid; }
+
+    using TSamplingPolicy::getSampling;
+};
+
 } // namespace Scatter
 } // namespace Faunus
@@ -41,6 +41,34 @@ TEST_CASE("Benchmark") {
 }
 #endif
 
+TEST_CASE("[Faunus] StructureFactorFFT") {
+    std::map<double, double> explicit_result = {{0.0785, 1.48621}, {0.1111, 0.567279}, {0.136, 1.39515},
+                                                {0.1571, 0.730579}, {0.2221, 0.701547}, {0.2721, 0.692064}};
+    StructureFactorFFT<double> scatter(2, 32);
+    scatter.sample(positions, {box, box, box});
+    auto result = scatter.getSampling();
+    CHECK(result.size() == 9); // all lattice vectors, not only the 13 explicit directions
+    for (auto [q, S] : explicit_result)
+        CHECK(result.at(q) == Approx(S).epsilon(0.01));
+}
+
+TEST_CASE("[Faunus] DebyeFormula") {
+    DebyeFormula<FormFactorUnity<double>, double> debye(0.1, 0.5, 0.1, 1e9, 0.001);
+    debye.sample(positions);
+    debye.sample(positions, 2.0); // weights should not affect the average of identical samples
+    auto intensity = debye.getIntensity();
+    CHECK(intensity.size() == 5);
+    for (auto [q, I] : intensity) {
+        double sum = 0; // direct evaluation of the Debye formula
+        for (size_t i = 0; i < positions.size(); i++)
+            for (size_t j = i + 1; j < positions.size(); j++) {
+                double qr = q * (positions[i] - positions[j]).norm();
+                sum += std::sin(qr) / qr;
+            }
+        CHECK(I == Approx(1 + 2 * sum / positions.size()).epsilon(0.001));
+    }
+}
+
 TEST_CASE("[Faunus] StructureFactorIPBC") {
     size_t cnt = 0;
     std::vector<double> result = {0.0785, 0.384363, 0.1111, 1.51652, 0.136,  1.18027,
@@ -334,19 +334,39 @@ void to_json(json &j, Space &spc) {
     j["reactionlist"] = reactions;
     j["implicit_reservoir"] = spc.getImplicitReservoir();
 }
+/**
+ * The input of the loaded topology is kept so that e.g. replicas with different
+ * topologies are detected. Not thread safe; replicas are set up one at a time.
+ */
+void loadTopology(const json &j) {
+    static json loaded; // input from which the topology was loaded
+    if (atoms.empty())
+        loaded = json();
+    if (j.count("atomlist") > 0) {
+        json topology = {{"atomlist", j["atomlist"]},
+                         {"moleculelist", j.value("moleculelist", json())},
+                         {"reactionlist", j.value("reactionlist", json())}};
+        if (loaded.is_null())
+            loaded = topology;
+        else if (topology != loaded)
+            throw std::runtime_error("topology (atomlist, moleculelist, reactionlist) differs from the one already "
+                                     "loaded, e.g. by another replica");
+    }
+    if (atoms.empty())
+        atoms = j.at("atomlist").get<decltype(atoms)>();
+    if (molecules.empty())
+        molecules = j.at("moleculelist").get<decltype(molecules)>();
+    if (reactions.empty())
+        if (j.count("reactionlist") > 0)
+            reactions = j.at("reactionlist").get<decltype(reactions)>();
+}
+
 void from_json(const json &j, Space &spc) {
     typedef typename Space::Tpvec Tpvec;
     using namespace std::string_literals;
 
     try {
-        if (atoms.empty())
-            atoms = j.at("atomlist").get<decltype(atoms)>();
-        if (molecules.empty())
-            molecules = j.at("moleculelist").get<decltype(molecules)>();
-        if (reactions.empty())
-            if (j.count("reactionlist") > 0)
-                reactions = j.at("reactionlist").get<decltype(reactions)>();
-
+        loadTopology(j);
         spc.clear();
         spc.geo = j.at("geometry");
 
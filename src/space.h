@@ -263,6 +263,15 @@ void from_json(const json &j, Space &spc); //!< Deserialize json object to Space
  */
 void insertMolecules(const json &j, Space &spc); //!< Insert `N` molecules into space as defined in `insert`
 
+/**
+ * @brief Load global atom, molecule, and reaction lists from input unless already loaded
+ * @throw If the input defines a topology different from the one already loaded
+ *
+ * The topology is shared by all spaces and replicas in a process and is thus built only once.
+ * Clearing the atom list allows for loading a new topology.
+ */
+void loadTopology(const json &j);
+
 /**
  * @brief Helper class for range-based for-loops over *active* particles
  *
@@ -360,9 +360,9 @@ bool SpeciationMove::enoughImplicitMolecules() const {
 
 void SpeciationMove::_move(Change &change) {
     assert(other_spc != nullptr);        // knowledge of other space should be provided by now
-    if (not Faunus::reactions.empty()) { // global list of reactions
-        reaction = slump.sample(Faunus::reactions.begin(), Faunus::reactions.end()); // random reaction
-        assert(reaction != Faunus::reactions.end());
+    if (not reactions.empty()) { // copy of global list of reactions
+        reaction = slump.sample(reactions.begin(), reactions.end()); // random reaction
+        assert(reaction != reactions.end());
         auto direction = static_cast<ReactionData::Direction>((char)slump.range(0, 1)); // random direction
         reaction->setDirection(direction);
 
@@ -433,7 +433,7 @@ void SpeciationMove::_reject(Change &) {
     }
 }
 
-SpeciationMove::SpeciationMove(Tspace &spc) : spc(spc) {
+SpeciationMove::SpeciationMove(Tspace &spc) : spc(spc), reactions(Faunus::reactions) {
     name = "rcmc";
     cite = "doi:10/fqcpg3";
 }
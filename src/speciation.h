@@ -13,7 +13,8 @@ namespace Move {
  * species. Flow of events:
  *
  * 1. pick random `Faunus::ReactionData` object
- * 2. pick random direction (left or right)
+ * 2. pick random direction (left or right); the direction is set in a copy of
+ *    the reaction owned by the move, as the global reactions are shared by replicas
  * 3. perform appropriate action:
  *    - atomic swap
  *    - deactivate reactants
@@ -25,6 +26,7 @@ class SpeciationMove : public Movebase {
     Space &spc;                 //!< Trial space (particles, groups)
     Space *other_spc;           //!< Old space (particles, groups)
     double bond_energy = 0;     //!< Accumulated bond energy if inserted/deleted molecule
+    decltype(Faunus::reactions) reactions; //!< Own copy of the global reactions as the direction is changed
     reaction_iterator reaction; //!< Randomly selected reaction
 
     class AcceptanceData {
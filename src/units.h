@@ -23,7 +23,7 @@ namespace Faunus {
             Nav = 6.022137e23,       //!< Avogadro's number [1/mol]
             c = 299792458.0,         //!< Speed of light [m/s]
             R = kB * Nav;            //!< Molar gas constant [J/(K*mol)]
-        extern T temperature;        //!< Temperature (Kelvin)
+        extern thread_local T temperature; //!< Temperature (Kelvin); local to each replica thread
         static inline T kT() { return temperature*kB; } //!< Thermal energy (Joule)
         static inline T bjerrumLength(T epsilon_r) {
             return e*e/(4*pi*e0*epsilon_r*1e-10*kT());
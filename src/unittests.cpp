@@ -27,6 +27,8 @@
 #include "tensor_test.h"
 #include "externalpotential_test.h"
 #include "scatter_test.h"
+#include "analysis_test.h"
+#include "montecarlo_test.h"
 
 #include "mpicontroller.h"
 #include "auxiliary.h"
@@ -35,6 +37,8 @@
 #include "average.h"
 #include "tabulate.h"
 #include "move.h"
+#include "clustermove.h"
+#include "eventchain.h"
 #include "penalty.h"
 #include "celllist.h"
 #include "functionparser.h"